@@ -45,19 +45,13 @@
 
 - (void)loadFromVersionInfo:(EIVersionInfo*)vir
 {
-  NSArray *resSrch;
-  NSString *node, *keyPath, *value;
+  NSMutableArray *newList;
   
-  list = [[NSMutableArray alloc] init];
-  
-  resSrch = [vir querySubNodesUnder:@"\\StringFileInfo\\*" error:NULL];
-  
-  for (node in resSrch) {
-    keyPath = [NSString stringWithFormat:@"\\StringFileInfo\\*\\%@", node];
-    value = [vir queryStringValue:keyPath error:NULL];
-    if (value)
-      [list addObject:[NSString stringWithFormat:@"%@: %@", node, value]];
-  }
+  newList = [[NSMutableArray alloc] init];
+  [vir enumerateStringsInTable:nil usingBlock:^(NSString *node, NSString *value, BOOL *stop) {
+    [newList addObject:[NSString stringWithFormat:@"%@: %@", node, value]];
+  }];
+  list = newList;
 }
 
 
@@ -23,6 +23,7 @@
 #import <Cocoa/Cocoa.h>
 #import "EIExeFile.h"
 #import "EIVersionInfo.h"
+#import "EIExeFileSummary.h"
 #import "Utils.h"
 
 
@@ -67,51 +68,107 @@ NSString *QWAGetTemplate(void)
 }
 
 
-NSString *QWAHTMLVersionInfoForExeFile(EIExeFile *exeFile)
+static void QWAAppendHTMLRow(NSMutableString *html, NSString *node, NSString *value, NSBundle *mbundle)
+{
+  [html appendString:@"<tr><td>"];
+  NSString *tmp = NSLocalizedStringFromTableInBundle(node, @"VersioninfoNames", mbundle, nil);
+  [html appendString:QWAEscapeStringForHtml(tmp)];
+  [html appendString:@"</td><td>"];
+  [html appendString:QWAEscapeStringForHtml(value)];
+  [html appendString:@"</td></tr>"];
+}
+
+
+static void QWAAppendHTMLFixedFileInfo(NSMutableString *html, EIVersionInfo *vir, NSBundle *mbundle)
+{
+  NSMutableArray *flagNames;
+  uint32_t flags;
+  const char *desc;
+  
+  QWAAppendHTMLRow(html, @"FixedFileVersion", [vir fixedFileVersion], mbundle);
+  QWAAppendHTMLRow(html, @"FixedProductVersion", [vir fixedProductVersion], mbundle);
+  
+  flags = [vir fixedFileFlags];
+  flagNames = [NSMutableArray array];
+  if (flags & VS_FF_DEBUG) [flagNames addObject:@"Debug"];
+  if (flags & VS_FF_PRERELEASE) [flagNames addObject:@"Prerelease"];
+  if (flags & VS_FF_PATCHED) [flagNames addObject:@"Patched"];
+  if (flags & VS_FF_PRIVATEBUILD) [flagNames addObject:@"PrivateBuild"];
+  if (flags & VS_FF_SPECIALBUILD) [flagNames addObject:@"SpecialBuild"];
+  if ([flagNames count]) {
+    for (NSUInteger i = 0; i < [flagNames count]; i++)
+      flagNames[i] = NSLocalizedStringFromTableInBundle(flagNames[i], @"VersioninfoNames", mbundle, nil);
+    QWAAppendHTMLRow(html, @"FileFlags", [flagNames componentsJoinedByString:@", "], mbundle);
+  }
+  
+  desc = version_info_os_name([vir fixedFileOS]);
+  if (desc)
+    QWAAppendHTMLRow(html, @"FileOS",
+      NSLocalizedStringFromTableInBundle(@(desc), @"VersioninfoNames", mbundle, nil), mbundle);
+  desc = version_info_file_type_name([vir fixedFileType]);
+  if (desc)
+    QWAAppendHTMLRow(html, @"FileType",
+      NSLocalizedStringFromTableInBundle(@(desc), @"VersioninfoNames", mbundle, nil), mbundle);
+}
+
+
+NSString *QWAHTMLVersionInfoForSummary(EIExeFileSummary *summary)
 {
   NSMutableString *html;
   EIVersionInfo *vir;
-  NSString* queryHeader;
-  NSArray *resSrch;
   NSBundle *mbundle;
-  NSString *value, *node, *vpath;
+  EIPartStatus status;
   
   mbundle = [NSBundle bundleWithIdentifier:@"com.danielecattaneo.qlgenerator.qlwindowsapps"];
   html = [@"<tbody>" mutableCopy];
-  vir = [exeFile versionInfo];
-  if (!vir) return @"";
-  
-  queryHeader = @"\\StringFileInfo\\*";
-  resSrch = [vir querySubNodesUnder:queryHeader error:NULL];
-  if (!resSrch) return @"";
-  
-  for (node in resSrch) {
-    vpath = [NSString stringWithFormat:@"%@\\%@", queryHeader, node];
-    value = [vir queryStringValue:vpath error:NULL];
-    if (!value) continue;
-    
-    [html appendString:@"<tr><td>"];
-    NSString *tmp = NSLocalizedStringFromTableInBundle(node, @"VersioninfoNames", mbundle, nil);
-    [html appendString:QWAEscapeStringForHtml(tmp)];
-    [html appendString:@"</td><td>"];
-    [html appendString:QWAEscapeStringForHtml(value)];
-    [html appendString:@"</td></tr>"];
+  vir = [summary versionInfo];
+  if (!vir) {
+    /* say why the version info is missing if it could have been there */
+    status = [summary statusOfPart:EIExeFilePartVersionInfo];
+    if (status != EIPartStatusTimedOut
+        && [summary statusOfPart:EIExeFilePartHeader] != EIPartStatusTimedOut)
+      return @"";
+    QWAAppendHTMLRow(html, @"VersionInfo",
+      NSLocalizedStringFromTableInBundle(@"TimedOut", @"VersioninfoNames", mbundle, nil), mbundle);
+    [html appendString:@"</tbody>"];
+    return html;
   }
   
+  [vir enumerateStringsInTable:nil usingBlock:^(NSString *node, NSString *value, BOOL *stop) {
+    QWAAppendHTMLRow(html, node, value, mbundle);
+  }];
+  if ([vir hasFixedFileInfo])
+    QWAAppendHTMLFixedFileInfo(html, vir, mbundle);
+  
   [html appendString:@"</tbody>"];
   return html;
 }
 
 
-NSString *QWAGetImageSrcForExeFile(EIExeFile *exeFile, CFStringRef contentTypeUTI, NSURL *url)
+/* Returns the icon to show for an executable, from the cache if it is
+ * there. DLLs show the icon of their type instead of their own. */
+NSData *QWAIconDataForExeFile(EIExeFile *exeFile, CFStringRef contentTypeUTI, NSURL *url)
+{
+  if (!UTTypeEqual(contentTypeUTI, (CFStringRef)@"com.microsoft.windows-executable"))
+    return nil;
+  return QWACachedData(FILE_CACHE_ICON, url, ^NSData *{
+    NSData *data = [exeFile iconPNGData];
+    if (!data)
+      data = [exeFile iconData];
+    return data;
+  });
+}
+
+
+NSString *QWAGetImageSrcForIconData(NSData *image, NSURL *url)
 {
-  NSData *image;
   NSString *mimetype;
   
-  if (UTTypeEqual(contentTypeUTI, (CFStringRef)@"com.microsoft.windows-executable")) {
-    image = [exeFile iconData];
+  /* the cache keeps the PNG image if there is one, the icon otherwise */
+  if ([image length] >= 4 && memcmp([image bytes], "\x89PNG", 4) == 0)
+    mimetype = @"image/png";
+  else
     mimetype = @"image/x-icon";
-  }
   if (!image) {
     NSImage *icon = [[NSWorkspace sharedWorkspace] iconForFile:[url path]];
     NSRect proposedRect = NSMakeRect(0, 0, 512, 512);
@@ -125,6 +182,29 @@ NSString *QWAGetImageSrcForExeFile(EIExeFile *exeFile, CFStringRef contentTypeUT
 }
 
 
+/* The whole preview is read within PreviewTimeLimit milliseconds (50 by
+ * default, 0 for no limit), split among the parts of the file. Parts
+ * that take longer are left out of the preview. */
+EIExeFileBudget QWAPreviewBudget(void)
+{
+  EIExeFileBudget budget = EIExeFileInteractiveBudget;
+  NSNumber *limit;
+  double total, scale;
+  
+  limit = [QWAUserDefaults() objectForKey:@"PreviewTimeLimit"];
+  if (![limit isKindOfClass:[NSNumber class]])
+    return budget;
+  if ([limit doubleValue] <= 0)
+    return EIExeFileUnlimitedBudget;
+  total = budget.header + budget.icon + budget.versionInfo;
+  scale = [limit doubleValue] / 1000.0 / total;
+  budget.header *= scale;
+  budget.icon *= scale;
+  budget.versionInfo *= scale;
+  return budget;
+}
+
+
 void QWAReplaceHtmlPlaceholders(NSMutableString *html, NSDictionary *ph)
 {
   NSRegularExpression *phregex, *nameregex;
@@ -155,31 +235,39 @@ void QWAReplaceHtmlPlaceholders(NSMutableString *html, NSDictionary *ph)
 
 void QWAGeneratePreviewForURL(QLPreviewRequestRef preview, NSURL *url, CFStringRef contentTypeUTI)
 {
+  EIExeFileSummary *summary;
   EIExeFile *exeFile;
   NSMutableString *html;
   NSDictionary *props;
   NSMutableDictionary *elem;
-  NSString *icon;
   
-  exeFile = [[EIExeFile alloc] initWithExeFileURL:url error:nil];
-  if (!exeFile) return;
+  summary = [[EIExeFileSummary alloc] initWithExeFileURL:url budget:QWAPreviewBudget()
+    iconLoader:^NSData *(EIExeFile *exeFile) {
+      return QWAIconDataForExeFile(exeFile, contentTypeUTI, url);
+    }];
+  exeFile = [summary exeFile];
+  /* a file that took too long to open still gets a preview with its
+   * name and the icon of its type */
+  if (!exeFile && [summary statusOfPart:EIExeFilePartHeader] != EIPartStatusTimedOut) return;
   if (QLPreviewRequestIsCancelled(preview)) return;
+  if (![summary isComplete])
+    NSLog(@"Partial preview of %@ (%@)", url, [summary statusDescription]);
   
   html = [QWAGetTemplate() mutableCopy];
   elem = [NSMutableDictionary dictionary];
-  if (QLPreviewRequestIsCancelled(preview)) return;
   
-  /* Icon */
-  icon = QWAGetImageSrcForExeFile(exeFile, contentTypeUTI, url);
-  [elem setObject:icon forKey:@"ICON"];
-  if (QLPreviewRequestIsCancelled(preview)) return;
+  /* Icon; the icon of the file type if the icon was not read */
+  [elem setObject:QWAGetImageSrcForIconData([summary iconData], url) forKey:@"ICON"];
   
   /* File name and 16-bit badge */
-  [elem setObject:[NSString stringWithFormat:@"%d bit", [exeFile bitness]] forKey:@"BADGE"];
+  if (exeFile)
+    [elem setObject:[NSString stringWithFormat:@"%d bit", [exeFile bitness]] forKey:@"BADGE"];
+  else
+    [elem setObject:@"" forKey:@"BADGE"];
   [elem setObject:QWAEscapeStringForHtml([url lastPathComponent]) forKey:@"NAME"];
   
   /* Version info */
-  [elem setObject:QWAHTMLVersionInfoForExeFile(exeFile) forKey:@"TABLEBODY"];
+  [elem setObject:QWAHTMLVersionInfoForSummary(summary) forKey:@"TABLEBODY"];
   
   /* Generate HTML */
   QWAReplaceHtmlPlaceholders(html, elem);
@@ -202,15 +290,19 @@ void QWAGeneratePreviewForURL(QLPreviewRequestRef preview, NSURL *url, CFStringR
 OSStatus GeneratePreviewForURL(void *thisInterface, QLPreviewRequestRef preview, 
   CFURLRef url, CFStringRef contentTypeUTI, CFDictionaryRef options)
 {
+  WinCancelToken token;
+  
+  QWABeginCancellableRequest(preview, &token);
   @autoreleasepool {
     QWAGeneratePreviewForURL(preview, (__bridge NSURL*)url, contentTypeUTI);
   }
+  QWAEndCancellableRequest(preview);
   return noErr;
 }
 
 
 void CancelPreviewGeneration(void* thisInterface, QLPreviewRequestRef preview)
 {
-  // implement only if supported
+  QWACancelRequest(preview);
 }
 
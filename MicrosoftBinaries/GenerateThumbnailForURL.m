@@ -46,7 +46,6 @@ void QWAGenerateThumbnailForURL(QLThumbnailRequestRef thumbnail,
   NSURL *url, CFStringRef contentTypeUTI, CGSize maxSize)
 {
   NSNumber *fsize;
-  EIExeFile *exeFile;
   
   //No icon for DLLs
   if (!UTTypeEqual(contentTypeUTI, (CFStringRef)@"com.microsoft.windows-executable"))
@@ -61,11 +60,13 @@ void QWAGenerateThumbnailForURL(QLThumbnailRequestRef thumbnail,
     }
   }
   
-  exeFile = [[EIExeFile alloc] initWithExeFileURL:url error:nil];
-  if (!exeFile) return;
-  if (QLThumbnailRequestIsCancelled(thumbnail)) return;
-  
-  NSData *iconData = [exeFile iconData];
+  NSData *iconData = QWACachedData(FILE_CACHE_ICON, url, ^NSData *{
+    EIExeFile *exeFile = [[EIExeFile alloc] initWithExeFileURL:url error:nil];
+    NSData *data = [exeFile iconPNGData];
+    if (!data)
+      data = [exeFile iconData];
+    return data;
+  });
   if (!iconData) return;
   if (QLThumbnailRequestIsCancelled(thumbnail)) return;
   
@@ -91,15 +92,18 @@ void QWAGenerateThumbnailForURL(QLThumbnailRequestRef thumbnail,
 OSStatus GenerateThumbnailForURL(void *thisInterface, QLThumbnailRequestRef thumbnail,
   CFURLRef url, CFStringRef contentTypeUTI, CFDictionaryRef options, CGSize maxSize)
 {
+  WinCancelToken token;
   
+  QWABeginCancellableRequest(thumbnail, &token);
   @autoreleasepool {
     QWAGenerateThumbnailForURL(thumbnail, (__bridge NSURL*)url, contentTypeUTI, maxSize);
   }
+  QWAEndCancellableRequest(thumbnail);
   return noErr;
 }
 
 
 void CancelThumbnailGeneration(void* thisInterface, QLThumbnailRequestRef thumbnail)
 {
-    // implement only if supported
+  QWACancelRequest(thumbnail);
 }
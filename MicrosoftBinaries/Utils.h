@@ -17,6 +17,8 @@
  */
 
 #import <Foundation/Foundation.h>
+#import "EIFileCache.h"
+#include "cancel.h"
 
 
 /* Undocumented thumbnail properties
@@ -44,5 +46,9 @@ typedef NS_ENUM(NSInteger, QLThumbnailIconFlavor)
 
 
 NSUserDefaults *QWAUserDefaults(void);
+NSData *QWACachedData(uint32_t kind, NSURL *url, NSData *(^generator)(void));
+void QWABeginCancellableRequest(const void *request, WinCancelToken *token);
+void QWAEndCancellableRequest(const void *request);
+void QWACancelRequest(const void *request);
 
 
@@ -35,3 +35,84 @@ NSUserDefaults *QWAUserDefaults()
   return pluginDefaults;
 }
 
+
+/* The size of the cache in MiB can be set with the CacheSize default */
+static EIFileCache *QWAFileCache(void)
+{
+  static EIFileCache *cache;
+  static dispatch_once_t cacheOt;
+  
+  dispatch_once(&cacheOt, ^{
+    NSInteger mib = [QWAUserDefaults() integerForKey:@"CacheSize"];
+    if (mib <= 0)
+      mib = 32;
+    cache = [EIFileCache cacheNamed:@"QLWindowsApps.cache" maximumSize:mib * 1024 * 1024];
+  });
+  return cache;
+}
+
+
+/* Returns the data of the given kind cached for the file at url, or makes
+ * it with the generator if it is not there, or if the cache is not
+ * available. */
+NSData *QWACachedData(uint32_t kind, NSURL *url, NSData *(^generator)(void))
+{
+  EIFileCache *cache = QWAFileCache();
+  
+  if (!cache)
+    return generator();
+  return [cache dataOfKind:kind forFileURL:url generatedBy:generator];
+}
+
+
+/* The tokens of the requests being generated, by request. Quick Look
+ * cancels a request from another thread than the one generating it. */
+static NSMutableDictionary *QWACancelTokens(void)
+{
+  static NSMutableDictionary *tokens;
+  static dispatch_once_t tokensOt;
+  
+  dispatch_once(&tokensOt, ^{
+    tokens = [NSMutableDictionary dictionary];
+  });
+  return tokens;
+}
+
+
+/* Makes token the cancellation token of the calling thread until
+ * QWAEndCancellableRequest(), so that loading and extraction stop soon
+ * after QWACancelRequest() is called with the same request. */
+void QWABeginCancellableRequest(const void *request, WinCancelToken *token)
+{
+  NSMutableDictionary *tokens = QWACancelTokens();
+  
+  cancel_token_init(token, 0);
+  @synchronized (tokens) {
+    [tokens setObject:[NSValue valueWithPointer:token] forKey:[NSValue valueWithPointer:request]];
+  }
+  set_thread_cancel_token(token);
+}
+
+
+void QWAEndCancellableRequest(const void *request)
+{
+  NSMutableDictionary *tokens = QWACancelTokens();
+  
+  set_thread_cancel_token(NULL);
+  @synchronized (tokens) {
+    [tokens removeObjectForKey:[NSValue valueWithPointer:request]];
+  }
+}
+
+
+void QWACancelRequest(const void *request)
+{
+  NSMutableDictionary *tokens = QWACancelTokens();
+  
+  /* the token cannot go away while the lock is held */
+  @synchronized (tokens) {
+    NSValue *token = [tokens objectForKey:[NSValue valueWithPointer:request]];
+    if (token)
+      cancel_token_cancel([token pointerValue]);
+  }
+}
@@ -35,7 +35,12 @@
 
 - (NSImage *)icon;
 - (NSData *)iconData;
+- (NSData *)iconPNGData;
 - (EIVersionInfo *)versionInfo;
+- (EIVersionInfo *)versionInfoForLanguages:(NSArray *)langs;
+- (NSData *)versionInventoryData;
+- (NSData *)manifestData;
+- (NSDictionary *)manifestAttributes;
 - (NSURL *)url;
 - (int)bitness;
 
@@ -21,6 +21,9 @@
 #import "EIVersionInfo.h"
 #include <stdlib.h>
 #include "wrestool.h"
+#include "libcache.h"
+#include "verinventory.h"
+#include "manifest.h"
 
 
 #ifdef DEBUG
@@ -29,17 +32,46 @@
 #  define EILog(...)
 #endif
 
+/* Libraries are kept for the requests that follow in the same process,
+ * such as the preview after the thumbnail of a file. */
+#define EI_LIBRARY_CACHE_SIZE (64 * 1024 * 1024)
+#define EI_LIBRARY_CACHE_AGE  (30)
+
 
 @implementation EIExeFile
 
 
+/* The cache of loaded libraries shared by all the instances. A timer
+ * drops the old libraries even if no other file is opened. */
++ (WinLibraryCache *)libraryCache
+{
+  static WinLibraryCache *cache;
+  static dispatch_source_t timer;
+  static dispatch_once_t once;
+  
+  dispatch_once(&once, ^{
+    cache = new_library_cache(EI_LIBRARY_CACHE_SIZE, EI_LIBRARY_CACHE_AGE);
+    timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
+        dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+    dispatch_source_set_timer(timer,
+        dispatch_time(DISPATCH_TIME_NOW, EI_LIBRARY_CACHE_AGE * NSEC_PER_SEC),
+        EI_LIBRARY_CACHE_AGE * NSEC_PER_SEC, 5 * NSEC_PER_SEC);
+    dispatch_source_set_event_handler(timer, ^{
+      library_cache_expire(cache);
+    });
+    dispatch_resume(timer);
+  });
+  return cache;
+}
+
+
 - (instancetype)initWithExeFileURL:(NSURL *)exeFile  error:(NSError **)oerr
 {
   self = [super init];
   if (!self) return nil;
   
   wres_error err;
-  fl = new_winlibrary_from_file([exeFile fileSystemRepresentation], &err);
+  fl = library_cache_open([EIExeFile libraryCache], [exeFile fileSystemRepresentation], &err);
   if (!fl) {
     if (oerr)
       *oerr = nserror_from_wreserror(err);
@@ -54,7 +86,7 @@
 {
   if (!fl)
     NSLog(@"%s", wres_strerr(err));
-  else if (err == WRES_ERROR_RESNOTFOUND)
+  else if (err == WRES_ERROR_RESNOTFOUND || err == WRES_ERROR_CANCELLED)
     EILog(@"%s: %s", fl->name, wres_strerr(err));
   else
     NSLog(@"%s: %s", fl->name, wres_strerr(err));
@@ -66,6 +98,9 @@
   wres_error err;
   NSData *icodata = get_resource_data(fl, "14", NULL, NULL, &err);
   
+  /* some executables only have an animated icon */
+  if (!icodata && err == WRES_ERROR_RESNOTFOUND)
+    icodata = get_animated_icon_data(fl, NULL, NULL, &err);
   if (!icodata) {
     [self logError:err];
     return nil;
@@ -74,6 +109,21 @@
 }
 
 
+/* Returns the best image of the icon as-is if it is a PNG, nil otherwise.
+ * The data is not copied out of the executable. */
+- (NSData *)iconPNGData
+{
+  wres_error err;
+  NSData *pngdata = get_icon_png_data(fl, NULL, NULL, &err);
+  
+  if (!pngdata) {
+    [self logError:err];
+    return nil;
+  }
+  return pngdata;
+}
+
+
 - (NSImage*)icon
 {
   NSData *icodata = [self iconData];
@@ -84,33 +134,137 @@
 }
 
 
+/* Returns the Windows language IDs of the current locale and of the
+ * preferred languages of the user, in order of preference. */
++ (NSArray *)preferredWindowsLanguages
+{
+  NSMutableArray *res;
+  NSArray *idents;
+  NSString *ident;
+  uint32_t lcid;
+  
+  res = [NSMutableArray array];
+  idents = [@[[[NSLocale currentLocale] localeIdentifier]]
+            arrayByAddingObjectsFromArray:[NSLocale preferredLanguages]];
+  for (ident in idents) {
+    lcid = [NSLocale windowsLocaleCodeFromLocaleIdentifier:ident];
+    if (lcid != 0 && ![res containsObject:@(lcid & 0xFFFF)])
+      [res addObject:@(lcid & 0xFFFF)];
+  }
+  return [res copy];
+}
+
+
 - (EIVersionInfo *)versionInfo
+{
+  return [self versionInfoForLanguages:[EIExeFile preferredWindowsLanguages]];
+}
+
+
+/* Picks the version resource and the string table whose language matches
+ * best langs, an array of Windows language IDs (most preferred first).
+ * If there is no good match, neutral and US English resources are
+ * preferred. */
+- (EIVersionInfo *)versionInfoForLanguages:(NSArray *)langs
 {
   wres_error err;
-  uint32_t sysLocale;
-  NSString *localeIdent;
-  char sysLocaleStr[64];
+  uint16_t prefs[[langs count] + 1];
+  WinResource *wr;
+  NSData *verdata;
+  int i;
   
-  localeIdent = [[NSLocale currentLocale] localeIdentifier];
-  sysLocale = [NSLocale windowsLocaleCodeFromLocaleIdentifier:localeIdent];
+  for (i = 0; i < [langs count]; i++)
+    prefs[i] = [[langs objectAtIndex:i] unsignedShortValue];
   
-  sprintf(sysLocaleStr, "%d", sysLocale);
-  //try with the current selected locale in the OS
-  NSData *verdata = get_resource_data(fl, "16", NULL, sysLocaleStr, NULL);
+  wr = find_version_resource(fl, prefs, (int)[langs count], &err);
+  if (!wr) {
+    [self logError:err];
+    return nil;
+  }
+  verdata = get_resource_data_for_entry(fl, wr, "16", NULL, &err);
+  free(wr);
   if (!verdata) {
-    //if failure, try the en-US locale (the majority of apps, if they're not neutral, use this)
-    verdata = get_resource_data(fl, "16", NULL, "1033", NULL);
-    if (!verdata) {
-      //else, pick the first locale we find, and go with it.
-      verdata = get_resource_data(fl, "16", NULL, NULL, &err);
-      if (!verdata) {
-        [self logError:err];
-        return nil;
-      }
-    }
+    [self logError:err];
+    return nil;
+  }
+  
+  return [[EIVersionInfo alloc] initWithData:verdata is16Bit:(fl->binary_type == NE_BINARY)
+                          preferredLanguages:langs];
+}
+
+
+/* Returns the version information of every language and string table
+ * of the file, in the format described in verinventory.h. */
+- (NSData *)versionInventoryData
+{
+  wres_error err;
+  size_t size;
+  void *inv;
+  
+  inv = extract_version_inventory(fl, &size, &err);
+  if (!inv) {
+    [self logError:err];
+    return nil;
+  }
+  return [NSData dataWithBytesNoCopy:inv length:size freeWhenDone:YES];
+}
+
+
+- (NSData *)manifestData
+{
+  wres_error err;
+  NSData *data = get_resource_data(fl, "24", NULL, NULL, &err);
+  
+  if (!data) {
+    [self logError:err];
+    return nil;
+  }
+  return data;
+}
+
+
+/* Returns the interesting attributes of the manifest, by the name of the
+ * element or attribute they come from: requestedExecutionLevel, uiAccess
+ * (NSNumber), dpiAware, dpiAwareness, supportedOS (NSArray of OS names,
+ * or GUIDs when unknown) and assemblyIdentity's name, version and
+ * processorArchitecture. Attributes that are missing are left out. */
+- (NSDictionary *)manifestAttributes
+{
+  NSMutableDictionary *res;
+  NSMutableArray *oses;
+  WinManifestInfo info;
+  NSData *data;
+  const char *osname;
+  int i;
+  
+  data = [self manifestData];
+  if (!data)
+    return nil;
+  if (scan_manifest([data bytes], [data length], &info) != WRES_ERROR_NONE)
+    return nil;
+  
+  res = [NSMutableDictionary dictionary];
+#define EI_SET_STRING(field, key) \
+  if (info.field[0]) [res setObject:[NSString stringWithUTF8String:info.field] forKey:key]
+  EI_SET_STRING(execution_level, @"requestedExecutionLevel");
+  EI_SET_STRING(dpi_aware, @"dpiAware");
+  EI_SET_STRING(dpi_awareness, @"dpiAwareness");
+  EI_SET_STRING(assembly_name, @"name");
+  EI_SET_STRING(assembly_version, @"version");
+  EI_SET_STRING(assembly_architecture, @"processorArchitecture");
+#undef EI_SET_STRING
+  if (info.has_ui_access)
+    [res setObject:@(info.ui_access) forKey:@"uiAccess"];
+  
+  oses = [NSMutableArray array];
+  for (i = 0; i < info.supported_os_count; i++) {
+    osname = manifest_os_name(info.supported_os[i]);
+    [oses addObject:[NSString stringWithUTF8String:(osname ? osname : info.supported_os[i])]];
   }
+  if ([oses count])
+    [res setObject:[oses copy] forKey:@"supportedOS"];
   
-  return [[EIVersionInfo alloc] initWithData:verdata is16Bit:(fl->binary_type == NE_BINARY)];
+  return [res copy];
 }
 
 
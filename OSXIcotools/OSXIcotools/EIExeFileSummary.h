@@ -0,0 +1,70 @@
+/* EIExeFileSummary.h - Header, icon and version info of an executable,
+ * each read within a time budget
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#import <Foundation/Foundation.h>
+
+
+@class EIExeFile;
+@class EIVersionInfo;
+
+
+typedef NS_ENUM(NSInteger, EIExeFilePart) {
+  EIExeFilePartHeader,
+  EIExeFilePartIcon,
+  EIExeFilePartVersionInfo,
+  EIExeFilePartCount
+};
+
+typedef NS_ENUM(NSInteger, EIPartStatus) {
+  EIPartStatusSkipped,        /* not tried, because the header was not read */
+  EIPartStatusComplete,
+  EIPartStatusUnavailable,    /* not in the file, or unreadable */
+  EIPartStatusTimedOut,
+  EIPartStatusCancelled,      /* the token of the thread was cancelled */
+};
+
+/* Seconds allowed to each part; zero means no limit */
+typedef struct {
+  NSTimeInterval header;
+  NSTimeInterval icon;
+  NSTimeInterval versionInfo;
+} EIExeFileBudget;
+
+extern const EIExeFileBudget EIExeFileInteractiveBudget;
+extern const EIExeFileBudget EIExeFileUnlimitedBudget;
+
+
+@interface EIExeFileSummary : NSObject {
+  EIExeFile *exeFile;
+  NSData *iconData;
+  EIVersionInfo *versionInfo;
+  EIPartStatus status[EIExeFilePartCount];
+}
+
+- (instancetype)initWithExeFileURL:(NSURL *)url budget:(EIExeFileBudget)budget
+                        iconLoader:(NSData *(^)(EIExeFile *exeFile))loader;
+
+- (EIExeFile *)exeFile;
+- (NSData *)iconData;
+- (EIVersionInfo *)versionInfo;
+- (EIPartStatus)statusOfPart:(EIExeFilePart)part;
+- (BOOL)isComplete;
+- (NSString *)statusDescription;
+
+@end
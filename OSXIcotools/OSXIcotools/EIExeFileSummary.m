@@ -0,0 +1,159 @@
+/* EIExeFileSummary.m - Header, icon and version info of an executable,
+ * each read within a time budget
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#import "EIExeFileSummary.h"
+#import "EIExeFile.h"
+#import "EIVersionInfo.h"
+#include "cancel.h"
+
+
+/* Something shown within 50 ms beats everything shown after seconds */
+const EIExeFileBudget EIExeFileInteractiveBudget = {0.020, 0.020, 0.010};
+const EIExeFileBudget EIExeFileUnlimitedBudget = {0, 0, 0};
+
+
+/* Runs stage with a cancellation token that expires after the given
+ * time, and that is also cancelled with the token of the thread. The
+ * status tells why the stage returned nil, if it did. */
+static id EIRunStage(NSTimeInterval seconds, id (^stage)(void), EIPartStatus *status)
+{
+  WinCancelToken token, *outer;
+  id res;
+  
+  outer = thread_cancel_token();
+  cancel_token_init_with_parent(&token, outer, seconds > 0 ? (uint64_t)(seconds * 1e6) : 0);
+  set_thread_cancel_token(&token);
+  res = stage();
+  set_thread_cancel_token(outer);
+  
+  if (res)
+    *status = EIPartStatusComplete;
+  else if (outer && cancel_token_is_cancelled(outer))
+    *status = EIPartStatusCancelled;
+  else if (cancel_token_is_cancelled(&token))
+    *status = EIPartStatusTimedOut;
+  else
+    *status = EIPartStatusUnavailable;
+  return res;
+}
+
+
+@implementation EIExeFileSummary
+
+
+/* Reads what can be read of the executable at url within the budget.
+ * The icon is read by loader if it is not nil, so that callers can add
+ * caching; otherwise it is the best PNG image or the whole icon. Parts
+ * that do not complete are reported by -statusOfPart:, and the others
+ * can still be used. If the header takes too long, -exeFile is nil
+ * and the file goes on loading in the background. */
+- (instancetype)initWithExeFileURL:(NSURL *)url budget:(EIExeFileBudget)budget
+                        iconLoader:(NSData *(^)(EIExeFile *exeFile))loader
+{
+  self = [super init];
+  if (!self) return nil;
+  
+  exeFile = EIRunStage(budget.header, ^id{
+    return [[EIExeFile alloc] initWithExeFileURL:url error:nil];
+  }, &status[EIExeFilePartHeader]);
+  if (!exeFile) {
+    /* A cancelled load is not cached, so the file would time out again
+     * on every request. It is loaded into the cache of EIExeFile in the
+     * background instead, for the next request to find it there. */
+    if (status[EIExeFilePartHeader] == EIPartStatusTimedOut) {
+      dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), ^{
+        (void)[[EIExeFile alloc] initWithExeFileURL:url error:nil];
+      });
+    }
+    return self;
+  }
+  
+  iconData = EIRunStage(budget.icon, ^id{
+    if (loader)
+      return loader(self->exeFile);
+    NSData *data = [self->exeFile iconPNGData];
+    return data ? data : [self->exeFile iconData];
+  }, &status[EIExeFilePartIcon]);
+  
+  versionInfo = EIRunStage(budget.versionInfo, ^id{
+    return [self->exeFile versionInfo];
+  }, &status[EIExeFilePartVersionInfo]);
+  
+  return self;
+}
+
+
+- (EIExeFile *)exeFile
+{
+  return exeFile;
+}
+
+
+- (NSData *)iconData
+{
+  return iconData;
+}
+
+
+- (EIVersionInfo *)versionInfo
+{
+  return versionInfo;
+}
+
+
+- (EIPartStatus)statusOfPart:(EIExeFilePart)part
+{
+  if (part < 0 || part >= EIExeFilePartCount)
+    return EIPartStatusSkipped;
+  return status[part];
+}
+
+
+/* Returns YES if no part was cut short. Parts that are not in the file
+ * do not count. */
+- (BOOL)isComplete
+{
+  int i;
+  
+  for (i = 0; i < EIExeFilePartCount; i++) {
+    if (status[i] == EIPartStatusTimedOut || status[i] == EIPartStatusCancelled)
+      return NO;
+  }
+  return YES;
+}
+
+
+/* Describes the status of each part, for logging, as in
+ * "header: complete, icon: complete, version info: timed out". */
+- (NSString *)statusDescription
+{
+  static NSString * const partNames[EIExeFilePartCount] = {
+    @"header", @"icon", @"version info"};
+  static NSString * const statusNames[] = {
+    @"skipped", @"complete", @"unavailable", @"timed out", @"cancelled"};
+  NSMutableArray *res = [NSMutableArray array];
+  int i;
+  
+  for (i = 0; i < EIExeFilePartCount; i++)
+    [res addObject:[NSString stringWithFormat:@"%@: %@", partNames[i], statusNames[status[i]]]];
+  return [res componentsJoinedByString:@", "];
+}
+
+
+@end
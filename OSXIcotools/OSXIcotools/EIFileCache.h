@@ -0,0 +1,34 @@
+/* EIFileCache.h - Persistent cache of data extracted from executables
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#import <Foundation/Foundation.h>
+#include "filecache.h"
+
+
+@interface EIFileCache : NSObject {
+  WinFileCache *cache;
+}
+
++ (instancetype)cacheNamed:(NSString *)name maximumSize:(size_t)size;
+- (instancetype)initWithURL:(NSURL *)url maximumSize:(size_t)size error:(NSError **)err;
+- (void)dealloc;
+
+- (NSData *)dataOfKind:(uint32_t)kind forFileURL:(NSURL *)url
+           generatedBy:(NSData *(^)(void))generator;
+
+@end
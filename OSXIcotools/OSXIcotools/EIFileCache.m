@@ -0,0 +1,102 @@
+/* EIFileCache.m - Persistent cache of data extracted from executables
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#import "EIFileCache.h"
+#include <sys/stat.h>
+#include "osxwres.h"
+
+
+@implementation EIFileCache
+
+
+/* Returns the cache with the given file name in the caches directory of
+ * the user (or of the sandbox container), or nil if it cannot be opened.
+ * The size only matters when the cache is created; if it changes, the
+ * cache is emptied. */
++ (instancetype)cacheNamed:(NSString *)name maximumSize:(size_t)size
+{
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSURL *dir, *url;
+  NSError *err;
+  EIFileCache *res;
+  
+  dir = [[fm URLsForDirectory:NSCachesDirectory inDomains:NSUserDomainMask] firstObject];
+  dir = [dir URLByAppendingPathComponent:@"com.danielecattaneo.qlwindowsapps" isDirectory:YES];
+  if (![fm createDirectoryAtURL:dir withIntermediateDirectories:YES attributes:nil error:&err]) {
+    NSLog(@"%@", err);
+    return nil;
+  }
+  url = [dir URLByAppendingPathComponent:name];
+  res = [[EIFileCache alloc] initWithURL:url maximumSize:size error:&err];
+  if (!res)
+    NSLog(@"%@: %@", url, err);
+  return res;
+}
+
+
+- (instancetype)initWithURL:(NSURL *)url maximumSize:(size_t)size error:(NSError **)oerr
+{
+  self = [super init];
+  if (!self) return nil;
+  
+  wres_error err;
+  cache = open_file_cache([url fileSystemRepresentation], size, &err);
+  if (!cache) {
+    if (oerr)
+      *oerr = nserror_from_wreserror(err);
+    return nil;
+  }
+  return self;
+}
+
+
+/* Returns the data of the given kind (FILE_CACHE_*) for the file at url
+ * as it is now. If it is not in the cache, it is made by the generator
+ * and stored, unless the generator returns nil. */
+- (NSData *)dataOfKind:(uint32_t)kind forFileURL:(NSURL *)url
+           generatedBy:(NSData *(^)(void))generator
+{
+  WinFileKey key;
+  NSData *res;
+  size_t size;
+  void *data;
+  
+  /* the key is taken before reading the file, so that if it changes
+   * meanwhile the data is stored under the old key, never the new one */
+  if (file_cache_key_for_path([url fileSystemRepresentation], &key) != WRES_ERROR_NONE)
+    return generator();
+  
+  data = file_cache_get(cache, &key, kind, &size, NULL);
+  if (data)
+    return [NSData dataWithBytesNoCopy:data length:size freeWhenDone:YES];
+  
+  res = generator();
+  if (res)
+    file_cache_put(cache, &key, kind, [res bytes], [res length]);
+  return res;
+}
+
+
+- (void)dealloc
+{
+  if (cache)
+    close_file_cache(cache);
+}
+
+
+@end
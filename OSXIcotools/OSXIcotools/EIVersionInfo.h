@@ -17,6 +17,8 @@
  */
 
 #import <Cocoa/Cocoa.h>
+#include "verinfo.h"
+#import "EIVersionInfoQuery.h"
 
 typedef enum {
   EIV_NOERR = 0,
@@ -29,9 +31,12 @@ typedef enum {
 @interface EIVersionInfo : NSObject {
   NSData* gBlock;
   BOOL win16Block;
+  WinVersionInfo *vinfo;
+  const WinVerStringTable *preferredTable;
 }
 
 - (instancetype)initWithData:(NSData *)myBlock is16Bit:(BOOL)win16;
+- (instancetype)initWithData:(NSData *)myBlock is16Bit:(BOOL)win16 preferredLanguages:(NSArray *)langs;
 
 - (BOOL)is16bit;
 - (NSData *)data;
@@ -40,6 +45,23 @@ typedef enum {
 - (NSString *)queryStringValue:(NSString *)subBlock error:(EIVERSION_ERR *)err;
 - (NSArray*)querySubNodesUnder:(NSString*)subBlock error:(EIVERSION_ERR*)err;
 
+- (NSData *)runValueQuery:(EIVersionInfoQuery *)query error:(EIVERSION_ERR *)err;
+- (NSString *)runStringValueQuery:(EIVersionInfoQuery *)query error:(EIVERSION_ERR *)err;
+- (NSArray *)runSubNodesQuery:(EIVersionInfoQuery *)query error:(EIVERSION_ERR *)err;
+
+- (BOOL)hasFixedFileInfo;
+- (NSString *)fixedFileVersion;
+- (NSString *)fixedProductVersion;
+- (uint64_t)fixedFileVersionNumber;
+- (uint64_t)fixedProductVersionNumber;
+- (uint16_t)fixedFileVersionPart:(int)i;
+- (uint32_t)fixedFileFlags;
+- (uint32_t)fixedFileOS;
+- (uint32_t)fixedFileType;
+
+- (void)enumerateStringsUsingBlock:(void (^)(NSString *table, NSString *key, NSString *value, BOOL *stop))block;
+- (void)enumerateStringsInTable:(NSString *)table usingBlock:(void (^)(NSString *key, NSString *value, BOOL *stop))block;
+
 @end
 
 
@@ -16,350 +16,306 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-/*  Thanks to Raymond Chen (MSFT) for the useful insight on the VERSIONINFO resource format.
- *  http://blogs.msdn.com/b/oldnewthing/archive/2006/12/22/1348663.aspx (kludge)
- *  http://blogs.msdn.com/b/oldnewthing/archive/2006/12/21/1340571.aspx (32 bit)
- *  http://blogs.msdn.com/b/oldnewthing/archive/2006/12/20/1332035.aspx (16 bit)
- */
+/* The block is parsed once by new_version_info() in verinfo.c; this class
+ * only converts queries and results to and from Cocoa objects. */
 
-/* Note: -stringWithCharacters:length: in NSString (like 
- * CFStringCreateWithCharacters, which is the function that actually does
- * the job under the hood) does NOT take a number of characters as length
- * parameter (as the documentation claims), but a number of CODE POINTS 
- * (bytes / 2). */
+/* Strings are converted to UTF-8 before being handed to NSString. Most of
+ * them are ASCII, which NSString then stores with one byte per character,
+ * and turning them back into UTF-8 for the preview HTML is a copy.
+ * Strings in 16-bit blocks are decoded with the code page of their string
+ * table. */
 
 #import "EIVersionInfo.h"
 
 
-#define PAD_TO_32BIT(x) (((void*)((x)) + ((4 - ((intptr_t)((x)) % 4)) % 4)))
-#define ERR_RET(x) {*err = ((x)); return nil;}
-#define CHECK_PTR(b, x, e) {if ((void*)(x) < (b) || (e) < (void*)(x)) ERR_RET(EIV_WRONGFORMAT);}
+#define EI_STACK_STRING_SIZE (256)
+
 
+static void EISetError(EIVERSION_ERR *err, EIVERSION_ERR value)
+{
+  if (err)
+    *err = value;
+}
 
-typedef struct {
-  int16_t cbNode;  //Size of the node (a node includes its children)
-  int16_t cbData;  //Size of the data in the node
-  int16_t wType;   //1 if the node contains a string
-} VERSIONNODE_HEADER;
 
-typedef struct {
-  int16_t cbNode;  //Size of the node (a node includes its children)
-  int16_t cbData;  //Size of the data in the node
-} VERSIONNODE16_HEADER;
+@implementation EIVersionInfo
 
 
-/* Returns a number of code points */
-int EIUTF16CheckedStringLen(const unichar* string, const unichar *maxptr, BOOL expectTerm)
+- (instancetype)initWithData:(NSData *)myBlock is16Bit:(BOOL)win16
 {
-  const unichar *initial;
-  
-  for (initial = string; ((void*)string) + 1 < (void*)maxptr; string++)
-    if (*string == '\0')
-      return (int)(string - initial);
-  return expectTerm ? -1 : (int)(string - initial);
+  return [self initWithData:myBlock is16Bit:win16 preferredLanguages:nil];
 }
 
 
-int EICheckedStringLen(const char *str, const char *maxptr, BOOL expectTerm)
+/* langs is an array of NSNumbers containing Windows language IDs, most
+ * preferred first. It is used to choose the string table to enumerate
+ * when none is specified. */
+- (instancetype)initWithData:(NSData *)myBlock is16Bit:(BOOL)win16 preferredLanguages:(NSArray *)langs
 {
-  const char *initial;
+  uint16_t prefs[[langs count] + 1];
+  int i;
+  
+  self = [super init];
+  if (!self) return nil;
   
-  for (initial = str; str < maxptr; str++)
-    if (*str == '\0')
-      return (int)(str - initial);
-  return expectTerm ? -1 : (int)(str - initial);
+  gBlock = myBlock;
+  win16Block = win16;
+  vinfo = new_version_info([gBlock bytes], [gBlock length], win16, NULL);
+  if (vinfo) {
+    for (i = 0; i < [langs count]; i++)
+      prefs[i] = [[langs objectAtIndex:i] unsignedShortValue];
+    preferredTable = version_info_best_string_table(vinfo, prefs, (int)[langs count]);
+  }
+  return self;
 }
 
 
-NSArray *EIRequestFromString(NSString *subBlock)
+- (void)dealloc
 {
-  NSArray *request;
-  NSString *tmp;
-  
-  if ([subBlock isEqual:@"\\"]) {
-    request = [NSArray arrayWithObject:@"VS_VERSION_INFO"];
-  } else {
-    tmp = [@"VS_VERSION_INFO" stringByAppendingString:subBlock];
-    request = [tmp componentsSeparatedByString:@"\\"];
-  }
-  return request;
+  if (vinfo)
+    free_version_info(vinfo);
 }
 
 
-const VERSIONNODE_HEADER *EIResTreeIterateChildren32(NSData *block, EIVERSION_ERR *err,
-  void (^callb)(BOOL *stop, NSString *name, const void *dataptr))
+- (BOOL)is16bit
 {
-  BOOL found;
-  const void *bb, *be;
-  const VERSIONNODE_HEADER *vnh;
-  const unichar *wszName;
-  const void *dataptr;
-  ssize_t nameLen;
-  NSString *nodeName;
-  
-  vnh = bb = [block bytes];
-  be = bb + [block length];
-  *err = EIV_NOERR;
-  
-  wszName = (unichar *)(vnh + 1);
-  
-  found = NO;
-  while ((void*)vnh < be) {
-    nameLen = EIUTF16CheckedStringLen(wszName, be, YES);
-    if (nameLen < 0)
-      ERR_RET(EIV_WRONGFORMAT);
-    
-    nodeName = [NSString stringWithCharacters:wszName length:nameLen];
-    dataptr = PAD_TO_32BIT((void*)(wszName + nameLen + 1));
-    
-    callb(&found, nodeName, dataptr);
-    if (found)
-      return vnh;
-    
-    vnh = PAD_TO_32BIT((void*)vnh + vnh->cbNode);
-    wszName = (const unichar*)(vnh + 1);
-  }
-  return NULL;
+  return win16Block;
 }
 
 
-NSData *EIResTreeRead32(NSArray *path, int level, NSData *block,
-  EIVERSION_ERR *err, BOOL getChildren)
+- (NSData *)data
 {
-  const VERSIONNODE_HEADER *vnh;
-  ssize_t subtreeLen;
-  const void __block *dataptr;
-  const void *nextptr;
-  NSString *nodeToRead;
-  NSData *nodeData;
-  
-  nodeToRead = [path objectAtIndex:level];
-  vnh = EIResTreeIterateChildren32(block, err, ^(BOOL *stop, NSString *name, const void *dp) {
-    dataptr = dp;
-    *stop = [name caseInsensitiveCompare:nodeToRead] == NSOrderedSame ||
-            [@"*" isEqual:nodeToRead];
-  });
-  if (*err)
-    return NULL;
-  if (!vnh)
-    ERR_RET(EIV_UNKNOWNNODE);
-  
-  nextptr = PAD_TO_32BIT(dataptr + vnh->cbData);  //pointer to first child node
-  subtreeLen = ((void*)vnh + vnh->cbNode) - nextptr;
-  
-  CHECK_PTR([block bytes], nextptr + subtreeLen - 1, [block bytes] + [block length]);
-  
-  /* If we're at the node we want to return, return it */
-  if ([path count] == level + 1) {
-    if (getChildren) {
-      return [NSData dataWithBytes:nextptr length:subtreeLen];
-    } else {
-      /* Right after the transition to Unicode version strings many resource
-       * compilers had a bug where the cbData is interpreted as a character
-       * count, not as a byte count as it should be.*/
-      if (vnh->wType == 1 && level == 3)
-        if (nextptr - (void*)vnh < vnh->cbNode)
-          return [NSData dataWithBytes:dataptr length:vnh->cbData * 2];
-      return [NSData dataWithBytes:dataptr length:vnh->cbData];
-    }
-  }
-  
-  /* Otherwise recurse into this node's children */
-  nodeData = [NSData dataWithBytesNoCopy:(void*)nextptr length:subtreeLen freeWhenDone:NO];
-  return EIResTreeRead32(path, level+1, nodeData, err, getChildren);
+  return gBlock;
 }
 
 
-const VERSIONNODE16_HEADER *EIResTreeIterateChildren16(NSData *block, EIVERSION_ERR *err,
-  void (^callb)(BOOL *stop, NSString *name, const void *dataptr))
+- (NSString *)stringFromText:(WinVerText)text
 {
-  BOOL found;
-  const void *bb, *be;
-  const VERSIONNODE16_HEADER *vnh;
-  const char *wszName;
-  ssize_t sl;
-  const void *dataptr;
-  NSString *nodeName;
-  
-  vnh = bb = [block bytes];
-  be = bb + [block length];
-  *err = EIV_NOERR;
-  
-  wszName = (char*)(vnh + 1);
+  return [self stringFromText:text codepage:version_info_codepage(vinfo, NULL)];
+}
+
+
+- (NSString *)stringFromText:(WinVerText)text codepage:(uint16_t)cp
+{
+  char stackbuf[EI_STACK_STRING_SIZE];
+  size_t size;
+  char *buf;
   
-  found = NO;
-  while ((void*)vnh < be) {
-    sl = EICheckedStringLen(wszName, be, YES);
-    if (sl < 0)
-      ERR_RET(EIV_WRONGFORMAT);
-    
-    nodeName = [NSString stringWithCString:wszName encoding:NSWindowsCP1252StringEncoding];
-    dataptr = PAD_TO_32BIT(wszName + [nodeName length] + 1);
-    
-    callb(&found, nodeName, dataptr);
-    if (found)
-      return vnh;
-    
-    vnh = PAD_TO_32BIT((void*)vnh + vnh->cbNode);
-    wszName = (const char*)(vnh + 1);
+  size = version_info_text_utf8_length(vinfo, &text, cp);
+  if (size <= EI_STACK_STRING_SIZE) {
+    version_info_text_to_utf8(vinfo, stackbuf, size, &text, cp);
+    return [[NSString alloc] initWithBytes:stackbuf length:size encoding:NSUTF8StringEncoding];
   }
-  return NULL;
+  buf = malloc(size);
+  if (!buf)
+    return nil;
+  version_info_text_to_utf8(vinfo, buf, size, &text, cp);
+  return [[NSString alloc] initWithBytesNoCopy:buf length:size
+          encoding:NSUTF8StringEncoding freeWhenDone:YES];
 }
 
 
-NSData *EIResTreeRead16(NSArray *path, int level, NSData* block,
-  EIVERSION_ERR *err, BOOL getChildren)
+- (const WinVerNode *)nodeForQuery:(EIVersionInfoQuery *)query error:(EIVERSION_ERR *)err
 {
-  const VERSIONNODE16_HEADER *vnh;
-  ssize_t subtreeLen;
-  const void __block *dataptr;
-  const void *nextptr;
-  NSString *nodeToRead;
-  NSData *nodeData;
+  int i;
   
-  nodeToRead = [path objectAtIndex:level];
-  
-  vnh = EIResTreeIterateChildren16(block, err, ^(BOOL *stop, NSString *name, const void *dp) {
-    dataptr = dp;
-    *stop = [name caseInsensitiveCompare:nodeToRead] == NSOrderedSame ||
-            [@"*" isEqual:nodeToRead];
-  });
-  if (*err)
+  if (!vinfo) {
+    EISetError(err, EIV_WRONGFORMAT);
     return NULL;
-  if (!vnh)
-    ERR_RET(EIV_UNKNOWNNODE);
-  
-  nextptr = PAD_TO_32BIT(dataptr + vnh->cbData);  //pointer to first child node
-  subtreeLen = ((void*)vnh + vnh->cbNode) - nextptr;
-  
-  CHECK_PTR([block bytes], nextptr + subtreeLen - 1, [block bytes] + [block length]);
-  
-  /* If we're at the node we want to return, return it */
-  if ([path count] == level + 1) {
-    if (getChildren)
-      return [NSData dataWithBytes:nextptr length:subtreeLen];
-    return [NSData dataWithBytes:dataptr length:vnh->cbData];
   }
-  
-  /* Otherwise recurse into this node's children */
-  nodeData = [NSData dataWithBytesNoCopy:(void*)nextptr length:subtreeLen freeWhenDone:NO];
-  return EIResTreeRead16(path, level+1, nodeData, err, getChildren);
+  i = version_query_run([query compiledQuery], vinfo);
+  if (i < 0) {
+    EISetError(err, EIV_UNKNOWNNODE);
+    return NULL;
+  }
+  return &vinfo->nodes[i];
 }
 
 
-@implementation EIVersionInfo
+- (NSString *)queryStringValue:(NSString *)subBlock error:(EIVERSION_ERR *)err
+{
+  return [self runStringValueQuery:[EIVersionInfoQuery queryWithPath:subBlock] error:err];
+}
 
 
-- (instancetype)initWithData:(NSData *)myBlock is16Bit:(BOOL)win16
+// Like VerQueryValue(pBlock, lpSubBlock, lplpBuffer, puLen);
+- (NSData *)queryValue:(NSString *)subBlock error:(EIVERSION_ERR *)err
 {
-  gBlock = myBlock;
-  win16Block = win16;
-  return [super init];
+  return [self runValueQuery:[EIVersionInfoQuery queryWithPath:subBlock] error:err];
 }
 
 
-- (BOOL)is16bit
+- (NSArray *)querySubNodesUnder:(NSString *)subBlock error:(EIVERSION_ERR *)err
 {
-  return win16Block;
+  return [self runSubNodesQuery:[EIVersionInfoQuery queryWithPath:subBlock] error:err];
 }
 
 
-- (NSData *)data
+- (NSString *)runStringValueQuery:(EIVersionInfoQuery *)query error:(EIVERSION_ERR *)err
 {
-  return gBlock;
+  const WinVerNode *node;
+  const WinVerStringTable *table;
+  
+  node = [self nodeForQuery:query error:err];
+  if (!node)
+    return nil;
+  table = version_info_node_string_table(vinfo, (int)(node - vinfo->nodes));
+  return [self stringFromText:version_info_node_text(vinfo, node)
+                     codepage:version_info_codepage(vinfo, table)];
 }
 
 
-- (NSString *)queryStringValue:(NSString *)subBlock error:(EIVERSION_ERR *)err
+- (NSData *)runValueQuery:(EIVersionInfoQuery *)query error:(EIVERSION_ERR *)err
 {
-  NSData *raw;
-  const void *bytes;
-  int l;
+  const WinVerNode *node;
   
-  raw = [self queryValue:subBlock error:err];
-  if (!raw)
+  node = [self nodeForQuery:query error:err];
+  if (!node)
     return nil;
-  bytes = [raw bytes];
-  
-  if (win16Block) {
-    l = EICheckedStringLen(bytes, (const char *)(bytes + [raw length]), NO);
-    return [[NSString alloc] initWithBytes:bytes length:l
-            encoding:NSWindowsCP1252StringEncoding];
-  }
-  
-  l = EIUTF16CheckedStringLen(bytes, (const unichar *)(bytes + [raw length]), NO);
-  return [NSString stringWithCharacters:bytes length:l];
+  return [NSData dataWithBytes:node->value length:node->value_size];
 }
 
 
-// Like VerQueryValue(pBlock, lpSubBlock, lplpBuffer, puLen);
-- (NSData *)queryValue:(NSString *)subBlock error:(EIVERSION_ERR *)err
+- (NSArray *)runSubNodesQuery:(EIVersionInfoQuery *)query error:(EIVERSION_ERR *)err
 {
-  NSData *res;
-  EIVERSION_ERR rerr = EIV_NOERR;
+  const WinVerNode *node;
+  const WinVerStringTable *table;
+  NSMutableArray *nodeArray;
+  int i;
+  
+  node = [self nodeForQuery:query error:err];
+  if (!node)
+    return nil;
   
-  if (win16Block)
-    res = EIResTreeRead16(EIRequestFromString(subBlock), 0, gBlock, &rerr, NO);
-  else
-    res = EIResTreeRead32(EIRequestFromString(subBlock), 0, gBlock, &rerr, NO);
-  if (!res && err)
-    *err = rerr;
-  return res;
+  nodeArray = [NSMutableArray array];
+  for (i = node->first_child; i >= 0; i = vinfo->nodes[i].next_sibling) {
+    table = version_info_node_string_table(vinfo, i);
+    [nodeArray addObject:[self stringFromText:vinfo->nodes[i].name
+                                      codepage:version_info_codepage(vinfo, table)]];
+  }
+  return [nodeArray copy];
 }
 
 
-- (NSArray *)querySubNodesUnder:(NSString *)subBlock error:(EIVERSION_ERR *)err
+- (BOOL)hasFixedFileInfo
 {
-  NSArray *res;
-  EIVERSION_ERR rerr = EIV_NOERR;
-  
-  if (win16Block)
-    res = [self _query16BitSubNodesUnder:subBlock error:&rerr];
-  else
-    res = [self _query32BitSubNodesUnder:subBlock error:&rerr];
-  if (!res && err)
-    *err = rerr;
-  return res;
+  return vinfo && vinfo->has_fixed_info;
 }
 
 
-- (NSArray *)_query16BitSubNodesUnder:(NSString *)subBlock error:(EIVERSION_ERR *)err
+- (NSString *)fixedFileVersion
 {
-  NSData *queryNode;
-  NSMutableArray *nodeArray;
-  
-  queryNode = EIResTreeRead16(EIRequestFromString(subBlock), 0, gBlock, err, YES);
-  if (*err)
+  if (![self hasFixedFileInfo])
     return nil;
-  
-  nodeArray = [NSMutableArray array];
-  EIResTreeIterateChildren16(queryNode, err, ^(BOOL *stop, NSString *name, const void *dataptr) {
-    [nodeArray addObject:name];
-  });
-  if (*err)
+  return [NSString stringWithFormat:@"%d.%d.%d.%d", vinfo->file_version[0],
+          vinfo->file_version[1], vinfo->file_version[2], vinfo->file_version[3]];
+}
+
+
+- (NSString *)fixedProductVersion
+{
+  if (![self hasFixedFileInfo])
     return nil;
-  
-  return [nodeArray copy];
+  return [NSString stringWithFormat:@"%d.%d.%d.%d", vinfo->product_version[0],
+          vinfo->product_version[1], vinfo->product_version[2], vinfo->product_version[3]];
 }
 
 
-- (NSArray *)_query32BitSubNodesUnder:(NSString *)subBlock error:(EIVERSION_ERR *)err
+- (uint64_t)fixedFileVersionNumber
 {
-  NSData *queryNode;
-  NSMutableArray *nodeArray;
+  if (![self hasFixedFileInfo])
+    return 0;
+  return version_info_pack_version(vinfo->file_version);
+}
+
+
+- (uint64_t)fixedProductVersionNumber
+{
+  if (![self hasFixedFileInfo])
+    return 0;
+  return version_info_pack_version(vinfo->product_version);
+}
+
+
+- (uint16_t)fixedFileVersionPart:(int)i
+{
+  if (![self hasFixedFileInfo] || i < 0 || i > 3)
+    return 0;
+  return vinfo->file_version[i];
+}
+
+
+- (uint32_t)fixedFileFlags
+{
+  if (![self hasFixedFileInfo])
+    return 0;
+  return vinfo->file_flags;
+}
+
+
+- (uint32_t)fixedFileOS
+{
+  if (![self hasFixedFileInfo])
+    return VOS_UNKNOWN;
+  return vinfo->fixed_info.file_os;
+}
+
+
+- (uint32_t)fixedFileType
+{
+  if (![self hasFixedFileInfo])
+    return VFT_UNKNOWN;
+  return vinfo->fixed_info.file_type;
+}
+
+
+/* Enumerates the strings of all the string tables in a single pass. */
+- (void)enumerateStringsUsingBlock:(void (^)(NSString *table, NSString *key, NSString *value, BOOL *stop))block
+{
+  const WinVerStringTable *table;
+  NSString *tableName;
+  uint16_t cp;
+  BOOL stop = NO;
+  int t, c;
   
-  queryNode = EIResTreeRead32(EIRequestFromString(subBlock), 0, gBlock, err, YES);
-  if (*err)
-    return nil;
+  if (!vinfo)
+    return;
+  for (t = 0; t < vinfo->string_table_count && !stop; t++) {
+    table = &vinfo->string_tables[t];
+    cp = version_info_codepage(vinfo, table);
+    tableName = [self stringFromText:table->name];
+    for (c = 0; c < table->count && !stop; c++)
+      block(tableName, [self stringFromText:table->strings[c].key codepage:cp],
+            [self stringFromText:table->strings[c].value codepage:cp], &stop);
+  }
+}
+
+
+/* Enumerates the strings of a single string table. If table is nil the
+ * one matching best the preferred languages is used. */
+- (void)enumerateStringsInTable:(NSString *)table usingBlock:(void (^)(NSString *key, NSString *value, BOOL *stop))block
+{
+  const WinVerStringTable *st = NULL;
+  uint16_t cp;
+  BOOL stop = NO;
+  int t, c;
   
-  nodeArray = [NSMutableArray array];
-  EIResTreeIterateChildren32(queryNode, err, ^(BOOL *stop, NSString *name, const void *dataptr) {
-    [nodeArray addObject:name];
-  });
-  if (*err)
-    return nil;
+  if (!vinfo || vinfo->string_table_count == 0)
+    return;
+  if (!table) {
+    st = preferredTable;
+  } else {
+    for (t = 0; t < vinfo->string_table_count && !st; t++)
+      if ([table caseInsensitiveCompare:[self stringFromText:vinfo->string_tables[t].name]] == NSOrderedSame)
+        st = &vinfo->string_tables[t];
+    if (!st)
+      return;
+  }
   
-  return [nodeArray copy];
+  cp = version_info_codepage(vinfo, st);
+  for (c = 0; c < st->count && !stop; c++)
+    block([self stringFromText:st->strings[c].key codepage:cp],
+          [self stringFromText:st->strings[c].value codepage:cp], &stop);
 }
 
 
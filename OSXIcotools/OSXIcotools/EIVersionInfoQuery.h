@@ -0,0 +1,34 @@
+/* EIVersionInfoQuery.h - Compiled VERSIONINFO query paths
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#import <Foundation/Foundation.h>
+#include "verinfo.h"
+
+
+@interface EIVersionInfoQuery : NSObject {
+  WinVerQuery *query;
+  NSString *path;
+}
+
++ (instancetype)queryWithPath:(NSString *)path;
+- (instancetype)initWithPath:(NSString *)path;
+
+- (NSString *)path;
+- (const WinVerQuery *)compiledQuery;
+
+@end
@@ -0,0 +1,77 @@
+/* EIVersionInfoQuery.m - Compiled VERSIONINFO query paths
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#import "EIVersionInfoQuery.h"
+
+
+@implementation EIVersionInfoQuery
+
+
+/* Returns a compiled query, reusing the ones made for the same path
+ * recently. Callers tend to run the same handful of queries on every
+ * file, so they are compiled only once. */
++ (instancetype)queryWithPath:(NSString *)path
+{
+  static NSCache *cache;
+  static dispatch_once_t onceToken;
+  EIVersionInfoQuery *res;
+  
+  dispatch_once(&onceToken, ^{
+    cache = [[NSCache alloc] init];
+    [cache setCountLimit:64];
+  });
+  
+  res = [cache objectForKey:path];
+  if (!res) {
+    res = [[EIVersionInfoQuery alloc] initWithPath:path];
+    [cache setObject:res forKey:path];
+  }
+  return res;
+}
+
+
+- (instancetype)initWithPath:(NSString *)p
+{
+  self = [super init];
+  if (!self) return nil;
+  
+  path = [p copy];
+  query = new_version_query([path UTF8String]);
+  return self;
+}
+
+
+- (void)dealloc
+{
+  free_version_query(query);
+}
+
+
+- (NSString *)path
+{
+  return path;
+}
+
+
+- (const WinVerQuery *)compiledQuery
+{
+  return query;
+}
+
+
+@end
@@ -0,0 +1,153 @@
+/* codepages.c - Conversion of ANSI and OEM code pages to UTF-8
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Only the code pages that are likely to be found in 16-bit executables
+ * are supported: Windows-1252 and Shift JIS for Windows 3.x resources,
+ * IBM 437 and 850 for the occasional OEM string. Any other code page is
+ * decoded as Windows-1252. The five bytes that Windows-1252 leaves
+ * undefined (0x81, 0x8D, 0x8F, 0x90 and 0x9D) become the C1 controls of
+ * the same value, as MultiByteToWideChar() does; bytes that do not map to
+ * anything in the other code pages become U+FFFD. */
+
+#include <config.h>
+#include <stdlib.h>	/* C89 */
+#include "xalloc.h"	/* Gnulib */
+#include "codepages.h"	/* common */
+#include "codepage_tables.h"	/* common */
+
+
+#define CP932_TRAIL_FIRST (0x40)
+#define CP932_TRAIL_LAST (0xFC)
+#define CP932_TRAIL_COUNT (CP932_TRAIL_LAST - CP932_TRAIL_FIRST + 1)
+
+
+bool
+codepage_is_supported(uint16_t cp)
+{
+	return cp == 1252 || cp == 850 || cp == 437 || cp == 932;
+}
+
+static bool
+cp932_is_lead(uint8_t c)
+{
+	return (c >= 0x81 && c <= 0x9F) || (c >= 0xE0 && c <= 0xFC);
+}
+
+/* next_code_point:
+ *   Decode the character at `*s' and advance `*s' past it.
+ */
+static uint32_t
+next_code_point(uint16_t cp, const uint8_t **s, const uint8_t *end)
+{
+	uint8_t c = *(*s)++;
+
+	if (c < 0x80)
+		return c;
+
+	switch (cp) {
+		case 850: return cp850_high[c - 0x80];
+		case 437: return cp437_high[c - 0x80];
+		case 932:
+			if (c >= 0xA1 && c <= 0xDF)		/* half-width katakana */
+				return 0xFF61 + (c - 0xA1);
+			if (cp932_is_lead(c) && *s < end
+			    && **s >= CP932_TRAIL_FIRST && **s <= CP932_TRAIL_LAST) {
+				int lead = c <= 0x9F ? c - 0x81 : c - 0xE0 + (0x9F - 0x81 + 1);
+				uint8_t trail = *(*s)++;
+
+				return cp932_double[lead * CP932_TRAIL_COUNT + trail - CP932_TRAIL_FIRST];
+			}
+			return 0xFFFD;
+	}
+	return cp1252_high[c - 0x80];
+}
+
+static size_t
+utf8_length_of(uint32_t c)
+{
+	if (c < 0x80)
+		return 1;
+	if (c < 0x800)
+		return 2;
+	return 3;	/* all the tables are in the BMP */
+}
+
+/* codepage_to_utf8_length:
+ *   Returns the number of bytes needed to convert `len' bytes in code
+ *   page `cp' to UTF-8, without terminator.
+ */
+size_t
+codepage_to_utf8_length(uint16_t cp, const char *src, size_t len)
+{
+	const uint8_t *s = (const uint8_t *) src, *end = s + len;
+	size_t res = 0;
+
+	while (s < end)
+		res += utf8_length_of(next_code_point(cp, &s, end));
+	return res;
+}
+
+/* codepage_to_utf8:
+ *   Convert `len' bytes in code page `cp' to UTF-8, writing at most
+ *   `size' bytes to `dst', without cutting a character in half. No
+ *   terminator is written. Returns the number of bytes written.
+ */
+size_t
+codepage_to_utf8(uint16_t cp, char *dst, size_t size, const char *src, size_t len)
+{
+	const uint8_t *s = (const uint8_t *) src, *end = s + len;
+	size_t o = 0;
+	uint32_t c;
+
+	while (s < end) {
+		c = next_code_point(cp, &s, end);
+		if (utf8_length_of(c) > size - o)
+			break;
+		if (c < 0x80) {
+			dst[o++] = c;
+		} else if (c < 0x800) {
+			dst[o++] = 0xC0 | (c >> 6);
+			dst[o++] = 0x80 | (c & 0x3F);
+		} else {
+			dst[o++] = 0xE0 | (c >> 12);
+			dst[o++] = 0x80 | ((c >> 6) & 0x3F);
+			dst[o++] = 0x80 | (c & 0x3F);
+		}
+	}
+	return o;
+}
+
+/* codepage_to_utf8_dup:
+ *   Convert `len' bytes in code page `cp' to a newly allocated,
+ *   NUL-terminated UTF-8 string. If `outlen' is not NULL, the length of
+ *   the result (without terminator) is put there.
+ */
+char *
+codepage_to_utf8_dup(uint16_t cp, const char *src, size_t len, size_t *outlen)
+{
+	size_t size;
+	char *res;
+
+	size = codepage_to_utf8_length(cp, src, len);
+	res = xmalloc(size + 1);
+	codepage_to_utf8(cp, res, size, src, len);
+	res[size] = '\0';
+
+	if (outlen) *outlen = size;
+	return res;
+}
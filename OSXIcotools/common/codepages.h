@@ -0,0 +1,33 @@
+/* codepages.h - Conversion of ANSI and OEM code pages to UTF-8
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMMON_CODEPAGES_H
+#define COMMON_CODEPAGES_H
+
+#include <stdbool.h>	/* Gnulib/C99/POSIX */
+#include <stddef.h>	/* C89 */
+#include <stdint.h>	/* Gnulib/C99/POSIX */
+
+#define CODEPAGE_DEFAULT (1252)
+
+bool codepage_is_supported(uint16_t cp);
+size_t codepage_to_utf8_length(uint16_t cp, const char *src, size_t len);
+size_t codepage_to_utf8(uint16_t cp, char *dst, size_t size, const char *src, size_t len);
+char *codepage_to_utf8_dup(uint16_t cp, const char *src, size_t len, size_t *outlen);
+
+#endif
@@ -0,0 +1,349 @@
+/* jsonwriter.c - Streaming JSON writer
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Values are appended to a growable buffer as they are written, so there
+ * is no object graph to build first. The writer does not check that the
+ * calls are balanced: it only keeps track of where commas go. Strings
+ * should be UTF-8; quotes, backslashes and control characters are
+ * escaped, and so are bytes that are not part of valid UTF-8, as the
+ * Latin-1 character of the same value, so that the output is valid JSON
+ * whatever the input. The bytes that need no escaping are found 16 at a
+ * time with SSE2 or NEON where available. */
+
+#include <config.h>
+#include <stdlib.h>	/* C89 */
+#include <string.h>	/* C89 */
+#include <stdio.h>	/* C89 */
+#include "xalloc.h"	/* Gnulib */
+#include "jsonwriter.h"	/* common */
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#  define JSON_SIMD_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  include <arm_neon.h>
+#  define JSON_SIMD_NEON
+#endif
+
+
+void
+json_writer_init(JSONWriter *w)
+{
+	memset(w, 0, sizeof(JSONWriter));
+}
+
+/* json_writer_reset:
+ *   Empty the buffer, keeping the memory for the next document.
+ */
+void
+json_writer_reset(JSONWriter *w)
+{
+	w->size = 0;
+	w->need_comma = false;
+}
+
+void
+json_writer_free(JSONWriter *w)
+{
+	free(w->data);
+	memset(w, 0, sizeof(JSONWriter));
+}
+
+static char *
+reserve(JSONWriter *w, size_t len)
+{
+	if (len > w->capacity - w->size) {
+		if (w->capacity == 0)
+			w->capacity = 256;
+		while (len > w->capacity - w->size)
+			w->capacity *= 2;
+		w->data = xrealloc(w->data, w->capacity);
+	}
+	return w->data + w->size;
+}
+
+static void
+append(JSONWriter *w, const char *s, size_t len)
+{
+	memcpy(reserve(w, len), s, len);
+	w->size += len;
+}
+
+static void
+append_char(JSONWriter *w, char c)
+{
+	*reserve(w, 1) = c;
+	w->size++;
+}
+
+static void
+begin_value(JSONWriter *w)
+{
+	if (w->need_comma)
+		append_char(w, ',');
+	w->need_comma = true;
+}
+
+void
+json_begin_object(JSONWriter *w)
+{
+	begin_value(w);
+	append_char(w, '{');
+	w->need_comma = false;
+}
+
+void
+json_end_object(JSONWriter *w)
+{
+	append_char(w, '}');
+	w->need_comma = true;
+}
+
+void
+json_begin_array(JSONWriter *w)
+{
+	begin_value(w);
+	append_char(w, '[');
+	w->need_comma = false;
+}
+
+void
+json_end_array(JSONWriter *w)
+{
+	append_char(w, ']');
+	w->need_comma = true;
+}
+
+/* utf8_sequence_length:
+ *   Returns the length of the valid UTF-8 sequence at the start of `s',
+ *   which begins with a byte >= 0x80, or 0 if it is not valid: truncated,
+ *   overlong, a surrogate or beyond U+10FFFF.
+ */
+static size_t
+utf8_sequence_length(const unsigned char *s, size_t len)
+{
+	size_t n, i;
+	uint32_t cp;
+
+	if (s[0] >= 0xC2 && s[0] <= 0xDF) {
+		n = 2;
+		cp = s[0] & 0x1F;
+	} else if (s[0] >= 0xE0 && s[0] <= 0xEF) {
+		n = 3;
+		cp = s[0] & 0x0F;
+	} else if (s[0] >= 0xF0 && s[0] <= 0xF4) {
+		n = 4;
+		cp = s[0] & 0x07;
+	} else {
+		return 0;
+	}
+	if (len < n)
+		return 0;
+	for (i = 1; i < n; i++) {
+		if ((s[i] & 0xC0) != 0x80)
+			return 0;
+		cp = cp << 6 | (s[i] & 0x3F);
+	}
+	if ((n == 3 && cp < 0x800) || (n == 4 && cp < 0x10000))
+		return 0;
+	if ((cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+		return 0;
+	return n;
+}
+
+/* safe_run:
+ *   Returns how many of the first `len' bytes of `s' can be copied to a
+ *   JSON string as they are.
+ */
+static size_t
+safe_run(const char *s, size_t len)
+{
+	size_t i = 0;
+
+#if defined(JSON_SIMD_SSE2)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1F);
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+		__m128i bad = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+
+		/* unsigned v <= 0x1F; non-ASCII bytes are checked one by one */
+		bad = _mm_or_si128(bad, _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+		if ((_mm_movemask_epi8(bad) | _mm_movemask_epi8(v)) != 0)
+			break;
+	}
+#elif defined(JSON_SIMD_NEON)
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8((const uint8_t *) (s + i));
+		uint8x16_t bad = vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\')));
+
+		bad = vorrq_u8(bad, vcltq_u8(v, vdupq_n_u8(0x20)));
+		bad = vorrq_u8(bad, vcgeq_u8(v, vdupq_n_u8(0x80)));
+		if (vmaxvq_u8(bad) != 0)
+			break;
+	}
+#endif
+	while (i < len) {
+		unsigned char c = s[i];
+		size_t n;
+
+		if (c < 0x20 || c == '"' || c == '\\')
+			break;
+		if (c < 0x80) {
+			i++;
+			continue;
+		}
+		n = utf8_sequence_length((const unsigned char *) s + i, len - i);
+		if (n == 0)
+			break;
+		i += n;
+	}
+	return i;
+}
+
+static void
+append_escaped(JSONWriter *w, const char *s, size_t len)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t i = 0, run;
+	char esc[6];
+
+	append_char(w, '"');
+	while (i < len) {
+		run = safe_run(s + i, len - i);
+		append(w, s + i, run);
+		i += run;
+		if (i >= len)
+			break;
+
+		esc[0] = '\\';
+		switch (s[i]) {
+		case '"': esc[1] = '"'; break;
+		case '\\': esc[1] = '\\'; break;
+		case '\b': esc[1] = 'b'; break;
+		case '\f': esc[1] = 'f'; break;
+		case '\n': esc[1] = 'n'; break;
+		case '\r': esc[1] = 'r'; break;
+		case '\t': esc[1] = 't'; break;
+		default:
+			/* control characters, and bytes that are not UTF-8 */
+			esc[1] = 'u';
+			esc[2] = '0';
+			esc[3] = '0';
+			esc[4] = hex[(s[i] >> 4) & 0xF];
+			esc[5] = hex[s[i] & 0xF];
+			append(w, esc, 6);
+			i++;
+			continue;
+		}
+		append(w, esc, 2);
+		i++;
+	}
+	append_char(w, '"');
+}
+
+/* json_key_string:
+ *   Write the key of the next member of an object.
+ */
+void
+json_key_string(JSONWriter *w, const char *key, size_t len)
+{
+	begin_value(w);
+	append_escaped(w, key, len);
+	append_char(w, ':');
+	w->need_comma = false;
+}
+
+void
+json_key(JSONWriter *w, const char *key)
+{
+	json_key_string(w, key, strlen(key));
+}
+
+void
+json_string(JSONWriter *w, const char *s, size_t len)
+{
+	begin_value(w);
+	append_escaped(w, s, len);
+}
+
+/* json_cstring:
+ *   Write a NUL-terminated string, or null if `s' is NULL.
+ */
+void
+json_cstring(JSONWriter *w, const char *s)
+{
+	if (s == NULL)
+		json_null(w);
+	else
+		json_string(w, s, strlen(s));
+}
+
+void
+json_uint(JSONWriter *w, uint64_t n)
+{
+	char buf[24];
+	int len;
+
+	begin_value(w);
+	len = snprintf(buf, sizeof(buf), "%llu", (unsigned long long) n);
+	append(w, buf, len);
+}
+
+void
+json_bool(JSONWriter *w, bool b)
+{
+	begin_value(w);
+	if (b)
+		append(w, "true", 4);
+	else
+		append(w, "false", 5);
+}
+
+void
+json_null(JSONWriter *w)
+{
+	begin_value(w);
+	append(w, "null", 4);
+}
+
+/* json_raw:
+ *   Append JSON made by another writer: a value, or the members of an
+ *   object (starting with their key) if inside an object.
+ */
+void
+json_raw(JSONWriter *w, const char *json, size_t len)
+{
+	if (len == 0)
+		return;
+	begin_value(w);
+	append(w, json, len);
+}
+
+/* json_end_line:
+ *   Terminate the current document with a newline, as in NDJSON, so that
+ *   the next value written starts a new one.
+ */
+void
+json_end_line(JSONWriter *w)
+{
+	append_char(w, '\n');
+	w->need_comma = false;
+}
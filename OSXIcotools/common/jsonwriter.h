@@ -0,0 +1,51 @@
+/* jsonwriter.h - Streaming JSON writer
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMMON_JSONWRITER_H
+#define COMMON_JSONWRITER_H
+
+#include <stdbool.h>	/* Gnulib/C99/POSIX */
+#include <stddef.h>	/* C89 */
+#include <stdint.h>	/* Gnulib/C99/POSIX */
+
+typedef struct _JSONWriter {
+	char *data;
+	size_t size;
+	size_t capacity;
+	bool need_comma;
+} JSONWriter;
+
+void json_writer_init(JSONWriter *);
+void json_writer_reset(JSONWriter *);
+void json_writer_free(JSONWriter *);
+
+void json_begin_object(JSONWriter *);
+void json_end_object(JSONWriter *);
+void json_begin_array(JSONWriter *);
+void json_end_array(JSONWriter *);
+void json_key(JSONWriter *, const char *);
+void json_key_string(JSONWriter *, const char *, size_t);
+void json_string(JSONWriter *, const char *, size_t);
+void json_cstring(JSONWriter *, const char *);
+void json_uint(JSONWriter *, uint64_t);
+void json_bool(JSONWriter *, bool);
+void json_null(JSONWriter *);
+void json_raw(JSONWriter *, const char *, size_t);
+void json_end_line(JSONWriter *);
+
+#endif
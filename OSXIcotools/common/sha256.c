@@ -0,0 +1,164 @@
+/* sha256.c - SHA-256 message digest
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* SHA-256 as specified in FIPS 180-4. Used where a digest has to mean
+ * the same thing outside of this program, such as in inventories of
+ * files; xxh64() is much faster for anything else. */
+
+#include <config.h>
+#include <string.h>	/* C89 */
+#include "sha256.h"	/* common */
+
+
+#define ROTR32(x, r) (((x) >> (r)) | ((x) << (32 - (r))))
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+
+static uint32_t
+read32be(const uint8_t *p)
+{
+	return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static void
+write32be(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+/* sha256_blocks:
+ *   Run the compression function on `count' consecutive 64-byte blocks.
+ */
+static void
+sha256_blocks(uint32_t state[8], const uint8_t *p, size_t count)
+{
+	uint32_t w[64];
+	uint32_t a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+
+	for (; count > 0; count--, p += SHA256_BLOCK_SIZE) {
+		for (i = 0; i < 16; i++)
+			w[i] = read32be(p + i * 4);
+		for (i = 16; i < 64; i++) {
+			t1 = ROTR32(w[i-2], 17) ^ ROTR32(w[i-2], 19) ^ (w[i-2] >> 10);
+			t2 = ROTR32(w[i-15], 7) ^ ROTR32(w[i-15], 18) ^ (w[i-15] >> 3);
+			w[i] = t1 + w[i-7] + t2 + w[i-16];
+		}
+
+		a = state[0]; b = state[1]; c = state[2]; d = state[3];
+		e = state[4]; f = state[5]; g = state[6]; h = state[7];
+		for (i = 0; i < 64; i++) {
+			t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25))
+			    + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+			t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22))
+			    + ((a & b) ^ (a & c) ^ (b & c));
+			h = g; g = f; f = e;
+			e = d + t1;
+			d = c; c = b; b = a;
+			a = t1 + t2;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+	}
+}
+
+void
+sha256_init(SHA256Context *ctx)
+{
+	static const uint32_t initial[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+
+	memcpy(ctx->state, initial, sizeof(initial));
+	ctx->length = 0;
+	ctx->buffered = 0;
+}
+
+void
+sha256_update(SHA256Context *ctx, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t n;
+
+	ctx->length += len;
+	if (ctx->buffered > 0) {
+		n = SHA256_BLOCK_SIZE - ctx->buffered;
+		if (n > len)
+			n = len;
+		memcpy(ctx->buffer + ctx->buffered, p, n);
+		ctx->buffered += n;
+		p += n;
+		len -= n;
+		if (ctx->buffered < SHA256_BLOCK_SIZE)
+			return;
+		sha256_blocks(ctx->state, ctx->buffer, 1);
+		ctx->buffered = 0;
+	}
+	/* whole blocks are hashed where they are */
+	n = len / SHA256_BLOCK_SIZE;
+	sha256_blocks(ctx->state, p, n);
+	p += n * SHA256_BLOCK_SIZE;
+	len -= n * SHA256_BLOCK_SIZE;
+	memcpy(ctx->buffer, p, len);
+	ctx->buffered = len;
+}
+
+void
+sha256_final(SHA256Context *ctx, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	uint64_t bits = ctx->length * 8;
+	int i;
+
+	ctx->buffer[ctx->buffered++] = 0x80;
+	if (ctx->buffered > SHA256_BLOCK_SIZE - 8) {
+		memset(ctx->buffer + ctx->buffered, 0, SHA256_BLOCK_SIZE - ctx->buffered);
+		sha256_blocks(ctx->state, ctx->buffer, 1);
+		ctx->buffered = 0;
+	}
+	memset(ctx->buffer + ctx->buffered, 0, SHA256_BLOCK_SIZE - 8 - ctx->buffered);
+	write32be(ctx->buffer + SHA256_BLOCK_SIZE - 8, bits >> 32);
+	write32be(ctx->buffer + SHA256_BLOCK_SIZE - 4, bits);
+	sha256_blocks(ctx->state, ctx->buffer, 1);
+
+	for (i = 0; i < 8; i++)
+		write32be(digest + i * 4, ctx->state[i]);
+}
+
+void
+sha256(const void *data, size_t len, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	SHA256Context ctx;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, data, len);
+	sha256_final(&ctx, digest);
+}
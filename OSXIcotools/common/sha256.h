@@ -0,0 +1,40 @@
+/* sha256.h - SHA-256 message digest
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMMON_SHA256_H
+#define COMMON_SHA256_H
+
+#include <stddef.h>	/* C89 */
+#include <stdint.h>	/* Gnulib/C99/POSIX */
+
+#define SHA256_DIGEST_SIZE	32
+#define SHA256_BLOCK_SIZE	64
+
+typedef struct _SHA256Context {
+	uint32_t state[8];
+	uint64_t length;			/* bytes hashed so far */
+	uint8_t buffer[SHA256_BLOCK_SIZE];
+	size_t buffered;
+} SHA256Context;
+
+void sha256_init(SHA256Context *);
+void sha256_update(SHA256Context *, const void *, size_t);
+void sha256_final(SHA256Context *, uint8_t digest[SHA256_DIGEST_SIZE]);
+void sha256(const void *data, size_t len, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+#endif
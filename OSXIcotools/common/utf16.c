@@ -0,0 +1,187 @@
+/* utf16.c - UTF-16 string conversion routines.
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The conversion loops skip runs of ASCII characters 8 code units at a
+ * time with SSE2 or NEON where available, since most strings found in
+ * resources are plain ASCII. Unpaired surrogates are replaced with
+ * U+FFFD, so the output is always valid UTF-8. */
+
+#include <config.h>
+#include <stdlib.h>	/* C89 */
+#include "xalloc.h"	/* Gnulib */
+#include "utf16.h"	/* common */
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#  define UTF16_SIMD_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#  include <arm_neon.h>
+#  define UTF16_SIMD_NEON
+#endif
+
+
+/* ascii_run:
+ *   Returns how many of the first `len' code units are ASCII, counting
+ *   in blocks of 8 when SIMD is available. If `dst' is not NULL, those
+ *   characters are also copied there as bytes.
+ */
+static size_t
+ascii_run(char *dst, const uint16_t *src, size_t len)
+{
+	size_t i = 0;
+
+#if defined(UTF16_SIMD_SSE2)
+	const __m128i mask = _mm_set1_epi16((short) 0xFF80);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 8 <= len; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, mask), zero)) != 0xFFFF)
+			break;
+		if (dst)
+			_mm_storel_epi64((__m128i *) (dst + i), _mm_packus_epi16(v, v));
+	}
+#elif defined(UTF16_SIMD_NEON)
+	for (; i + 8 <= len; i += 8) {
+		uint16x8_t v = vld1q_u16(src + i);
+
+		if (vmaxvq_u16(v) >= 0x80)
+			break;
+		if (dst)
+			vst1_u8((uint8_t *) (dst + i), vmovn_u16(v));
+	}
+#endif
+	for (; i < len && src[i] < 0x80; i++) {
+		if (dst)
+			dst[i] = (char) src[i];
+	}
+	return i;
+}
+
+/* next_code_point:
+ *   Decode the code point at `src[*i]' and advance `*i'.
+ */
+static uint32_t
+next_code_point(const uint16_t *src, size_t len, size_t *i)
+{
+	uint32_t c = src[*i];
+
+	(*i)++;
+	if (c < 0xD800 || c > 0xDFFF)
+		return c;
+	if (c <= 0xDBFF && *i < len && src[*i] >= 0xDC00 && src[*i] <= 0xDFFF) {
+		c = 0x10000 + ((c - 0xD800) << 10) + (src[*i] - 0xDC00);
+		(*i)++;
+		return c;
+	}
+	return 0xFFFD;
+}
+
+static size_t
+utf8_length_of(uint32_t c)
+{
+	if (c < 0x80)
+		return 1;
+	if (c < 0x800)
+		return 2;
+	if (c < 0x10000)
+		return 3;
+	return 4;
+}
+
+/* utf16le_to_utf8_length:
+ *   Returns the number of bytes needed to convert `len' UTF-16LE code
+ *   units to UTF-8, without terminator.
+ */
+size_t
+utf16le_to_utf8_length(const uint16_t *src, size_t len)
+{
+	size_t i = 0, res = 0, run;
+
+	while (i < len) {
+		run = ascii_run(NULL, src + i, len - i);
+		i += run;
+		res += run;
+		if (i < len)
+			res += utf8_length_of(next_code_point(src, len, &i));
+	}
+	return res;
+}
+
+/* utf16le_to_utf8:
+ *   Convert `len' UTF-16LE code units to UTF-8, writing at most `size'
+ *   bytes to `dst'. If the output does not fit, it is cut before the first
+ *   code point that does not fit. No terminator is written. Returns the
+ *   number of bytes written.
+ */
+size_t
+utf16le_to_utf8(char *dst, size_t size, const uint16_t *src, size_t len)
+{
+	size_t i = 0, o = 0, run;
+	uint32_t c;
+
+	while (i < len) {
+		/* copies the run while looking for its end */
+		run = ascii_run(dst + o, src + i, len - i < size - o ? len - i : size - o);
+		i += run;
+		o += run;
+		if (i >= len || o >= size)
+			break;
+
+		c = next_code_point(src, len, &i);
+		if (utf8_length_of(c) > size - o)
+			break;
+		if (c < 0x80) {
+			dst[o++] = c;
+		} else if (c < 0x800) {
+			dst[o++] = 0xC0 | (c >> 6);
+			dst[o++] = 0x80 | (c & 0x3F);
+		} else if (c < 0x10000) {
+			dst[o++] = 0xE0 | (c >> 12);
+			dst[o++] = 0x80 | ((c >> 6) & 0x3F);
+			dst[o++] = 0x80 | (c & 0x3F);
+		} else {
+			dst[o++] = 0xF0 | (c >> 18);
+			dst[o++] = 0x80 | ((c >> 12) & 0x3F);
+			dst[o++] = 0x80 | ((c >> 6) & 0x3F);
+			dst[o++] = 0x80 | (c & 0x3F);
+		}
+	}
+	return o;
+}
+
+/* utf16le_to_utf8_dup:
+ *   Convert `len' UTF-16LE code units to a newly allocated, NUL-terminated
+ *   UTF-8 string of exactly the right size. If `outlen' is not NULL, the
+ *   length of the result (without terminator) is put there.
+ */
+char *
+utf16le_to_utf8_dup(const uint16_t *src, size_t len, size_t *outlen)
+{
+	size_t size;
+	char *res;
+
+	size = utf16le_to_utf8_length(src, len);
+	res = xmalloc(size + 1);
+	utf16le_to_utf8(res, size, src, len);
+	res[size] = '\0';
+
+	if (outlen) *outlen = size;
+	return res;
+}
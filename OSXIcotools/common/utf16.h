@@ -0,0 +1,29 @@
+/* utf16.h - UTF-16 string conversion routines.
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMMON_UTF16_H
+#define COMMON_UTF16_H
+
+#include <stddef.h>	/* C89 */
+#include <stdint.h>	/* Gnulib/C99/POSIX */
+
+size_t utf16le_to_utf8_length(const uint16_t *src, size_t len);
+size_t utf16le_to_utf8(char *dst, size_t size, const uint16_t *src, size_t len);
+char *utf16le_to_utf8_dup(const uint16_t *src, size_t len, size_t *outlen);
+
+#endif
@@ -0,0 +1,117 @@
+/* xxhash.c - XXH64 non-cryptographic hash
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* XXH64 as specified by Yann Collet, for fingerprinting resources. The
+ * input is read in little-endian order, which is the order of every
+ * machine this code runs on. */
+
+#include <config.h>
+#include <string.h>	/* C89 */
+#include "xxhash.h"	/* common */
+
+
+#define PRIME64_1 (11400714785074694791ULL)
+#define PRIME64_2 (14029467366897019727ULL)
+#define PRIME64_3 (1609587929392839161ULL)
+#define PRIME64_4 (9650029242287828579ULL)
+#define PRIME64_5 (2870177450012600261ULL)
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+
+static uint64_t
+read64(const uint8_t *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t
+read32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint64_t
+xxh64_round(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc = ROTL64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static uint64_t
+xxh64_merge_round(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh64_round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t
+xxh64(const void *data, size_t len, uint64_t seed)
+{
+	const uint8_t *p = data, *end = p + len;
+	uint64_t h, v1, v2, v3, v4;
+
+	if (len >= 32) {
+		v1 = seed + PRIME64_1 + PRIME64_2;
+		v2 = seed + PRIME64_2;
+		v3 = seed;
+		v4 = seed - PRIME64_1;
+		do {
+			v1 = xxh64_round(v1, read64(p));
+			v2 = xxh64_round(v2, read64(p + 8));
+			v3 = xxh64_round(v3, read64(p + 16));
+			v4 = xxh64_round(v4, read64(p + 24));
+			p += 32;
+		} while (end - p >= 32);
+
+		h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+		h = xxh64_merge_round(h, v1);
+		h = xxh64_merge_round(h, v2);
+		h = xxh64_merge_round(h, v3);
+		h = xxh64_merge_round(h, v4);
+	} else {
+		h = seed + PRIME64_5;
+	}
+	h += (uint64_t) len;
+
+	for (; end - p >= 8; p += 8) {
+		h ^= xxh64_round(0, read64(p));
+		h = ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+	if (end - p >= 4) {
+		h ^= (uint64_t) read32(p) * PRIME64_1;
+		h = ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * PRIME64_5;
+		h = ROTL64(h, 11) * PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
@@ -163,6 +163,10 @@ typedef struct {
 #define RT_GROUP_CURSOR  12
 #define RT_GROUP_ICON    14
 #define RT_VERSION       16
+#define RT_ANICURSOR     21
+#define RT_ANIICON       22
+#define RT_HTML          23
+#define RT_MANIFEST      24
 
 typedef struct {
     union {
@@ -0,0 +1,217 @@
+/* anicursor.c - Streaming reader for animated cursors and icons
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* RT_ANICURSOR and RT_ANIICON resources are complete `.ani' files, which
+ * are RIFF files of form `ACON' containing:
+ *   - an `anih' chunk (frame count, default rate, flags)
+ *   - optional `rate' and `seq ' chunks
+ *   - a `LIST' chunk of type `fram' with one `icon' chunk per frame,
+ *     each one containing an `.ico' or `.cur' file.
+ * The reader only walks chunk headers: frames are located when they are
+ * asked for, and never copied or decoded unless the caller does so. */
+
+#include <config.h>
+#include "gettext.h"			/* Gnulib */
+#define _(s) gettext(s)
+#define N_(s) gettext_noop(s)
+#include "xalloc.h"			/* Gnulib */
+#include "common/log.h"
+#include "win32.h"
+#include "restable.h"
+#include "anicursor.h"
+
+
+#define FOURCC(a, b, c, d) \
+	((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+#define RIFF_ID_RIFF FOURCC('R', 'I', 'F', 'F')
+#define RIFF_ID_LIST FOURCC('L', 'I', 'S', 'T')
+#define RIFF_ID_ACON FOURCC('A', 'C', 'O', 'N')
+#define RIFF_ID_ANIH FOURCC('a', 'n', 'i', 'h')
+#define RIFF_ID_RATE FOURCC('r', 'a', 't', 'e')
+#define RIFF_ID_FRAM FOURCC('f', 'r', 'a', 'm')
+#define RIFF_ID_ICON FOURCC('i', 'c', 'o', 'n')
+
+#pragma pack(1)
+typedef struct {
+	uint32_t id;
+	uint32_t size;
+} RiffChunkHeader;
+
+typedef struct {
+	uint32_t size;
+	uint32_t frames;
+	uint32_t steps;
+	uint32_t width;
+	uint32_t height;
+	uint32_t bit_count;
+	uint32_t planes;
+	uint32_t rate;
+	uint32_t flags;
+} AniHeader;
+#pragma pack()
+
+
+/* riff_next_chunk:
+ *   Read the chunk header at `*pos' and advance `*pos' to the following
+ *   chunk. Chunks are padded to an even size. Returns false if the chunk
+ *   does not fit before `end'.
+ */
+static bool
+riff_next_chunk(const uint8_t **pos, const uint8_t *end, uint32_t *id,
+                const uint8_t **data, uint32_t *size)
+{
+	const RiffChunkHeader *hdr = (const RiffChunkHeader *) *pos;
+
+	if ((size_t)(end - *pos) < sizeof(RiffChunkHeader))
+		return false;
+	if (hdr->size > (size_t)(end - *pos) - sizeof(RiffChunkHeader))
+		return false;
+
+	*id = hdr->id;
+	*size = hdr->size;
+	*data = *pos + sizeof(RiffChunkHeader);
+	*pos = *data + hdr->size;
+	if ((hdr->size & 1) && *pos < end)
+		(*pos)++;
+	return true;
+}
+
+/* ani_reader_init:
+ *   Prepare to read the frames of the `.ani' file in `data'. Only the
+ *   headers of the top level chunks are looked at.
+ */
+wres_error
+ani_reader_init(WinAniReader *ar, const void *data, size_t size)
+{
+	const uint8_t *pos, *end, *chunk;
+	uint32_t id, chunk_size;
+	bool have_header = false;
+
+	memset(ar, 0, sizeof(WinAniReader));
+	ar->data = data;
+	ar->size = size;
+
+	pos = data;
+	end = pos + size;
+	if (!riff_next_chunk(&pos, end, &id, &chunk, &chunk_size))
+		return WRES_ERROR_PREMATUREEND;
+	if (id != RIFF_ID_RIFF || chunk_size < sizeof(uint32_t) || *(uint32_t *)chunk != RIFF_ID_ACON)
+		return WRES_ERROR_WRONGFORMAT;
+
+	/* walk the chunks of the ACON form */
+	end = chunk + chunk_size;
+	pos = chunk + sizeof(uint32_t);
+	while (pos < end) {
+		if (!riff_next_chunk(&pos, end, &id, &chunk, &chunk_size))
+			return WRES_ERROR_PREMATUREEND;
+
+		if (id == RIFF_ID_ANIH) {
+			const AniHeader *anih = (const AniHeader *) chunk;
+			if (chunk_size < sizeof(AniHeader))
+				return WRES_ERROR_PREMATUREEND;
+			ar->flags = anih->flags;
+			ar->frame_count = anih->frames;
+			ar->default_rate = anih->rate;
+			have_header = true;
+		} else if (id == RIFF_ID_RATE) {
+			ar->rates = (const uint32_t *) chunk;
+			ar->rate_count = chunk_size / sizeof(uint32_t);
+		} else if (id == RIFF_ID_LIST && chunk_size >= sizeof(uint32_t)
+		           && *(uint32_t *)chunk == RIFF_ID_FRAM) {
+			ar->next = chunk + sizeof(uint32_t);
+			ar->end = chunk + chunk_size;
+		}
+	}
+
+	if (!have_header || ar->next == NULL)
+		return WRES_ERROR_PREMATUREEND;
+	/* frames stored as raw bitmaps are never found in resources */
+	if (!(ar->flags & ANI_FLAG_ICON))
+		return WRES_ERROR_UNSUPPRESTYPE;
+	return WRES_ERROR_NONE;
+}
+
+/* ani_reader_next_frame:
+ *   Return the next frame stored in the file. Frames are returned in the
+ *   order they are stored, which is not necessarily the order they are
+ *   shown in if the file has a `seq ' chunk. Returns false when there
+ *   are no more frames, or when the file is corrupt (and `err' is set).
+ */
+bool
+ani_reader_next_frame(WinAniReader *ar, WinAniFrame *frame, wres_error *err)
+{
+	const uint8_t *chunk;
+	uint32_t id, chunk_size;
+
+	if (err) *err = WRES_ERROR_NONE;
+	while (ar->next < ar->end) {
+		if (!riff_next_chunk(&ar->next, ar->end, &id, &chunk, &chunk_size)) {
+			if (err) *err = WRES_ERROR_PREMATUREEND;
+			ar->next = ar->end;
+			return false;
+		}
+		if (id != RIFF_ID_ICON)
+			continue;
+
+		frame->data = chunk;
+		frame->size = chunk_size;
+		frame->index = ar->index;
+		/* without a sequence, rates are per frame */
+		if (ar->rates && !(ar->flags & ANI_FLAG_SEQUENCE) && ar->index < ar->rate_count)
+			frame->rate = ar->rates[ar->index];
+		else
+			frame->rate = ar->default_rate;
+		ar->index++;
+		return true;
+	}
+	return false;
+}
+
+/* extract_ani_frame_vec:
+ *   Extract the best image of the first frame of a RT_ANICURSOR or
+ *   RT_ANIICON resource, which is all that is needed for a thumbnail.
+ *   The other frames are not even located. `is_icon' selects whether
+ *   DIB images are wrapped in an `.ico' or a `.cur' file.
+ *   `vec' must be freed with free_resource_vec().
+ */
+wres_error
+extract_ani_frame_vec(WinLibrary *fi, WinResource *wr, bool is_icon, WinResourceVec *vec)
+{
+	WinAniReader ar;
+	WinAniFrame frame;
+	WinIconImage img;
+	wres_error err;
+	size_t size;
+	void *data;
+
+	data = get_resource_entry(fi, wr, &size, &err);
+	if (data == NULL)
+		return err;
+
+	err = ani_reader_init(&ar, data, size);
+	if (err)
+		return err;
+	if (!ani_reader_next_frame(&ar, &frame, &err))
+		return err ? err : WRES_ERROR_RESNOTFOUND;
+
+	err = find_best_icon_file_image(frame.data, frame.size, &img);
+	if (err)
+		return err;
+	return icon_image_vec(&img, is_icon, vec);
+}
@@ -0,0 +1,59 @@
+/* anicursor.h - Streaming reader for animated cursors and icons
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ANICURSOR_H
+#define ANICURSOR_H
+
+#include "wrestool.h"
+#include "extract.h"
+
+
+/* State of a reader walking the frames of a RIFF `ACON' file. Nothing is
+ * copied out of the file; all pointers refer to the data passed to
+ * ani_reader_init(). */
+typedef struct _WinAniReader {
+	const uint8_t *data;
+	size_t size;
+	uint32_t flags;			/* anih flags */
+	uint32_t frame_count;	/* anih frame count */
+	uint32_t default_rate;	/* anih rate, in jiffies (1/60 s) */
+	const uint32_t *rates;	/* `rate' chunk, or NULL */
+	uint32_t rate_count;
+	const uint8_t *next;	/* next chunk in the `fram' list */
+	const uint8_t *end;		/* end of the `fram' list */
+	uint32_t index;			/* index of the next frame */
+} WinAniReader;
+
+typedef struct _WinAniFrame {
+	const void *data;		/* an `.ico' or `.cur' file */
+	size_t size;
+	uint32_t index;
+	uint32_t rate;			/* display time, in jiffies (1/60 s) */
+} WinAniFrame;
+
+#define ANI_FLAG_ICON		(0x1)	/* frames are icons/cursors, not raw bitmaps */
+#define ANI_FLAG_SEQUENCE	(0x2)	/* the file has a `seq ' chunk */
+
+
+wres_error ani_reader_init(WinAniReader *, const void *, size_t);
+bool ani_reader_next_frame(WinAniReader *, WinAniFrame *, wres_error *);
+
+wres_error extract_ani_frame_vec(WinLibrary *, WinResource *, bool, WinResourceVec *);
+
+
+#endif
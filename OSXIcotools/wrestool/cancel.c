@@ -0,0 +1,120 @@
+/* cancel.c - Cancellation of loading and extraction
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* A Quick Look preview of a file the user has already scrolled past is
+ * wasted work. Whoever starts a request makes a token and installs it
+ * as the token of the thread with set_thread_cancel_token(); any other
+ * thread can then cancel it, and the token can also expire by itself.
+ * The loader, the resource walk and the extractors poll the token of
+ * their thread with wres_cancelled() and give up with
+ * WRES_ERROR_CANCELLED. A token can have a parent, such as a token for
+ * one stage of a request under the token of the whole request. Passing
+ * the token through the thread instead of through every function keeps
+ * the interface of the library as it is, and lets libraries shared by
+ * several requests be cancelled per request. */
+
+#include <config.h>
+#include <time.h>
+#include "cancel.h"
+
+
+static __thread WinCancelToken *thread_token;
+
+
+static uint64_t
+now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* cancel_token_init:
+ *   Make a token that is not cancelled, and that expires after
+ *   `timeout_us' microseconds unless that is zero.
+ */
+void
+cancel_token_init(WinCancelToken *tok, uint64_t timeout_us)
+{
+	cancel_token_init_with_parent(tok, NULL, timeout_us);
+}
+
+/* cancel_token_init_with_parent:
+ *   Like cancel_token_init(), but the token is also cancelled when
+ *   `parent' is. The parent must outlive the token.
+ */
+void
+cancel_token_init_with_parent(WinCancelToken *tok, WinCancelToken *parent, uint64_t timeout_us)
+{
+	tok->cancelled = 0;
+	tok->deadline = timeout_us ? now_us() + timeout_us : 0;
+	tok->parent = parent;
+}
+
+/* cancel_token_cancel:
+ *   Cancel whatever is using the token. Can be called from any thread.
+ */
+void
+cancel_token_cancel(WinCancelToken *tok)
+{
+	__atomic_store_n(&tok->cancelled, 1, __ATOMIC_RELAXED);
+}
+
+bool
+cancel_token_is_cancelled(WinCancelToken *tok)
+{
+	if (__atomic_load_n(&tok->cancelled, __ATOMIC_RELAXED))
+		return true;
+	if (tok->deadline != 0 && now_us() >= tok->deadline) {
+		/* expired tokens stay so without looking at the clock */
+		cancel_token_cancel(tok);
+		return true;
+	}
+	return tok->parent != NULL && cancel_token_is_cancelled(tok->parent);
+}
+
+/* set_thread_cancel_token:
+ *   Make `tok' (or no token, if NULL) the token of the calling thread,
+ *   returning the previous one so that it can be put back.
+ */
+WinCancelToken *
+set_thread_cancel_token(WinCancelToken *tok)
+{
+	WinCancelToken *old = thread_token;
+
+	thread_token = tok;
+	return old;
+}
+
+WinCancelToken *
+thread_cancel_token(void)
+{
+	return thread_token;
+}
+
+/* wres_cancelled:
+ *   Returns true if the token of the calling thread has been cancelled
+ *   or has expired. Cheap enough to be called in loops when the thread
+ *   has no token.
+ */
+bool
+wres_cancelled(void)
+{
+	return thread_token != NULL && cancel_token_is_cancelled(thread_token);
+}
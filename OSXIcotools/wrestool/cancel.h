@@ -0,0 +1,47 @@
+/* cancel.h - Cancellation of loading and extraction
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CANCEL_H
+#define CANCEL_H
+
+#include "wrestool.h"
+
+
+/* Long loops check the token of their thread at least every
+ * CANCEL_CHECK_BYTES bytes processed or CANCEL_CHECK_ENTRIES entries
+ * of a table, which is well under a millisecond of work. */
+#define CANCEL_CHECK_BYTES		(128 * 1024)
+#define CANCEL_CHECK_ENTRIES	(1024)
+
+typedef struct _WinCancelToken {
+	int cancelled;				/* set by cancel_token_cancel() */
+	uint64_t deadline;			/* monotonic microseconds, or 0 for none */
+	struct _WinCancelToken *parent;	/* cancels this one too, if not NULL */
+} WinCancelToken;
+
+
+void cancel_token_init(WinCancelToken *, uint64_t);
+void cancel_token_init_with_parent(WinCancelToken *, WinCancelToken *, uint64_t);
+void cancel_token_cancel(WinCancelToken *);
+bool cancel_token_is_cancelled(WinCancelToken *);
+WinCancelToken *set_thread_cancel_token(WinCancelToken *);
+WinCancelToken *thread_cancel_token(void);
+bool wres_cancelled(void);
+
+
+#endif
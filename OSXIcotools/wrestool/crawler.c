@@ -0,0 +1,475 @@
+/* crawler.c - Parallel scanner of directory trees
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* There are two kinds of task: listing a directory, and checking a
+ * batch of up to CRAWL_BATCH_SIZE files of the same directory. Every
+ * worker has its own deque of tasks. It pushes the tasks it finds and
+ * pops them from the bottom, so each worker goes depth first through
+ * its part of the tree. Idle workers steal from the top of the others'
+ * deques, which holds the oldest tasks, near the root. Stolen tasks are
+ * usually big subtrees, so stealing does not happen often. Files are
+ * opened and checked relative to the file descriptor of their
+ * directory, which stays open until all of its batches are done; since
+ * the batches of a directory are queued after its subdirectories, they
+ * are done first, and few directories are open at once. The headers of
+ * a batch are read together by scan_headers(), and only the files that
+ * turn out to be modules are loaded. */
+
+#include <config.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "xalloc.h"			/* Gnulib */
+#include "headerscan.h"
+#include "crawler.h"
+
+
+#define CRAWL_BATCH_SIZE	HEADER_SCAN_BATCH
+#define CRAWL_MAX_WORKERS	(256)
+
+/* An open directory, shared by the batches of its files */
+typedef struct _CrawlDir {
+	DIR *dp;
+	int fd;
+	char *path;
+	int refcount;
+} CrawlDir;
+
+typedef struct _CrawlTask {
+	struct _CrawlTask *next;	/* used while listing a directory */
+	char *path;					/* directory to list, or NULL */
+	CrawlDir *dir;				/* directory of the batch */
+	int name_count;
+	char *names[CRAWL_BATCH_SIZE];
+} CrawlTask;
+
+typedef struct _CrawlDeque {
+	pthread_mutex_t lock;
+	CrawlTask **tasks;
+	size_t top;					/* oldest task, stolen first */
+	size_t bottom;				/* one past the newest task */
+	size_t capacity;
+} CrawlDeque;
+
+typedef struct _CrawlWorker {
+	pthread_t thread;
+	int index;
+	struct _Crawler *crawler;
+	CrawlDeque deque;
+	WinHeaderScanner *scanner;
+	WinLibrary *fl;
+	char *path;					/* buffer for the path of the current file */
+	size_t path_size;
+	WinCrawlStats stats;
+} CrawlWorker;
+
+typedef struct _Crawler {
+	CrawlWorker *workers;
+	int worker_count;
+	long pending;				/* tasks pushed and not done yet */
+	int hash_flags;
+	CrawlCallback callback;
+	void *ctx;
+} Crawler;
+
+
+static void
+deque_push(CrawlDeque *dq, CrawlTask *task)
+{
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bottom == dq->capacity) {
+		if (dq->top > 0) {
+			memmove(dq->tasks, dq->tasks + dq->top, (dq->bottom - dq->top) * sizeof(CrawlTask *));
+			dq->bottom -= dq->top;
+			dq->top = 0;
+		}
+		if (dq->bottom == dq->capacity) {
+			dq->capacity = dq->capacity ? dq->capacity * 2 : 64;
+			dq->tasks = xrealloc(dq->tasks, dq->capacity * sizeof(CrawlTask *));
+		}
+	}
+	dq->tasks[dq->bottom++] = task;
+	pthread_mutex_unlock(&dq->lock);
+}
+
+/* deque_take:
+ *   Take the newest task if `steal' is false, the oldest one otherwise.
+ */
+static CrawlTask *
+deque_take(CrawlDeque *dq, bool steal)
+{
+	CrawlTask *task = NULL;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->top < dq->bottom) {
+		task = steal ? dq->tasks[dq->top++] : dq->tasks[--dq->bottom];
+		if (dq->top == dq->bottom)
+			dq->top = dq->bottom = 0;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return task;
+}
+
+static void
+push_task(CrawlWorker *wk, CrawlTask *task)
+{
+	__atomic_add_fetch(&wk->crawler->pending, 1, __ATOMIC_RELAXED);
+	deque_push(&wk->deque, task);
+}
+
+/* next_task:
+ *   Returns the next task for a worker, stealing it if necessary, or
+ *   NULL when the crawl is over.
+ */
+static CrawlTask *
+next_task(CrawlWorker *wk)
+{
+	Crawler *cr = wk->crawler;
+	CrawlTask *task;
+	unsigned idle = 0;
+	int c, victim;
+
+	for (;;) {
+		task = deque_take(&wk->deque, false);
+		if (task)
+			return task;
+		for (c = 1; c < cr->worker_count; c++) {
+			victim = (wk->index + c) % cr->worker_count;
+			task = deque_take(&cr->workers[victim].deque, true);
+			if (task)
+				return task;
+		}
+		/* tasks being run may still push more */
+		if (__atomic_load_n(&cr->pending, __ATOMIC_ACQUIRE) == 0)
+			return NULL;
+		if (++idle < 64)
+			sched_yield();
+		else
+			usleep(100);
+	}
+}
+
+static void
+release_dir(CrawlDir *dir)
+{
+	if (__atomic_sub_fetch(&dir->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+	if (dir->dp)
+		closedir(dir->dp);
+	free(dir->path);
+	free(dir);
+}
+
+/* join_path:
+ *   Put `dir'/`name' in the path buffer of the worker.
+ */
+static const char *
+join_path(CrawlWorker *wk, const char *dir, const char *name)
+{
+	size_t dir_len = strlen(dir), name_len = strlen(name), need;
+	bool slash = dir_len > 0 && dir[dir_len - 1] != '/';
+
+	need = dir_len + slash + name_len + 1;
+	if (need > wk->path_size) {
+		wk->path_size = need * 2;
+		wk->path = xrealloc(wk->path, wk->path_size);
+	}
+	memcpy(wk->path, dir, dir_len);
+	if (slash)
+		wk->path[dir_len] = '/';
+	memcpy(wk->path + dir_len + slash, name, name_len + 1);
+	return wk->path;
+}
+
+/* load_file:
+ *   Load a file whose headers have been found to be those of a module.
+ */
+static void
+load_file(CrawlWorker *wk, CrawlDir *dir, const char *name)
+{
+	Crawler *cr = wk->crawler;
+	const char *path;
+	wres_error err;
+	int fd;
+
+	path = join_path(wk, dir->path, name);
+	/* roots given as files are opened by their path, and may be links */
+	if (dir->fd == AT_FDCWD)
+		fd = open(name, O_RDONLY | O_CLOEXEC);
+	else
+		fd = openat(dir->fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0) {
+		err = -errno;
+	} else {
+		if (wk->fl == NULL) {
+			wk->fl = new_winlibrary();
+			if (wk->fl == NULL)
+				xalloc_die();
+			wk->fl->hash_flags = cr->hash_flags;
+		}
+		err = reload_winlibrary_from_fd(wk->fl, fd, path);
+	}
+
+	if (err == WRES_ERROR_NONE) {
+		wk->stats.libraries++;
+		cr->callback(wk->index, wk->fl, path, err, cr->ctx);
+	} else {
+		wk->stats.errors++;
+		cr->callback(wk->index, NULL, path, err, cr->ctx);
+	}
+}
+
+/* check_batch:
+ *   Read the headers of a batch of files at once, and load the modules.
+ */
+static void
+check_batch(CrawlWorker *wk, CrawlTask *task)
+{
+	Crawler *cr = wk->crawler;
+	WinHeaderScan scans[CRAWL_BATCH_SIZE];
+	CrawlDir *dir = task->dir;
+	int c;
+
+	if (wk->scanner == NULL)
+		wk->scanner = new_header_scanner(1, NULL);
+	memset(scans, 0, sizeof(scans));
+	for (c = 0; c < task->name_count; c++)
+		scans[c].path = task->names[c];
+	scan_headers(wk->scanner, dir->fd, scans, task->name_count);
+
+	for (c = 0; c < task->name_count; c++) {
+		if (scans[c].error == WRES_ERROR_NONE) {
+			wk->stats.candidates++;
+			wk->stats.bytes += scans[c].size;
+			load_file(wk, dir, task->names[c]);
+		} else if (scans[c].error < WRES_ERROR_NONE) {
+			/* could not be opened or read: report it like a failed load */
+			wk->stats.errors++;
+			cr->callback(wk->index, NULL, join_path(wk, dir->path, task->names[c]),
+			             scans[c].error, cr->ctx);
+		}
+	}
+}
+
+/* list_dir:
+ *   Queue the subdirectories of a directory, and its files in batches.
+ */
+static void
+list_dir(CrawlWorker *wk, char *path)
+{
+	Crawler *cr = wk->crawler;
+	CrawlTask *batch = NULL, *full = NULL, *sub;
+	CrawlDir *dir;
+	struct dirent *ent;
+	struct stat st;
+	bool is_dir, is_file;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		wk->stats.errors++;
+		cr->callback(wk->index, NULL, path, -errno, cr->ctx);
+		free(path);
+		return;
+	}
+	dir = xcalloc(1, sizeof(CrawlDir));
+	dir->refcount = 1;
+	dir->path = path;
+	dir->fd = fd;
+	dir->dp = fdopendir(fd);
+	if (dir->dp == NULL) {
+		close(fd);
+		release_dir(dir);
+		return;
+	}
+	wk->stats.directories++;
+
+	while ((ent = readdir(dir->dp)) != NULL) {
+		if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0'
+		    || (ent->d_name[1] == '.' && ent->d_name[2] == '\0')))
+			continue;
+
+		is_dir = ent->d_type == DT_DIR;
+		is_file = ent->d_type == DT_REG;
+		if (ent->d_type == DT_UNKNOWN) {
+			/* some file systems do not fill d_type */
+			if (fstatat(fd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+				continue;
+			is_dir = S_ISDIR(st.st_mode);
+			is_file = S_ISREG(st.st_mode);
+		}
+
+		if (is_dir) {
+			sub = xcalloc(1, sizeof(CrawlTask));
+			sub->path = xstrdup(join_path(wk, path, ent->d_name));
+			push_task(wk, sub);
+		} else if (is_file) {
+			wk->stats.files++;
+			if (batch == NULL) {
+				batch = xcalloc(1, sizeof(CrawlTask));
+				batch->dir = dir;
+				__atomic_add_fetch(&dir->refcount, 1, __ATOMIC_RELAXED);
+			}
+			batch->names[batch->name_count++] = xstrdup(ent->d_name);
+			if (batch->name_count == CRAWL_BATCH_SIZE) {
+				batch->next = full;
+				full = batch;
+				batch = NULL;
+			}
+		}
+	}
+
+	/* the batches go above the subdirectories, so that this worker checks
+	 * the files and closes the directory before going down the tree */
+	if (batch)
+		push_task(wk, batch);
+	while (full) {
+		batch = full;
+		full = full->next;
+		push_task(wk, batch);
+	}
+	release_dir(dir);
+}
+
+static void
+run_task(CrawlWorker *wk, CrawlTask *task)
+{
+	int c;
+
+	if (task->path) {
+		list_dir(wk, task->path);
+	} else {
+		check_batch(wk, task);
+		for (c = 0; c < task->name_count; c++)
+			free(task->names[c]);
+		release_dir(task->dir);
+	}
+	free(task);
+	__atomic_sub_fetch(&wk->crawler->pending, 1, __ATOMIC_RELEASE);
+}
+
+static void *
+crawl_worker(void *arg)
+{
+	CrawlWorker *wk = arg;
+	CrawlTask *task;
+
+	while ((task = next_task(wk)) != NULL)
+		run_task(wk, task);
+	return NULL;
+}
+
+/* queue_root:
+ *   Queue a path given by the user, which may be a directory or a file.
+ *   Symbolic links are followed here, and only here.
+ */
+static void
+queue_root(CrawlWorker *wk, const char *root)
+{
+	Crawler *cr = wk->crawler;
+	CrawlTask *task;
+	CrawlDir *dir;
+	struct stat st;
+
+	if (stat(root, &st) != 0) {
+		wk->stats.errors++;
+		cr->callback(wk->index, NULL, root, -errno, cr->ctx);
+		return;
+	}
+	task = xcalloc(1, sizeof(CrawlTask));
+	if (S_ISDIR(st.st_mode)) {
+		task->path = xstrdup(root);
+	} else {
+		dir = xcalloc(1, sizeof(CrawlDir));
+		dir->fd = AT_FDCWD;
+		dir->path = xstrdup("");
+		dir->refcount = 1;
+		task->dir = dir;
+		task->names[task->name_count++] = xstrdup(root);
+		wk->stats.files++;
+	}
+	push_task(wk, task);
+}
+
+/* crawl_trees:
+ *   Go through all the files under `roots' with `worker_count' threads,
+ *   calling `cb' for each executable, loaded with the hashes in
+ *   `hash_flags' (WRES_HASH_*) computed. Directories that cannot be read
+ *   are reported to `cb' and skipped. The totals of all the workers are
+ *   put in `stats' if it is not NULL.
+ */
+wres_error
+crawl_trees(char *const *roots, int root_count, int worker_count, int hash_flags,
+            CrawlCallback cb, void *ctx, WinCrawlStats *stats)
+{
+	Crawler cr;
+	CrawlWorker *wk;
+	int c;
+
+	if (worker_count < 1 || worker_count > CRAWL_MAX_WORKERS || cb == NULL)
+		return WRES_ERROR_INVALIDPARAM;
+
+	memset(&cr, 0, sizeof(cr));
+	cr.worker_count = worker_count;
+	cr.hash_flags = hash_flags;
+	cr.callback = cb;
+	cr.ctx = ctx;
+	cr.workers = xcalloc(worker_count, sizeof(CrawlWorker));
+	for (c = 0; c < worker_count; c++) {
+		cr.workers[c].index = c;
+		cr.workers[c].crawler = &cr;
+		pthread_mutex_init(&cr.workers[c].deque.lock, NULL);
+	}
+
+	/* the roots are queued before starting, so that nobody quits early */
+	for (c = 0; c < root_count; c++)
+		queue_root(&cr.workers[c % worker_count], roots[c]);
+
+	for (c = 1; c < worker_count; c++)
+		pthread_create(&cr.workers[c].thread, NULL, crawl_worker, &cr.workers[c]);
+	crawl_worker(&cr.workers[0]);
+	for (c = 1; c < worker_count; c++)
+		pthread_join(cr.workers[c].thread, NULL);
+
+	if (stats)
+		memset(stats, 0, sizeof(WinCrawlStats));
+	for (c = 0; c < worker_count; c++) {
+		wk = &cr.workers[c];
+		if (stats) {
+			stats->directories += wk->stats.directories;
+			stats->files += wk->stats.files;
+			stats->candidates += wk->stats.candidates;
+			stats->libraries += wk->stats.libraries;
+			stats->errors += wk->stats.errors;
+			stats->bytes += wk->stats.bytes;
+		}
+		if (wk->scanner)
+			free_header_scanner(wk->scanner);
+		if (wk->fl)
+			free_winlibrary(wk->fl);
+		free(wk->path);
+		free(wk->deque.tasks);
+		pthread_mutex_destroy(&wk->deque.lock);
+	}
+	free(cr.workers);
+	return WRES_ERROR_NONE;
+}
@@ -0,0 +1,44 @@
+/* crawler.h - Parallel scanner of directory trees
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CRAWLER_H
+#define CRAWLER_H
+
+#include "wrestool.h"
+
+
+typedef struct _WinCrawlStats {
+	uint64_t directories;
+	uint64_t files;				/* regular files seen */
+	uint64_t candidates;		/* files with NE or PE headers */
+	uint64_t libraries;			/* candidates loaded successfully */
+	uint64_t errors;
+	uint64_t bytes;				/* size of the candidates */
+} WinCrawlStats;
+
+/* Called from worker `worker' (between 0 and the worker count) for each
+ * candidate, with `fl' loaded, or with `fl' NULL and `err' set if the
+ * candidate or a directory could not be read. `fl' is reused for the
+ * next file when the callback returns. */
+typedef void (*CrawlCallback) (int worker, WinLibrary *fl, const char *path, wres_error err, void *ctx);
+
+
+wres_error crawl_trees(char *const *, int, int, int, CrawlCallback, void *, WinCrawlStats *);
+
+
+#endif
@@ -18,6 +18,7 @@
  */
 
 #include <config.h>
+#include <pthread.h>
 #include "gettext.h"			/* Gnulib */
 #define _(s) gettext(s)
 #define N_(s) gettext_noop(s)
@@ -32,6 +33,7 @@
 #include "restypes.h"
 #include "restable.h"
 #include "fileread.h"
+#include "cancel.h"
 
 
 #define SET_IF_NULL(x,def) ((x) = ((x) == NULL ? (def) : (x)))
@@ -41,6 +43,10 @@
 
 static void *extract_group_icon_cursor_resource(WinLibrary *, WinResource *, char *, size_t *, bool, wres_error *);
 static void *extract_bitmap_resource(WinLibrary *, WinResource *, size_t *, wres_error *);
+static wres_error bitmap_vec(WinLibrary *, WinResource *, WinResourceVec *);
+static wres_error raw_resource_vec(WinLibrary *, WinResource *, WinResourceVec *);
+
+static const uint8_t png_signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
 
 
 /* extract_resource:
@@ -78,12 +84,28 @@ extract_resource (WinLibrary *fi, WinResource *wr, size_t *size,
 			*free_it = false;
 			return get_resource_entry(fi, wr, size, err); //no conversion for versioninfo
 		}
+		if (intval == (int) RT_ANICURSOR || intval == (int) RT_ANIICON) {
+			*free_it = false;
+			return get_resource_entry(fi, wr, size, err); //already a complete .ani file
+		}
+		if (intval == (int) RT_MANIFEST) {
+			*free_it = false;
+			return get_resource_entry(fi, wr, size, err); //XML, as-is
+		}
 	}
 
 	if (err) *err = WRES_ERROR_UNSUPPRESTYPE;
 	return NULL;
 }
 
+/* The alpha fix writes to the memory of the library, which may be shared
+ * by several requests. A thread that looked at an image while another
+ * one was halfway through fixing it would find some alpha, leave it as
+ * it is and hand out the half-fixed pixels, so the check and the fix are
+ * done under a lock. Fixes are rare and take microseconds, so one lock
+ * for all the libraries is enough. */
+static pthread_mutex_t alpha_fix_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static wres_error fix_dib_without_alpha(Win32BitmapInfoHeader *dib, size_t size)
 {
 	/* set alpha channel to 255 iff it's all zeroes
@@ -101,208 +123,604 @@ static wres_error fix_dib_without_alpha(Win32BitmapInfoHeader *dib, size_t size)
 	
 	uint32_t sum = 0;
 	uint32_t *rgb;
+	pthread_mutex_lock(&alpha_fix_lock);
 	for (rgb = rgb_start; rgb < rgb_end; rgb++)
 		sum |= *rgb;
-	if ((sum & 0xFF000000) != 0)
-		return WRES_ERROR_NONE;
-		
-	for (rgb = rgb_start; rgb < rgb_end; rgb++)
-		*rgb |= 0xFF000000;
+	if ((sum & 0xFF000000) == 0) {
+		for (rgb = rgb_start; rgb < rgb_end; rgb++)
+			*rgb |= 0xFF000000;
+	}
+	pthread_mutex_unlock(&alpha_fix_lock);
 	return WRES_ERROR_NONE;
 }
 
-/* extract_group_icon_resource:
- *   Create a complete RT_GROUP_ICON resource, that can be written to
- *   an `.ico' file without modifications. Returns an allocated
- *   memory block that should be freed with free() once used.
+/* group_icon_cursor_vec:
+ *   Build a RT_GROUP_ICON or RT_GROUP_CURSOR resource in the form of
+ *   an `.ico' or `.cur' file, without copying the images. The directory
+ *   of the file is generated in a block owned by `vec', while the
+ *   images are referenced directly from the library memory.
  *
- *   `root' is the offset in file that specifies the resource.
- *   `base' is the offset that string pointers are calculated from.
- *   `ressize' should point to an integer variable where the size of
- *   the returned memory block will be placed.
  *   `is_icon' indicates whether resource to be extracted is icon
  *   or cursor group.
  */
-static void *
-extract_group_icon_cursor_resource(WinLibrary *fi, WinResource *wr, char *lang,
-                                   size_t *ressize, bool is_icon, wres_error *err)
+static wres_error
+group_icon_cursor_vec(WinLibrary *fi, WinResource *wr, char *lang,
+                      bool is_icon, WinResourceVec *vec)
 {
 	Win32CursorIconDir *icondir;
 	Win32CursorIconFileDir *fileicondir;
-	char *memory;
-	int c, offset, skipped;
-	size_t size;
+	struct iovec *iov;
+	wres_error err;
+	int c, count;
+	size_t size, offset, header_size;
 
 	/* get resource data and size */
-	icondir = (Win32CursorIconDir *) get_resource_entry(fi, wr, &size, err);
+	icondir = (Win32CursorIconDir *) get_resource_entry(fi, wr, &size, &err);
 	if (icondir == NULL)
-		return NULL;
+		return err;
+	IF_BAD_POINTER(fi, icondir->count)
+		return WRES_ERROR_PREMATUREEND;
+
+	/* the iovec array and the directory share the same allocation;
+	 * the directory is sized for the worst case (no skipped images) */
+	header_size = sizeof(Win32CursorIconFileDir) + icondir->count * sizeof(Win32CursorIconFileDirEntry);
+	iov = xmalloc(sizeof(struct iovec) * (icondir->count + 1) + header_size);
+	fileicondir = (Win32CursorIconFileDir *) (iov + icondir->count + 1);
 
-	/* calculate total size of output file */
-	RET_NULL_AND_SET_ERR_IF_BAD_POINTER(fi, err, icondir->count);
-	skipped = 0;
+	/* transfer each cursor/icon: Win32CursorIconDirEntry and data */
+	count = 0;
 	for (c = 0 ; c < icondir->count ; c++) {
 		int level;
-		size_t iconsize;
 		char name[14];
 		WinResource *fwr;
+		char *data;
+		Win32CursorIconFileDirEntry *entry;
+
+		if (wres_cancelled()) {
+			free(iov);
+			return WRES_ERROR_CANCELLED;
+		}
+		IF_BAD_POINTER(fi, icondir->entries[c]) {
+			free(iov);
+			return WRES_ERROR_PREMATUREEND;
+		}
 
-		RET_NULL_AND_SET_ERR_IF_BAD_POINTER(fi, err, icondir->entries[c]);
-		/*printf("%d. bytes_in_res=%d width=%d height=%d planes=%d bit_count=%d\n", c,
-			icondir->entries[c].bytes_in_res,
-			(is_icon ? icondir->entries[c].res_info.icon.width : icondir->entries[c].res_info.cursor.width),
-			(is_icon ? icondir->entries[c].res_info.icon.height : icondir->entries[c].res_info.cursor.height),
-			icondir->entries[c].plane_count,
-			icondir->entries[c].bit_count);*/
-      
 		/* find the corresponding icon resource */
 		snprintf(name, sizeof(name)/sizeof(char), "-%d", icondir->entries[c].res_id);
-		fwr = find_resource(fi, (is_icon ? "-3" : "-1"), name, "", &level, err);
+		fwr = find_resource(fi, (is_icon ? "-3" : "-1"), name, "", &level, &err);
 		//The empty string tells find_resource to ignore the value of the language id. Some EXEs have GROUP_ICONS
 		//with a different language ID than the ICONs themselves.
-		if (fwr == NULL)
-			return NULL;
-
-		if (get_resource_entry(fi, fwr, &iconsize, err) != NULL) {
-			if (iconsize == 0) {
-				dbg_log(_("%s: icon resource `%s' is empty, skipping"), fi->name, name);
-				skipped++;
-				continue;
-			}
-			if (iconsize != icondir->entries[c].bytes_in_res) {
-				dbg_log(_("%s: mismatch of size in icon resource `%s' and group (%d vs %d)"), fi->name, name, iconsize, icondir->entries[c].bytes_in_res);
-			}
-			size += iconsize < icondir->entries[c].bytes_in_res ? icondir->entries[c].bytes_in_res : iconsize;
-
-			/* cursor resources have two additional WORDs that contain
-			 * hotspot info */
-			if (!is_icon)
-				size -= sizeof(uint16_t)*2;
-		} else {
-			free(fwr);
-			return NULL;
+		if (fwr == NULL) {
+			free(iov);
+			return err;
 		}
-		free(fwr);
-	}
-  
-	offset = sizeof(Win32CursorIconFileDir) + (icondir->count-skipped) * sizeof(Win32CursorIconFileDirEntry);
-	size += offset;
-	*ressize = size;
-
-	/* allocate that much memory */
-	memory = xmalloc(size);
-	fileicondir = (Win32CursorIconFileDir *) memory;
-
-	/* transfer Win32CursorIconDir structure members */
-	fileicondir->reserved = icondir->reserved;
-	fileicondir->type = icondir->type;
-	fileicondir->count = icondir->count - skipped;
-
-	/* transfer each cursor/icon: Win32CursorIconDirEntry and data */
-	skipped = 0;
-	for (c = 0 ; c < icondir->count ; c++) {
-		int level;
-		char name[14];
-		WinResource *fwr;
-		char *data;
-  
-		/* find the corresponding icon resource */
-		snprintf(name, sizeof(name)/sizeof(char), "-%d", icondir->entries[c].res_id);
-		fwr = find_resource(fi, (is_icon ? "-3" : "-1"), name, "", &level, err);
-		if (fwr == NULL)
-			return NULL;
 
 		/* get data and size of that resource */
-		data = get_resource_entry(fi, fwr, &size, err);
-		if (data == NULL)
-			return NULL;
+		data = get_resource_entry(fi, fwr, &size, &err);
+		free(fwr);
+		if (data == NULL) {
+			free(iov);
+			return err;
+		}
 
 		if (size == 0) {
-		    skipped++;
-		    continue;
+			dbg_log(_("%s: icon resource `%s' is empty, skipping"), fi->name, name);
+			continue;
+		}
+		if (size != icondir->entries[c].bytes_in_res) {
+			dbg_log(_("%s: mismatch of size in icon resource `%s' and group (%d vs %d)"), fi->name, name, size, icondir->entries[c].bytes_in_res);
 		}
 
 		/* copy ICONDIRENTRY (not including last dwImageOffset) */
-		memcpy(&fileicondir->entries[c-skipped], &icondir->entries[c],
+		entry = &fileicondir->entries[count];
+		memcpy(entry, &icondir->entries[c],
 			sizeof(Win32CursorIconFileDirEntry)-sizeof(uint32_t));
 
+		/* Better to trust the resource itself. Fixes crash with ISCC.exe */
+		if (size > icondir->entries[c].bytes_in_res)
+			size = icondir->entries[c].bytes_in_res;
+
+		/* special treatment for cursors */
+		if (!is_icon) {
+			entry->color_count = 0;
+			entry->reserved = 0;
+			/* cursor resources have two additional WORDs that contain
+			 * hotspot info, which go in the directory entry instead */
+			if (size >= sizeof(uint16_t)*2) {
+				entry->hotspot_x = ((uint16_t *) data)[0];
+				entry->hotspot_y = ((uint16_t *) data)[1];
+				data += sizeof(uint16_t)*2;
+				size -= sizeof(uint16_t)*2;
+			} else {
+				size = 0;
+			}
+		}
+
 		if (size >= sizeof(Win32BitmapInfoHeader)) {
-			const uint8_t pngh[8] = {137, 80, 78, 71, 13, 10, 26, 10};
-			if (memcmp(data, pngh, 8) != 0) {
+			if (memcmp(data, png_signature, 8) != 0) {
 				/* don't trust the size specified in ICONDIRENTRY because there are
 				 * some people who manage to get it wrong, believe it or not */
 				Win32BitmapInfoHeader *bim = (Win32BitmapInfoHeader *)data;
-				fileicondir->entries[c-skipped].width = bim->width;
-				fileicondir->entries[c-skipped].height = bim->height / 2;
+				entry->width = bim->width;
+				entry->height = bim->height / 2;
 				/* fix icons without transparency */
-				wres_error tmp = fix_dib_without_alpha(bim, size);
-				if (tmp) {
-					if (err) *err = tmp;
-					free(fwr);
-					free(memory);
-					return NULL;
+				err = fix_dib_without_alpha(bim, size);
+				if (err) {
+					free(iov);
+					return err;
 				}
-			} else {
+			} else if (is_icon) {
 				/* do not trust ICONDIRENTRY for PNG icons
 				 * fixes cases in which big PNG icons were not prioritized
 				 * over small DIB icons */
-				fileicondir->entries[c-skipped].color_count = 0;
-				fileicondir->entries[c-skipped].hotspot_y = 1;
-				fileicondir->entries[c-skipped].hotspot_y = 32;
+				entry->color_count = 0;
+				entry->hotspot_x = 1;
+				entry->hotspot_y = 32;
 			}
 		}
-		
-		/* special treatment for cursors */
-		if (!is_icon) {
-			fileicondir->entries[c-skipped].color_count = 0;
-			fileicondir->entries[c-skipped].reserved = 0;
-		}
 
-		/* set image offset and increase it */
-		fileicondir->entries[c-skipped].dib_offset = offset;
-
-		/* transfer resource into file memory */
-		if (size > icondir->entries[c-skipped].bytes_in_res)
-			size = icondir->entries[c-skipped].bytes_in_res;
-		if (is_icon) {
-			/* Better to trust the resource itself. Fixes crash with ISCC.exe */
-			memcpy(&memory[offset], data, size);
-		} else if (size >= sizeof(uint16_t)*2) {
-			fileicondir->entries[c-skipped].hotspot_x = ((uint16_t *) data)[0];
-			fileicondir->entries[c-skipped].hotspot_y = ((uint16_t *) data)[1];
-			memcpy(&memory[offset], data+sizeof(uint16_t)*2,
-				   size-sizeof(uint16_t)*2);
-			offset -= sizeof(uint16_t)*2;
-		}
+		entry->dib_size = (uint32_t) size;
+		iov[count + 1].iov_base = data;
+		iov[count + 1].iov_len = size;
+		count++;
+	}
 
-		/* increase the offset pointer */
-		offset += icondir->entries[c].bytes_in_res;
-		free(fwr);
+	/* transfer Win32CursorIconDir structure members */
+	fileicondir->reserved = icondir->reserved;
+	fileicondir->type = icondir->type;
+	fileicondir->count = count;
+
+	/* now that the size of the directory is known, set the image offsets */
+	header_size = sizeof(Win32CursorIconFileDir) + count * sizeof(Win32CursorIconFileDirEntry);
+	offset = header_size;
+	for (c = 0 ; c < count ; c++) {
+		fileicondir->entries[c].dib_offset = (uint32_t) offset;
+		offset += iov[c + 1].iov_len;
 	}
 
-	return (void *) memory;
+	iov[0].iov_base = fileicondir;
+	iov[0].iov_len = header_size;
+	vec->iov = iov;
+	vec->iovcnt = count + 1;
+	vec->total_size = offset;
+	return WRES_ERROR_NONE;
 }
 
-/* extract_bitmap_resource:
- *   Create a complete RT_BITMAP resource, that can be written to
- *   an `.bmp' file without modifications. Returns an allocated
+/* extract_group_icon_cursor_resource:
+ *   Create a complete RT_GROUP_ICON resource, that can be written to
+ *   an `.ico' file without modifications. Returns an allocated
  *   memory block that should be freed with free() once used.
  *
  *   `ressize' should point to an integer variable where the size of
  *   the returned memory block will be placed.
+ *   `is_icon' indicates whether resource to be extracted is icon
+ *   or cursor group.
  */
 static void *
-extract_bitmap_resource(WinLibrary *fi, WinResource *wr, size_t *ressize, wres_error *err)
+extract_group_icon_cursor_resource(WinLibrary *fi, WinResource *wr, char *lang,
+                                   size_t *ressize, bool is_icon, wres_error *err)
+{
+	WinResourceVec vec;
+	wres_error tmp;
+	void *memory;
+
+	tmp = group_icon_cursor_vec(fi, wr, lang, is_icon, &vec);
+	if (tmp) {
+		if (err) *err = tmp;
+		return NULL;
+	}
+
+	memory = flatten_resource_vec(&vec, ressize);
+	free_resource_vec(&vec);
+	return memory;
+}
+
+/* extract_resource_vec:
+ *   Like extract_resource, but produces the resource as a list of
+ *   memory blocks that can be written out with writev(), instead of
+ *   as a single contiguous block. Only the headers generated during
+ *   the extraction are owned by `vec'; everything else refers to the
+ *   library memory.
+ *   `vec' must be freed with free_resource_vec().
+ */
+wres_error
+extract_resource_vec(WinLibrary *fi, WinResource *wr, char *type, char *lang, WinResourceVec *vec)
+{
+	int32_t intval;
+	char *str;
+
+	str = type;
+	if (str != NULL && parse_int32(STRIP_RES_ID_FORMAT(str), &intval)) {
+		if (intval == (int) RT_BITMAP)
+			return bitmap_vec(fi, wr, vec);
+		if (intval == (int) RT_GROUP_ICON)
+			return group_icon_cursor_vec(fi, wr, lang, true, vec);
+		if (intval == (int) RT_GROUP_CURSOR)
+			return group_icon_cursor_vec(fi, wr, lang, false, vec);
+		if (intval == (int) RT_ANICURSOR || intval == (int) RT_ANIICON
+		    || intval == (int) RT_MANIFEST)
+			return raw_resource_vec(fi, wr, vec);
+	}
+
+	return WRES_ERROR_UNSUPPRESTYPE;
+}
+
+/* raw_resource_vec:
+ *   Wrap a resource that needs no conversion in a single block vector.
+ */
+static wres_error
+raw_resource_vec(WinLibrary *fi, WinResource *wr, WinResourceVec *vec)
+{
+	wres_error err;
+	size_t size;
+	void *data;
+
+	data = get_resource_entry(fi, wr, &size, &err);
+	if (data == NULL)
+		return err;
+
+	vec->iov = xmalloc(sizeof(struct iovec));
+	vec->iov[0].iov_base = data;
+	vec->iov[0].iov_len = size;
+	vec->iovcnt = 1;
+	vec->total_size = size;
+	return WRES_ERROR_NONE;
+}
+
+/* flatten_resource_vec:
+ *   Copy a resource vector into a single allocated memory block, which
+ *   should be freed with free() once used.
+ */
+void *
+flatten_resource_vec(const WinResourceVec *vec, size_t *size)
+{
+	char *memory, *p;
+	int c;
+
+	p = memory = xmalloc(vec->total_size);
+	for (c = 0 ; c < vec->iovcnt ; c++) {
+		memcpy(p, vec->iov[c].iov_base, vec->iov[c].iov_len);
+		p += vec->iov[c].iov_len;
+	}
+
+	*size = vec->total_size;
+	return memory;
+}
+
+#define WRITE_VEC_BATCH (64)
+
+/* write_resource_vec:
+ *   Write a resource vector to a file descriptor (file, pipe or socket)
+ *   with writev(), handling short writes. Returns the number of bytes
+ *   written, or -1 with errno set on failure.
+ */
+ssize_t
+write_resource_vec(int fd, const WinResourceVec *vec)
+{
+	struct iovec cur[WRITE_VEC_BATCH];
+	ssize_t total = 0, w;
+	size_t done = 0;	/* bytes of vec->iov[c] already written */
+	int c = 0, n;
+
+	while (c < vec->iovcnt) {
+		for (n = 0 ; n < WRITE_VEC_BATCH && c + n < vec->iovcnt ; n++)
+			cur[n] = vec->iov[c + n];
+		cur[0].iov_base = (char *) cur[0].iov_base + done;
+		cur[0].iov_len -= done;
+
+		w = writev(fd, cur, n);
+		if (w < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		total += w;
+
+		/* skip the blocks that were written completely */
+		done += w;
+		while (c < vec->iovcnt && done >= vec->iov[c].iov_len) {
+			done -= vec->iov[c].iov_len;
+			c++;
+		}
+	}
+
+	return total;
+}
+
+void
+free_resource_vec(WinResourceVec *vec)
+{
+	free(vec->iov);
+	vec->iov = NULL;
+	vec->iovcnt = 0;
+	vec->total_size = 0;
+}
+
+static uint32_t
+read_be32(const uint8_t *p)
+{
+	return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+/* describe_icon_image:
+ *   Fill in a WinIconImage from the raw data of a RT_ICON resource
+ *   (or of an image inside an `.ico' file). The size of DIB images is
+ *   read from the BITMAPINFOHEADER and the size of PNG images from the
+ *   IHDR chunk, because ICONDIRENTRY is not trustworthy.
+ *   Returns false if the data is neither a DIB nor a PNG, or if it is a
+ *   PNG whose size is out of range.
+ */
+static bool
+describe_icon_image(const void *data, size_t size, WinIconImage *img)
+{
+	const uint8_t *bytes = data;
+	uint32_t width, height;
+
+	img->data = data;
+	img->size = size;
+	img->hotspot_x = 0;
+	img->hotspot_y = 0;
+	if (size >= 24 && memcmp(bytes, png_signature, 8) == 0) {
+		/* IHDR is always the first chunk; width and height are big endian,
+		 * and PNG does not allow them above 2^31 - 1 */
+		width = read_be32(bytes + 16);
+		height = read_be32(bytes + 20);
+		if (width > INT32_MAX || height > INT32_MAX)
+			return false;
+		img->is_png = true;
+		img->width = (int) width;
+		img->height = (int) height;
+		img->bit_count = size >= 26 && bytes[25] == 6 ? 32 : 24;
+		return true;
+	}
+	if (size >= sizeof(Win32BitmapInfoHeader)) {
+		const Win32BitmapInfoHeader *bim = data;
+		img->is_png = false;
+		img->width = bim->width;
+		img->height = bim->height / 2;
+		img->bit_count = bim->bit_count;
+		return true;
+	}
+	return false;
+}
+
+/* icon_image_is_better:
+ *   The best image is the biggest one; ties are broken by color depth,
+ *   and then PNG images are preferred because they need no fixups.
+ */
+static bool
+icon_image_is_better(const WinIconImage *a, const WinIconImage *b)
+{
+	int64_t area_a = (int64_t)a->width * a->height;
+	int64_t area_b = (int64_t)b->width * b->height;
+
+	if (area_a != area_b)
+		return area_a > area_b;
+	if (a->bit_count != b->bit_count)
+		return a->bit_count > b->bit_count;
+	return a->is_png && !b->is_png;
+}
+
+/* icon_image_fits_better:
+ *   To be shown at `size' pixels, the best image is the smallest one
+ *   that is at least that big, or the biggest one if none is. Any image
+ *   fits if `size' is zero.
+ */
+static bool
+icon_image_fits_better(const WinIconImage *a, const WinIconImage *b, int size)
+{
+	bool a_fits = a->width >= size && a->height >= size;
+	bool b_fits = b->width >= size && b->height >= size;
+	int64_t area_a = (int64_t)a->width * a->height;
+	int64_t area_b = (int64_t)b->width * b->height;
+
+	if (a_fits != b_fits)
+		return a_fits;
+	if (size > 0 && a_fits && area_a != area_b)
+		return area_a < area_b;
+	return icon_image_is_better(a, b);
+}
+
+/* find_best_group_icon_image:
+ *   Find the best image referenced by a RT_GROUP_ICON resource, without
+ *   copying anything. `img->data' points into the memory of the library
+ *   and stays valid as long as the library is loaded.
+ */
+wres_error
+find_best_group_icon_image(WinLibrary *fi, WinResource *wr, WinIconImage *img)
+{
+	return find_group_icon_image_for_size(fi, wr, 0, img);
+}
+
+/* find_group_icon_image_for_size:
+ *   Like find_best_group_icon_image(), but for showing the icon at
+ *   `size' pixels: the smallest image that needs no enlarging is found.
+ */
+wres_error
+find_group_icon_image_for_size(WinLibrary *fi, WinResource *wr, int size_px, WinIconImage *img)
+{
+	Win32CursorIconDir *icondir;
+	WinIconImage cur;
+	wres_error err;
+	size_t size;
+	bool found = false;
+	int c;
+
+	icondir = (Win32CursorIconDir *) get_resource_entry(fi, wr, &size, &err);
+	if (icondir == NULL)
+		return err;
+	IF_BAD_POINTER(fi, icondir->count)
+		return WRES_ERROR_PREMATUREEND;
+
+	for (c = 0 ; c < icondir->count ; c++) {
+		int level;
+		char name[14];
+		WinResource *fwr;
+		void *data;
+
+		if (wres_cancelled())
+			return WRES_ERROR_CANCELLED;
+		IF_BAD_POINTER(fi, icondir->entries[c])
+			return WRES_ERROR_PREMATUREEND;
+
+		snprintf(name, sizeof(name)/sizeof(char), "-%d", icondir->entries[c].res_id);
+		fwr = find_resource(fi, "-3", name, "", &level, &err);
+		if (fwr == NULL)
+			return err;
+		data = get_resource_entry(fi, fwr, &size, &err);
+		free(fwr);
+		if (data == NULL)
+			return err;
+
+		if (!describe_icon_image(data, size, &cur))
+			continue;
+		if (!found || icon_image_fits_better(&cur, img, size_px)) {
+			*img = cur;
+			found = true;
+		}
+	}
+
+	return found ? WRES_ERROR_NONE : WRES_ERROR_RESNOTFOUND;
+}
+
+/* find_best_icon_file_image:
+ *   Find the best image in an `.ico' or `.cur' file in memory, such as
+ *   a frame of an animated cursor. `img->data' points inside `data'.
+ */
+wres_error
+find_best_icon_file_image(const void *data, size_t size, WinIconImage *img)
+{
+	const Win32CursorIconFileDir *filedir = data;
+	const Win32CursorIconFileDirEntry *entry;
+	WinIconImage cur;
+	bool found = false;
+	int c;
+
+	if (size < sizeof(Win32CursorIconFileDir))
+		return WRES_ERROR_PREMATUREEND;
+	if (size < sizeof(Win32CursorIconFileDir) + filedir->count * sizeof(Win32CursorIconFileDirEntry))
+		return WRES_ERROR_PREMATUREEND;
+
+	for (c = 0 ; c < filedir->count ; c++) {
+		entry = &filedir->entries[c];
+		if (entry->dib_offset > size || entry->dib_size > size - entry->dib_offset)
+			return WRES_ERROR_PREMATUREEND;
+
+		if (!describe_icon_image((const uint8_t *)data + entry->dib_offset, entry->dib_size, &cur))
+			continue;
+		if (filedir->type == 2) {
+			cur.hotspot_x = entry->hotspot_x;
+			cur.hotspot_y = entry->hotspot_y;
+		}
+		if (!found || icon_image_is_better(&cur, img)) {
+			*img = cur;
+			found = true;
+		}
+	}
+
+	return found ? WRES_ERROR_NONE : WRES_ERROR_RESNOTFOUND;
+}
+
+/* icon_image_vec:
+ *   Make a single image found by one of the find_best_* functions
+ *   decodable on its own: PNG images are returned as they are, while
+ *   DIB images get an `.ico' or `.cur' directory in front of them
+ *   and have their alpha channel fixed like in extract_resource.
+ */
+wres_error
+icon_image_vec(const WinIconImage *img, bool is_icon, WinResourceVec *vec)
+{
+	Win32CursorIconFileDir *filedir;
+	Win32CursorIconFileDirEntry *entry;
+	struct iovec *iov;
+	size_t header_size;
+	wres_error err;
+
+	if (img->is_png) {
+		vec->iov = xmalloc(sizeof(struct iovec));
+		vec->iov[0].iov_base = (void *) img->data;
+		vec->iov[0].iov_len = img->size;
+		vec->iovcnt = 1;
+		vec->total_size = img->size;
+		return WRES_ERROR_NONE;
+	}
+
+	err = fix_dib_without_alpha((Win32BitmapInfoHeader *) img->data, img->size);
+	if (err)
+		return err;
+
+	header_size = sizeof(Win32CursorIconFileDir) + sizeof(Win32CursorIconFileDirEntry);
+	iov = xmalloc(sizeof(struct iovec) * 2 + header_size);
+	filedir = (Win32CursorIconFileDir *) (iov + 2);
+	entry = &filedir->entries[0];
+
+	filedir->reserved = 0;
+	filedir->type = is_icon ? 1 : 2;
+	filedir->count = 1;
+	entry->width = img->width;
+	entry->height = img->height;
+	entry->color_count = 0;
+	entry->reserved = 0;
+	entry->hotspot_x = is_icon ? 1 : img->hotspot_x;
+	entry->hotspot_y = is_icon ? img->bit_count : img->hotspot_y;
+	entry->dib_size = (uint32_t) img->size;
+	entry->dib_offset = (uint32_t) header_size;
+
+	iov[0].iov_base = filedir;
+	iov[0].iov_len = header_size;
+	iov[1].iov_base = (void *) img->data;
+	iov[1].iov_len = img->size;
+	vec->iov = iov;
+	vec->iovcnt = 2;
+	vec->total_size = header_size + img->size;
+	return WRES_ERROR_NONE;
+}
+
+/* extract_group_icon_png:
+ *   If the best image of a RT_GROUP_ICON resource is PNG-compressed,
+ *   return a pointer to it. The PNG data is returned as-is, so the
+ *   pointer refers to the memory of the library and must not be freed.
+ *   Returns NULL with WRES_ERROR_RESNOTFOUND when the best image is a DIB.
+ */
+const void *
+extract_group_icon_png(WinLibrary *fi, WinResource *wr, size_t *size, wres_error *err)
+{
+	WinIconImage img;
+	wres_error tmp;
+
+	tmp = find_best_group_icon_image(fi, wr, &img);
+	if (tmp == WRES_ERROR_NONE && !img.is_png)
+		tmp = WRES_ERROR_RESNOTFOUND;
+	if (tmp) {
+		if (err) *err = tmp;
+		return NULL;
+	}
+
+	*size = img.size;
+	return img.data;
+}
+
+/* bitmap_vec:
+ *   Build a RT_BITMAP resource in the form of a `.bmp' file, without
+ *   copying the bitmap. Only the file header is generated in a block
+ *   owned by `vec'; the rest refers to the library memory.
+ */
+static wres_error
+bitmap_vec(WinLibrary *fi, WinResource *wr, WinResourceVec *vec)
 {
     Win32BitmapInfoHeader info;
-    uint8_t *result;
+    struct iovec *iov;
+    uint8_t *header;
     uint8_t *resentry;
     uint32_t offbits;
-    size_t size;
+    size_t size, filesize;
+    wres_error err;
 
-    resentry=(uint8_t *)(get_resource_entry(fi, wr, &size, err));
+    resentry=(uint8_t *)(get_resource_entry(fi, wr, &size, &err));
     if (!resentry)
-		return NULL;
+		return err;
+    if (size < sizeof(info))
+		return WRES_ERROR_INVALIDDIB;
 
     /* Bitmap file consists of:
      * 1) File header (14 bytes)
@@ -348,27 +766,60 @@ extract_bitmap_resource(WinLibrary *fi, WinResource *wr, size_t *ressize, wres_e
 
     /* The file will consist of the resource data and
      * 14 bytes long file header */
-    *ressize = 14+size;
-    result = (uint8_t *)xmalloc(*ressize);
+    filesize = 14+size;
+    iov = xmalloc(sizeof(struct iovec) * 2 + 14);
+    header = (uint8_t *)(iov + 2);
 
     /* Filling the file header with data */
-    result[0] = 'B';   /* Magic char #1 */
-    result[1] = 'M';   /* Magic char #2 */
-    result[2] = (*ressize & 0x000000ff);      /* file size, little-endian */
-    result[3] = (*ressize & 0x0000ff00)>>8;
-    result[4] = (*ressize & 0x00ff0000)>>16;
-    result[5] = (*ressize & 0xff000000)>>24;
-    result[6] = 0; /* Reserved */
-    result[7] = 0;
-    result[8] = 0;
-    result[9] = 0;
-    result[10] = (offbits & 0x000000ff);  /* offset to pixels, little-endian */
-    result[11] = (offbits & 0x0000ff00)>>8;
-    result[12] = (offbits & 0x00ff0000)>>16;
-    result[13] = (offbits & 0xff000000)>>24;
+    header[0] = 'B';   /* Magic char #1 */
+    header[1] = 'M';   /* Magic char #2 */
+    header[2] = (filesize & 0x000000ff);      /* file size, little-endian */
+    header[3] = (filesize & 0x0000ff00)>>8;
+    header[4] = (filesize & 0x00ff0000)>>16;
+    header[5] = (filesize & 0xff000000)>>24;
+    header[6] = 0; /* Reserved */
+    header[7] = 0;
+    header[8] = 0;
+    header[9] = 0;
+    header[10] = (offbits & 0x000000ff);  /* offset to pixels, little-endian */
+    header[11] = (offbits & 0x0000ff00)>>8;
+    header[12] = (offbits & 0x00ff0000)>>16;
+    header[13] = (offbits & 0xff000000)>>24;
 
     /* The rest of the file is the resource entry */
-    memcpy(result+14,resentry,size);
+    iov[0].iov_base = header;
+    iov[0].iov_len = 14;
+    iov[1].iov_base = resentry;
+    iov[1].iov_len = size;
+
+    vec->iov = iov;
+    vec->iovcnt = 2;
+    vec->total_size = filesize;
+    return WRES_ERROR_NONE;
+}
+
+/* extract_bitmap_resource:
+ *   Create a complete RT_BITMAP resource, that can be written to
+ *   an `.bmp' file without modifications. Returns an allocated
+ *   memory block that should be freed with free() once used.
+ *
+ *   `ressize' should point to an integer variable where the size of
+ *   the returned memory block will be placed.
+ */
+static void *
+extract_bitmap_resource(WinLibrary *fi, WinResource *wr, size_t *ressize, wres_error *err)
+{
+    WinResourceVec vec;
+    wres_error tmp;
+    void *result;
+
+    tmp = bitmap_vec(fi, wr, &vec);
+    if (tmp) {
+		if (err) *err = tmp;
+		return NULL;
+    }
 
+    result = flatten_resource_vec(&vec, ressize);
+    free_resource_vec(&vec);
     return result;
 }
@@ -20,10 +20,43 @@
 #ifndef EXTRACT_H
 #define EXTRACT_H
 
+#include <sys/uio.h>
 #include "wrestool.h"
 
 
+/* One image of an icon or cursor group, as found in the library memory */
+typedef struct _WinIconImage {
+	const void *data;
+	size_t size;
+	int width;
+	int height;
+	int bit_count;
+	int hotspot_x;		/* cursors only */
+	int hotspot_y;
+	bool is_png;
+} WinIconImage;
+
+/* A resource split in blocks. Blocks generated by the extraction are
+ * stored in the same allocation as `iov'; all the other blocks point
+ * to the memory of the library. */
+typedef struct _WinResourceVec {
+	struct iovec *iov;
+	int iovcnt;
+	size_t total_size;
+} WinResourceVec;
+
+
 void *extract_resource(WinLibrary *, WinResource *, size_t *, bool *, char *, char *, bool, wres_error *);
+wres_error find_best_group_icon_image(WinLibrary *, WinResource *, WinIconImage *);
+wres_error find_group_icon_image_for_size(WinLibrary *, WinResource *, int, WinIconImage *);
+const void *extract_group_icon_png(WinLibrary *, WinResource *, size_t *, wres_error *);
+wres_error find_best_icon_file_image(const void *, size_t, WinIconImage *);
+wres_error icon_image_vec(const WinIconImage *, bool, WinResourceVec *);
+
+wres_error extract_resource_vec(WinLibrary *, WinResource *, char *, char *, WinResourceVec *);
+void *flatten_resource_vec(const WinResourceVec *, size_t *);
+ssize_t write_resource_vec(int, const WinResourceVec *);
+void free_resource_vec(WinResourceVec *);
 
 
 #endif /* extract_h */
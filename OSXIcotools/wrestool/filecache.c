@@ -0,0 +1,471 @@
+/* filecache.c - Persistent cache of data extracted from files
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The cache is a single file, mapped in memory by all the processes
+ * that use it. A header is followed by an open addressing hash table of
+ * slots, one per entry, and by the data area, where entries are
+ * appended. When the data area or the table fill up, the least recently
+ * used entries are dropped and the others are moved to the start of the
+ * data area, so there is no free list to manage.
+ *
+ * Readers take a shared flock(), writers an exclusive one. The only
+ * thing readers change is the time of last use of an entry, which is
+ * done with atomic operations. A writer that dies half way leaves the
+ * `busy' flag set, and the next writer empties the cache; entries are
+ * also checked against their XXH64 before being returned.
+ *
+ * The size of the file is fixed when it is created. A cache opened with
+ * a different size, or that is not valid, is unlinked and created anew:
+ * processes that still have the old one open keep using it safely. */
+
+#include <config.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "xalloc.h"			/* Gnulib */
+#include "common/xxhash.h"
+#include "filecache.h"
+
+
+#define FILE_CACHE_MAGIC	0x31435746	/* `WFC1' */
+#define FILE_CACHE_VERSION	1
+
+#define SLOT_EMPTY			0
+#define SLOT_USED			1
+#define SLOT_DELETED		2
+
+#define DATA_ALIGN(x)		(((x) + 7) & ~(uint64_t) 7)
+
+typedef struct _FileCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t file_size;
+	uint32_t slot_count;		/* a power of two */
+	uint32_t used_slots;
+	uint32_t deleted_slots;
+	uint32_t busy;				/* a writer is changing the file */
+	uint64_t data_offset;
+	uint64_t data_end;
+	uint64_t data_used;
+	uint64_t clock;				/* for the time of last use */
+} FileCacheHeader;
+
+typedef struct _FileCacheSlot {
+	WinFileKey key;
+	uint32_t kind;
+	uint32_t state;
+	uint64_t hash;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t checksum;
+	uint64_t last_use;
+} FileCacheSlot;
+
+struct _WinFileCache {
+	int fd;
+	uint8_t *map;
+	size_t map_size;
+};
+
+#define CACHE_HEADER(fc)	((FileCacheHeader *) (fc)->map)
+#define CACHE_SLOTS(fc)		((FileCacheSlot *) ((fc)->map + sizeof(FileCacheHeader)))
+
+
+/* file_cache_key_from_stat:
+ *   Make the key of a file out of what stat() says about it.
+ */
+void
+file_cache_key_from_stat(const struct stat *st, WinFileKey *key)
+{
+	memset(key, 0, sizeof(WinFileKey));
+	key->dev = st->st_dev;
+	key->ino = st->st_ino;
+	key->size = st->st_size;
+#ifdef __APPLE__
+	key->mtime_sec = st->st_mtimespec.tv_sec;
+	key->mtime_nsec = st->st_mtimespec.tv_nsec;
+	key->ctime_sec = st->st_ctimespec.tv_sec;
+	key->ctime_nsec = st->st_ctimespec.tv_nsec;
+#else
+	key->mtime_sec = st->st_mtim.tv_sec;
+	key->mtime_nsec = st->st_mtim.tv_nsec;
+	key->ctime_sec = st->st_ctim.tv_sec;
+	key->ctime_nsec = st->st_ctim.tv_nsec;
+#endif
+}
+
+wres_error
+file_cache_key_for_path(const char *path, WinFileKey *key)
+{
+	struct stat st;
+
+	if (stat(path, &st) != 0)
+		return -errno;
+	file_cache_key_from_stat(&st, key);
+	return WRES_ERROR_NONE;
+}
+
+static void
+lock_cache(WinFileCache *fc, int op)
+{
+	while (flock(fc->fd, op) != 0 && errno == EINTR)
+		;
+}
+
+static uint32_t
+slot_count_for_size(uint64_t size)
+{
+	uint32_t count = 64;
+
+	/* about one slot every 8 KiB of data */
+	while (count < size / 8192)
+		count *= 2;
+	return count;
+}
+
+static uint64_t
+data_offset_for_slots(uint32_t slot_count)
+{
+	uint64_t end = sizeof(FileCacheHeader) + (uint64_t) slot_count * sizeof(FileCacheSlot);
+	return (end + 4095) & ~(uint64_t) 4095;
+}
+
+static bool
+header_is_valid(const FileCacheHeader *hdr, uint64_t file_size)
+{
+	return hdr->magic == FILE_CACHE_MAGIC && hdr->version == FILE_CACHE_VERSION
+	    && hdr->file_size == file_size
+	    && hdr->slot_count == slot_count_for_size(file_size)
+	    && hdr->data_offset == data_offset_for_slots(hdr->slot_count)
+	    && hdr->data_offset < file_size
+	    && hdr->data_end >= hdr->data_offset && hdr->data_end <= file_size;
+}
+
+/* reset_cache:
+ *   Drop all the entries. Called with the exclusive lock.
+ */
+static void
+reset_cache(WinFileCache *fc)
+{
+	FileCacheHeader *hdr = CACHE_HEADER(fc);
+
+	memset(CACHE_SLOTS(fc), 0, (size_t) hdr->slot_count * sizeof(FileCacheSlot));
+	hdr->used_slots = 0;
+	hdr->deleted_slots = 0;
+	hdr->data_end = hdr->data_offset;
+	hdr->data_used = 0;
+	hdr->busy = 0;
+}
+
+static uint64_t
+hash_key(const WinFileKey *key, uint32_t kind)
+{
+	return xxh64(key, sizeof(WinFileKey), kind);
+}
+
+/* find_slot:
+ *   Returns the index of the slot of an entry, or -1 if there is none,
+ *   in which case `free_slot' is set to where it can be inserted.
+ */
+static int64_t
+find_slot(WinFileCache *fc, const WinFileKey *key, uint32_t kind, uint64_t hash, int64_t *free_slot)
+{
+	FileCacheHeader *hdr = CACHE_HEADER(fc);
+	FileCacheSlot *slots = CACHE_SLOTS(fc);
+	uint32_t mask = hdr->slot_count - 1, i, c;
+
+	if (free_slot)
+		*free_slot = -1;
+	for (c = 0, i = hash & mask; c < hdr->slot_count; c++, i = (i + 1) & mask) {
+		if (slots[i].state == SLOT_EMPTY) {
+			if (free_slot && *free_slot < 0)
+				*free_slot = i;
+			return -1;
+		}
+		if (slots[i].state == SLOT_DELETED) {
+			if (free_slot && *free_slot < 0)
+				*free_slot = i;
+			continue;
+		}
+		if (slots[i].hash == hash && slots[i].kind == kind
+		    && memcmp(&slots[i].key, key, sizeof(WinFileKey)) == 0)
+			return i;
+	}
+	return -1;
+}
+
+static int
+compare_last_use_desc(const void *a, const void *b)
+{
+	const FileCacheSlot *sa = a, *sb = b;
+	return (sa->last_use < sb->last_use) - (sa->last_use > sb->last_use);
+}
+
+static int
+compare_offset(const void *a, const void *b)
+{
+	const FileCacheSlot *sa = a, *sb = b;
+	return (sa->offset > sb->offset) - (sa->offset < sb->offset);
+}
+
+/* collect:
+ *   Make room for `need' bytes of data and one more slot, by keeping
+ *   only the most recently used entries that fit in three quarters of
+ *   the cache, and moving them to the start of the data area.
+ */
+static void
+collect(WinFileCache *fc, uint64_t need)
+{
+	FileCacheHeader *hdr = CACHE_HEADER(fc);
+	FileCacheSlot *slots = CACHE_SLOTS(fc), *live;
+	uint64_t budget, bytes = 0, pos;
+	uint32_t c, count = 0, keep = 0, mask = hdr->slot_count - 1, i;
+
+	live = xmalloc((hdr->used_slots + 1) * sizeof(FileCacheSlot));
+	for (c = 0; c < hdr->slot_count && count < hdr->used_slots; c++) {
+		if (slots[c].state == SLOT_USED)
+			live[count++] = slots[c];
+	}
+
+	budget = (hdr->file_size - hdr->data_offset) / 4 * 3 - need;
+	qsort(live, count, sizeof(FileCacheSlot), compare_last_use_desc);
+	for (c = 0; c < count; c++) {
+		if (keep >= hdr->slot_count / 2 || bytes + DATA_ALIGN(live[c].size) > budget)
+			continue;
+		bytes += DATA_ALIGN(live[c].size);
+		live[keep++] = live[c];
+	}
+
+	/* entries only move towards the start, in order */
+	qsort(live, keep, sizeof(FileCacheSlot), compare_offset);
+	memset(slots, 0, (size_t) hdr->slot_count * sizeof(FileCacheSlot));
+	pos = hdr->data_offset;
+	for (c = 0; c < keep; c++) {
+		if (live[c].offset != pos)
+			memmove(fc->map + pos, fc->map + live[c].offset, live[c].size);
+		live[c].offset = pos;
+		pos += DATA_ALIGN(live[c].size);
+		for (i = live[c].hash & mask; slots[i].state != SLOT_EMPTY; i = (i + 1) & mask)
+			;
+		slots[i] = live[c];
+	}
+	hdr->used_slots = keep;
+	hdr->deleted_slots = 0;
+	hdr->data_end = pos;
+	hdr->data_used = pos - hdr->data_offset;
+	free(live);
+}
+
+static wres_error
+map_cache(WinFileCache *fc, size_t size)
+{
+	fc->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fc->fd, 0);
+	if (fc->map == MAP_FAILED) {
+		fc->map = NULL;
+		return -errno;
+	}
+	fc->map_size = size;
+	return WRES_ERROR_NONE;
+}
+
+static wres_error
+init_cache(WinFileCache *fc, size_t size)
+{
+	FileCacheHeader *hdr;
+	wres_error err;
+
+	if (ftruncate(fc->fd, size) != 0)
+		return -errno;
+	if ((err = map_cache(fc, size)))
+		return err;
+	hdr = CACHE_HEADER(fc);
+	memset(hdr, 0, sizeof(FileCacheHeader));
+	hdr->file_size = size;
+	hdr->slot_count = slot_count_for_size(size);
+	hdr->data_offset = data_offset_for_slots(hdr->slot_count);
+	reset_cache(fc);
+	hdr->version = FILE_CACHE_VERSION;
+	hdr->magic = FILE_CACHE_MAGIC;
+	return WRES_ERROR_NONE;
+}
+
+/* open_file_cache:
+ *   Open the cache at `path', creating it with room for about `size'
+ *   bytes if it does not exist or if it was created with another size.
+ */
+WinFileCache *
+open_file_cache(const char *path, size_t size, wres_error *err)
+{
+	WinFileCache *fc;
+	struct stat st, path_st;
+	wres_error e = WRES_ERROR_UNKNOWN;
+	int attempt;
+
+	if (size < FILE_CACHE_MIN_SIZE)
+		size = FILE_CACHE_MIN_SIZE;
+	fc = xcalloc(1, sizeof(WinFileCache));
+
+	for (attempt = 0; attempt < 4; attempt++) {
+		fc->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		if (fc->fd < 0) {
+			e = -errno;
+			break;
+		}
+		lock_cache(fc, LOCK_EX);
+
+		/* somebody may have replaced the file before we got the lock */
+		if (fstat(fc->fd, &st) != 0 || stat(path, &path_st) != 0
+		    || st.st_dev != path_st.st_dev || st.st_ino != path_st.st_ino) {
+			close(fc->fd);
+			continue;
+		}
+
+		if (st.st_size == 0) {
+			e = init_cache(fc, size);
+		} else if ((uint64_t) st.st_size != size || st.st_size < (off_t) sizeof(FileCacheHeader)) {
+			e = WRES_ERROR_WRONGFORMAT;
+		} else if ((e = map_cache(fc, size)) == WRES_ERROR_NONE) {
+			if (!header_is_valid(CACHE_HEADER(fc), size))
+				e = WRES_ERROR_WRONGFORMAT;
+			else if (CACHE_HEADER(fc)->busy)
+				reset_cache(fc);
+		}
+
+		if (e == WRES_ERROR_NONE) {
+			lock_cache(fc, LOCK_UN);
+			return fc;
+		}
+		if (fc->map)
+			munmap(fc->map, fc->map_size);
+		fc->map = NULL;
+		if (e == WRES_ERROR_WRONGFORMAT)
+			unlink(path);
+		close(fc->fd);
+		if (e != WRES_ERROR_WRONGFORMAT)
+			break;
+	}
+
+	free(fc);
+	if (err) *err = e;
+	return NULL;
+}
+
+void
+close_file_cache(WinFileCache *fc)
+{
+	munmap(fc->map, fc->map_size);
+	close(fc->fd);
+	free(fc);
+}
+
+/* file_cache_get:
+ *   Returns a copy of the data of `kind' stored for a file, which must be
+ *   freed, or NULL with WRES_ERROR_RESNOTFOUND if there is none.
+ */
+void *
+file_cache_get(WinFileCache *fc, const WinFileKey *key, uint32_t kind, size_t *size, wres_error *err)
+{
+	FileCacheHeader *hdr = CACHE_HEADER(fc);
+	FileCacheSlot *slot;
+	uint64_t hash = hash_key(key, kind);
+	void *data = NULL;
+	int64_t i;
+
+	lock_cache(fc, LOCK_SH);
+	/* a busy flag seen with the shared lock was left by a dead writer */
+	i = hdr->busy ? -1 : find_slot(fc, key, kind, hash, NULL);
+	if (i >= 0) {
+		slot = &CACHE_SLOTS(fc)[i];
+		if (slot->offset >= hdr->data_offset && slot->offset <= hdr->file_size
+		    && slot->size <= hdr->file_size - slot->offset) {
+			data = xmalloc(slot->size ? slot->size : 1);
+			memcpy(data, fc->map + slot->offset, slot->size);
+			if (xxh64(data, slot->size, 0) == slot->checksum) {
+				*size = slot->size;
+				__atomic_store_n(&slot->last_use, __atomic_add_fetch(&hdr->clock, 1, __ATOMIC_RELAXED),
+				                 __ATOMIC_RELAXED);
+			} else {
+				free(data);
+				data = NULL;
+			}
+		}
+	}
+	lock_cache(fc, LOCK_UN);
+
+	if (data == NULL && err)
+		*err = WRES_ERROR_RESNOTFOUND;
+	return data;
+}
+
+/* file_cache_put:
+ *   Store data of `kind' for a file, replacing what was there. Entries
+ *   bigger than a quarter of the cache are refused.
+ */
+wres_error
+file_cache_put(WinFileCache *fc, const WinFileKey *key, uint32_t kind, const void *data, size_t size)
+{
+	FileCacheHeader *hdr = CACHE_HEADER(fc);
+	FileCacheSlot *slot;
+	uint64_t hash = hash_key(key, kind), need = DATA_ALIGN(size);
+	int64_t i, free_slot;
+
+	if (need > (hdr->file_size - hdr->data_offset) / 4)
+		return WRES_ERROR_INVALIDPARAM;
+
+	lock_cache(fc, LOCK_EX);
+	if (hdr->busy)
+		reset_cache(fc);
+	hdr->busy = 1;
+
+	i = find_slot(fc, key, kind, hash, &free_slot);
+	if (i >= 0) {
+		slot = &CACHE_SLOTS(fc)[i];
+		slot->state = SLOT_DELETED;
+		hdr->used_slots--;
+		hdr->deleted_slots++;
+		hdr->data_used -= DATA_ALIGN(slot->size);
+		if (free_slot < 0)
+			free_slot = i;
+	}
+	if (hdr->data_end + need > hdr->file_size
+	    || hdr->used_slots + hdr->deleted_slots + 1 > hdr->slot_count / 4 * 3) {
+		collect(fc, need);
+		find_slot(fc, key, kind, hash, &free_slot);
+	}
+
+	slot = &CACHE_SLOTS(fc)[free_slot];
+	if (slot->state == SLOT_DELETED)
+		hdr->deleted_slots--;
+	hdr->used_slots++;
+	memcpy(fc->map + hdr->data_end, data, size);
+	slot->key = *key;
+	slot->kind = kind;
+	slot->hash = hash;
+	slot->offset = hdr->data_end;
+	slot->size = size;
+	slot->checksum = xxh64(data, size, 0);
+	slot->last_use = __atomic_add_fetch(&hdr->clock, 1, __ATOMIC_RELAXED);
+	slot->state = SLOT_USED;
+	hdr->data_end += need;
+	hdr->data_used += need;
+
+	hdr->busy = 0;
+	lock_cache(fc, LOCK_UN);
+	return WRES_ERROR_NONE;
+}
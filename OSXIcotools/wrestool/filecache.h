@@ -0,0 +1,54 @@
+/* filecache.h - Persistent cache of data extracted from files
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <sys/stat.h>
+#include "wrestool.h"
+
+
+/* Kinds of data stored in the cache. A file may have one entry of each. */
+#define FILE_CACHE_ICON			1	/* best image of the icon, PNG or ICO */
+#define FILE_CACHE_METADATA		2	/* serialized metadata */
+
+#define FILE_CACHE_MIN_SIZE		(1024 * 1024)
+
+/* Identifies a version of a file: any change to it gives another key */
+typedef struct _WinFileKey {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	int64_t ctime_sec;
+	int64_t ctime_nsec;
+} WinFileKey;
+
+typedef struct _WinFileCache WinFileCache;
+
+
+void file_cache_key_from_stat(const struct stat *, WinFileKey *);
+wres_error file_cache_key_for_path(const char *, WinFileKey *);
+WinFileCache *open_file_cache(const char *, size_t, wres_error *);
+void close_file_cache(WinFileCache *);
+void *file_cache_get(WinFileCache *, const WinFileKey *, uint32_t, size_t *, wres_error *);
+wres_error file_cache_put(WinFileCache *, const WinFileKey *, uint32_t, const void *, size_t);
+
+
+#endif
@@ -0,0 +1,314 @@
+/* filehash.c - Hashing of whole files while they are loaded
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* load_library() maps the whole file anyway, so the hashes that an
+ * inventory needs are computed from the same mapping instead of reading
+ * the file again. Large files are hashed by a few threads while the
+ * resources are being parsed: SHA-256 cannot be split, so it gets a
+ * thread of its own, and the chunks of the tree hash are taken by all
+ * the others, as well as by the SHA-256 thread when it is done. The
+ * caller joins in too in finish_file_hashing(), so that the hashes are
+ * complete even if no thread could be started. The hashing threads
+ * follow the cancellation token of the thread that started them. They
+ * are counted for the whole process, not per job: when several crawl
+ * workers hash large files at once, the jobs started last get fewer
+ * threads, or none and are hashed by their caller, so that there are
+ * never more hashing threads than processors. */
+
+#include <config.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "xalloc.h"			/* Gnulib */
+#include "common/sha256.h"
+#include "common/xxhash.h"
+#include "cancel.h"
+#include "filehash.h"
+
+
+struct _WinHashJob {
+	const uint8_t *data;
+	size_t size;
+	int flags;
+	WinFileHashes *out;
+	WinCancelToken *token;		/* of the thread that started the job */
+	int cancelled;
+	int sha256_claimed;
+	size_t next_chunk;
+	size_t chunk_count;
+	uint64_t *leaves;
+	uint64_t start_us;
+	uint64_t end_us;			/* when the last piece of work was done */
+	pthread_t threads[FILE_HASH_MAX_THREADS];
+	int thread_count;
+};
+
+/* hashing threads running in the process, up to hash_thread_limit() */
+static int hash_threads_running;
+
+
+static uint64_t
+now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static size_t
+tree_chunk_count(size_t size)
+{
+	if (size == 0)
+		return 1;
+	return (size + XXH64_TREE_CHUNK_SIZE - 1) / XXH64_TREE_CHUNK_SIZE;
+}
+
+static uint64_t
+tree_leaf(const uint8_t *data, size_t size, size_t chunk)
+{
+	size_t offset = chunk * XXH64_TREE_CHUNK_SIZE;
+	size_t len = size - offset;
+
+	if (len > XXH64_TREE_CHUNK_SIZE)
+		len = XXH64_TREE_CHUNK_SIZE;
+	return xxh64(data + offset, len, 0);
+}
+
+static uint64_t
+tree_root(uint64_t *leaves, size_t count, size_t size)
+{
+	uint8_t *p = (uint8_t *) leaves;
+	uint64_t v;
+	size_t c;
+	int i;
+
+	/* the leaves are hashed in little-endian order on any machine */
+	for (c = 0; c < count; c++) {
+		v = leaves[c];
+		for (i = 0; i < 8; i++, v >>= 8)
+			*p++ = v & 0xFF;
+	}
+	return xxh64(leaves, count * sizeof(uint64_t), size);
+}
+
+/* xxh64_tree:
+ *   Compute the tree hash of `size' bytes at `data' in the calling
+ *   thread; see XXH64_TREE_CHUNK_SIZE.
+ */
+uint64_t
+xxh64_tree(const void *data, size_t size)
+{
+	size_t c, count = tree_chunk_count(size);
+	uint64_t *leaves = xnmalloc(count, sizeof(uint64_t));
+	uint64_t res;
+
+	for (c = 0; c < count; c++)
+		leaves[c] = tree_leaf(data, size, c);
+	res = tree_root(leaves, count, size);
+	free(leaves);
+	return res;
+}
+
+static bool
+job_cancelled(WinHashJob *job)
+{
+	if (job->token == NULL || !cancel_token_is_cancelled(job->token))
+		return false;
+	__atomic_store_n(&job->cancelled, 1, __ATOMIC_RELAXED);
+	return true;
+}
+
+/* hash_sha256:
+ *   Hash the data of a job in steps, so that a cancelled job stops soon.
+ */
+static void
+hash_sha256(WinHashJob *job)
+{
+	SHA256Context ctx;
+	size_t offset, step;
+
+	sha256_init(&ctx);
+	for (offset = 0; offset < job->size; offset += step) {
+		if (job_cancelled(job))
+			return;
+		step = job->size - offset;
+		if (step > CANCEL_CHECK_BYTES)
+			step = CANCEL_CHECK_BYTES;
+		sha256_update(&ctx, job->data + offset, step);
+	}
+	sha256_final(&ctx, job->out->sha256);
+}
+
+/* hash_work:
+ *   Do whatever is left of a job. Run by the hashing threads and by the
+ *   caller of finish_file_hashing().
+ */
+static void *
+hash_work(void *arg)
+{
+	WinHashJob *job = arg;
+	uint64_t t, end;
+	size_t c;
+
+	if ((job->flags & WRES_HASH_SHA256) &&
+	    !__atomic_exchange_n(&job->sha256_claimed, 1, __ATOMIC_RELAXED))
+		hash_sha256(job);
+	if (job->flags & WRES_HASH_XXH64_TREE) {
+		while ((c = __atomic_fetch_add(&job->next_chunk, 1, __ATOMIC_RELAXED)) < job->chunk_count) {
+			if (job_cancelled(job))
+				break;
+			job->leaves[c] = tree_leaf(job->data, job->size, c);
+		}
+	}
+
+	t = now_us();
+	end = __atomic_load_n(&job->end_us, __ATOMIC_RELAXED);
+	while (t > end && !__atomic_compare_exchange_n(&job->end_us, &end, t,
+	    false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	return NULL;
+}
+
+static int
+hash_thread_limit(void)
+{
+	static int cpus;
+	int n = __atomic_load_n(&cpus, __ATOMIC_RELAXED);
+
+	if (n == 0) {
+		n = (int) sysconf(_SC_NPROCESSORS_ONLN);
+		if (n < 1)
+			n = 1;
+		if (n > FILE_HASH_MAX_THREADS)
+			n = FILE_HASH_MAX_THREADS;
+		__atomic_store_n(&cpus, n, __ATOMIC_RELAXED);
+	}
+	return n;
+}
+
+/* claim_hash_threads:
+ *   Reserve up to `wanted' hashing threads out of those that are not
+ *   running yet. Returns how many were reserved, possibly 0; the ones
+ *   that are not used must be given back with release_hash_threads().
+ */
+static int
+claim_hash_threads(int wanted)
+{
+	int running = __atomic_load_n(&hash_threads_running, __ATOMIC_RELAXED);
+	int n;
+
+	do {
+		n = hash_thread_limit() - running;
+		if (n <= 0)
+			return 0;
+		if (n > wanted)
+			n = wanted;
+	} while (!__atomic_compare_exchange_n(&hash_threads_running, &running, running + n,
+	    false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	return n;
+}
+
+static void
+release_hash_threads(int n)
+{
+	if (n > 0)
+		__atomic_sub_fetch(&hash_threads_running, n, __ATOMIC_RELAXED);
+}
+
+/* start_file_hashing:
+ *   Start computing the hashes in `flags' (WRES_HASH_*) of `size' bytes
+ *   at `data', which must stay readable and unchanged until the job is
+ *   passed to finish_file_hashing(). The results go in `out' at that
+ *   point, unless the token of the calling thread is cancelled in the
+ *   meantime, in which case none of the hashes are marked as computed.
+ *   Returns NULL if there was nothing to start, either because
+ *   `flags' is zero or because the data was small enough to be hashed
+ *   right away.
+ */
+WinHashJob *
+start_file_hashing(const void *data, size_t size, int flags, WinFileHashes *out)
+{
+	WinHashJob *job;
+	size_t work;
+	int c, threads;
+
+	memset(out, 0, sizeof(WinFileHashes));
+	flags &= WRES_HASH_SHA256 | WRES_HASH_XXH64_TREE;
+	if (flags == 0)
+		return NULL;
+	out->computed = flags;
+	out->size = size;
+
+	job = xcalloc(1, sizeof(WinHashJob));
+	job->data = data;
+	job->size = size;
+	job->flags = flags;
+	job->out = out;
+	job->token = thread_cancel_token();
+	job->start_us = now_us();
+	if (flags & WRES_HASH_XXH64_TREE) {
+		job->chunk_count = tree_chunk_count(size);
+		job->leaves = xnmalloc(job->chunk_count, sizeof(uint64_t));
+	}
+
+	if (size < FILE_HASH_THREAD_MIN) {
+		/* starting threads would take longer than the hashing */
+		finish_file_hashing(job);
+		return NULL;
+	}
+
+	work = job->chunk_count + ((flags & WRES_HASH_SHA256) ? 1 : 0);
+	threads = hash_thread_limit();
+	if ((size_t) threads > work)
+		threads = (int) work;
+	threads = claim_hash_threads(threads);
+	for (c = 0; c < threads; c++) {
+		if (pthread_create(&job->threads[c], NULL, hash_work, job) != 0)
+			break;
+		job->thread_count++;
+	}
+	release_hash_threads(threads - job->thread_count);
+	return job;
+}
+
+/* finish_file_hashing:
+ *   Wait for the hashes of a job, helping with what is left of them,
+ *   store them and free the job. Does nothing if `job' is NULL.
+ */
+void
+finish_file_hashing(WinHashJob *job)
+{
+	int c;
+
+	if (job == NULL)
+		return;
+	hash_work(job);
+	for (c = 0; c < job->thread_count; c++)
+		pthread_join(job->threads[c], NULL);
+	release_hash_threads(job->thread_count);
+
+	if (job->cancelled)
+		job->out->computed = 0;
+	else if (job->flags & WRES_HASH_XXH64_TREE)
+		job->out->xxh64_tree = tree_root(job->leaves, job->chunk_count, job->size);
+	job->out->microseconds = job->end_us - job->start_us;
+	free(job->leaves);
+	free(job);
+}
@@ -0,0 +1,43 @@
+/* filehash.h - Hashing of whole files while they are loaded
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FILEHASH_H
+#define FILEHASH_H
+
+#include "wrestool.h"
+
+
+/* The tree hash splits the file in chunks of XXH64_TREE_CHUNK_SIZE
+ * bytes, hashes each of them with seed 0, then hashes the leaf hashes,
+ * stored as consecutive little-endian 64-bit integers, with the size of
+ * the file as the seed. An empty file has one empty chunk. */
+#define XXH64_TREE_CHUNK_SIZE	(1024 * 1024)
+
+/* Smaller files are hashed by the caller of start_file_hashing() */
+#define FILE_HASH_THREAD_MIN	(1024 * 1024)
+#define FILE_HASH_MAX_THREADS	(8)
+
+typedef struct _WinHashJob WinHashJob;
+
+
+uint64_t xxh64_tree(const void *, size_t);
+WinHashJob *start_file_hashing(const void *, size_t, int, WinFileHashes *);
+void finish_file_hashing(WinHashJob *);
+
+
+#endif
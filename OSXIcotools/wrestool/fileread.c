@@ -21,19 +21,25 @@
 #include <stdlib.h>		/* C89 */
 #include <string.h>		/* C89 */
 #include <stdbool.h>		/* POSIX/Gnulib */
+#include <stddef.h>		/* C89 */
+#include <stdint.h>		/* POSIX/Gnulib */
 #include <sys/mman.h>
 #include "gettext.h"			/* Gnulib */
 #define _(s) gettext(s)
 #define N_(s) gettext_noop(s)
 #include "fileread.h"
+#include "filehash.h"
+#include "cancel.h"
 #include "win32.h"
 #include "xalloc.h"		/* Gnulib */
 #include "minmax.h"		/* Gnulib */
+#include "common/xxhash.h"
 
 
 static off_t calc_vma_size (WinLibrary *);
 static wres_error load_ne_library(WinLibrary *);
 static wres_error load_pe_library(WinLibrary *);
+static bool copy_unless_cancelled(void *, const void *, size_t);
 
 
 /* Check whether access to a PE_SECTIONS is allowed */
@@ -74,55 +80,144 @@ check_offset(const char *memory, size_t total_size, const char *name, const void
 
 
 
+/* header_needs:
+ *   Check that the first `end' bytes of a file are in the header that was
+ *   read. If they are not but the file is long enough, ask for more.
+ */
+static wres_error
+header_needs(size_t end, size_t size, size_t file_size, size_t *need)
+{
+	if (end <= size)
+		return WRES_ERROR_NONE;
+	if (end > file_size)
+		return WRES_ERROR_WRONGFORMAT;
+	if (need)
+		*need = end;
+	return WRES_ERROR_PREMATUREEND;
+}
+
+/* check_library_header:
+ *   Find out from the first `size' bytes of a file of `file_size' bytes
+ *   whether it is a NE, PE32 or PE32+ module, doing the same checks as
+ *   load_library() on the DOS, NE or PE headers and the section table.
+ *   When they do not fit in `size' bytes, WRES_ERROR_PREMATUREEND is
+ *   returned and the length of the header needed is put in `need'.
+ *   Pass SIZE_MAX as `file_size' if it is not known.
+ */
+wres_error
+check_library_header(const void *header, size_t size, size_t file_size, int *binary_type, size_t *need)
+{
+	const uint8_t *data = header;
+	const DOSImageHeader *mz_header = header;
+	const Win32ImageNTHeaders *pe_header;
+	size_t lfanew, sections;
+	wres_error e;
+
+	if (size > file_size)
+		size = file_size;
+
+	/* check for DOS header signature `MZ' */
+	if ((e = header_needs(sizeof(DOSImageHeader), size, file_size, need)))
+		return e;
+	lfanew = mz_header->lfanew;
+	if (mz_header->magic == IMAGE_DOS_SIGNATURE && lfanew < sizeof(DOSImageHeader))
+		return WRES_ERROR_WRONGFORMAT;
+
+	/* check for OS2/Win16 header signature `NE' */
+	if ((e = header_needs(lfanew + sizeof(uint16_t), size, file_size, need)))
+		return e;
+	if (NE_HEADER(data)->magic == IMAGE_OS2_SIGNATURE) {
+		if ((e = header_needs(lfanew + sizeof(OS2ImageHeader), size, file_size, need)))
+			return e;
+		*binary_type = NE_BINARY;
+		return WRES_ERROR_NONE;
+	}
+
+	/* check for NT header signature `PE' */
+	if ((e = header_needs(lfanew + sizeof(Win32ImageNTHeaders), size, file_size, need)))
+		return e;
+	pe_header = PE_HEADER(data);
+	if (pe_header->signature != IMAGE_NT_SIGNATURE)
+		return WRES_ERROR_WRONGFORMAT;
+
+	/* the section table, as calc_vma_size() does */
+	if (pe_header->file_header.number_of_sections > 0) {
+		sections = lfanew + offsetof(Win32ImageNTHeaders, optional_header)
+		    + pe_header->file_header.size_of_optional_header
+		    + sizeof(Win32ImageSectionHeader) * pe_header->file_header.number_of_sections;
+		if ((e = header_needs(sections, size, file_size, need)))
+			return e;
+	}
+
+	if (pe_header->optional_header.magic == OPTIONAL_MAGIC_PE32_64)
+		*binary_type = PEPLUS_BINARY;
+	else if (pe_header->optional_header.magic == OPTIONAL_MAGIC_PE32)
+		*binary_type = PE_BINARY;
+	else
+		return WRES_ERROR_WRONGFORMAT;
+	return WRES_ERROR_NONE;
+}
+
+
 /* load_library:
  *
  * Read header and get resource directory offset in a Windows library
- * (AKA module).
+ * (AKA module). The hashes in fi->hash_flags are computed from the
+ * mapping of the file while it is being parsed. Gives up with
+ * WRES_ERROR_CANCELLED if the token of the thread is cancelled.
  */
 wres_error load_library(WinLibrary *fi)
 {
+	WinHashJob *hashing;
+	WinFileHashes hashes;
+	char *file_memory;
+	off_t file_size;
+	wres_error e;
+	
+	/* before total_size is set, which must always go with a mapping */
+	if (wres_cancelled())
+		return WRES_ERROR_CANCELLED;
 	fseek(fi->file, 0, SEEK_END);
 	fi->total_size = ftello(fi->file);
 	fseek(fi->file, 0, SEEK_SET);
-	if (fi->total_size == -1)
+	if (fi->total_size == -1) {
+		fi->total_size = 0;
 		return -errno;
+	}
 	if (fi->total_size == 0)
 		return WRES_ERROR_WRONGFORMAT;
+	fi->file_size = fi->total_size;
 	
 	/* read all of file */
 	fi->memory = mmap(NULL, fi->total_size, PROT_READ | PROT_WRITE, MAP_FILE | MAP_PRIVATE, fileno(fi->file), 0);
-	if (fi->memory == MAP_FAILED)
-		return -errno;
-	
-	/* check for DOS header signature `MZ' */
-	RETURN_IF_BAD_POINTER(fi, WRES_ERROR_WRONGFORMAT, MZ_HEADER(fi->memory)->magic);
-	if (MZ_HEADER(fi->memory)->magic == IMAGE_DOS_SIGNATURE) {
-		RETURN_IF_BAD_POINTER(fi, WRES_ERROR_WRONGFORMAT, *MZ_HEADER(fi->memory));
-		DOSImageHeader *mz_header = MZ_HEADER(fi->memory);
-
-		RETURN_IF_BAD_POINTER(fi, WRES_ERROR_WRONGFORMAT, mz_header->lfanew);
-		if (mz_header->lfanew < sizeof (DOSImageHeader))
-			return WRES_ERROR_WRONGFORMAT;
-
-		/* falls through */
+	if (fi->memory == MAP_FAILED) {
+		e = -errno;
+		fi->memory = NULL;
+		fi->total_size = 0;
+		return e;
 	}
-
-	/* check for OS2/Win16 header signature `NE' */
-	RETURN_IF_BAD_POINTER(fi, WRES_ERROR_WRONGFORMAT, NE_HEADER(fi->memory)->magic);
-	if (NE_HEADER(fi->memory)->magic == IMAGE_OS2_SIGNATURE) {
-		RETURN_IF_BAD_POINTER(fi, WRES_ERROR_WRONGFORMAT, *NE_HEADER(fi->memory));
-		return load_ne_library(fi);
-	}
-
-	/* check for NT header signature `PE' */
-	RETURN_IF_BAD_POINTER(fi, WRES_ERROR_WRONGFORMAT, PE_HEADER(fi->memory)->signature);
-	if (PE_HEADER(fi->memory)->signature == IMAGE_NT_SIGNATURE) {
-		RETURN_IF_BAD_POINTER(fi, WRES_ERROR_WRONGFORMAT, *PE_HEADER(fi->memory));
-		return load_pe_library(fi);
+	file_memory = fi->memory;
+	file_size = fi->total_size;
+	hashing = start_file_hashing(file_memory, file_size, fi->hash_flags, &hashes);
+	
+	/* the whole file is there, so the header cannot be incomplete */
+	e = check_library_header(fi->memory, fi->total_size, fi->total_size, &fi->binary_type, NULL);
+	if (e == WRES_ERROR_NONE) {
+		if (fi->binary_type == NE_BINARY)
+			e = load_ne_library(fi);
+		else
+			e = load_pe_library(fi);
 	}
-
-	/* other (unknown) header signature was found */
-	return WRES_ERROR_WRONGFORMAT;
+	
+	/* the mapping of the file must outlive the hashing threads, and
+	 * load_pe_library() replaces *fi, so the hashes are stored last */
+	finish_file_hashing(hashing);
+	fi->hashes = hashes;
+	if (e == WRES_ERROR_NONE && fi->memory != file_memory)
+		munmap(file_memory, file_size);
+	if (e == WRES_ERROR_NONE && wres_cancelled())
+		e = WRES_ERROR_CANCELLED;
+	return e;
 }
 
 
@@ -185,6 +280,9 @@ static wres_error load_ne_library(WinLibrary *fi)
 		fi->first_resource = NULL;
 	}
 
+	/* resources are found through file offsets, so they are identical
+	 * only if the whole file is */
+	fi->resource_digest = xxh64(fi->memory, fi->total_size, NE_BINARY);
 	return WRES_ERROR_NONE;
 }
 
@@ -246,6 +344,10 @@ static wres_error load_pe_library(WinLibrary *fi)
 			
 			if (pe_sec->characteristics & IMAGE_SCN_CNT_UNINITIALIZED_DATA)
 				continue;
+			if (wres_cancelled()) {
+				err = WRES_ERROR_CANCELLED;
+				goto fail;
+			}
 			
 			/* Protect against memory moves overwriting the section table */
             if ((uint8_t*)(fi->memory + pe_sec->virtual_address) <
@@ -272,17 +374,32 @@ static wres_error load_pe_library(WinLibrary *fi)
 				/* As in PE files there is no requirement for sections in the file
 				 * to be aligned in the same way as they are required to be aligned
 				 * in memory, this code path will be hit very frequently */
-				memcpy(dest, fi->memory + offset, size);
+				if (!copy_unless_cancelled(dest, fi->memory + offset, size)) {
+					err = WRES_ERROR_CANCELLED;
+					goto fail;
+				}
 			}
 		}
 
 		fi_new.first_resource = ((uint8_t *)fi_new.memory) + dir->virtual_address;
+		
+		/* The data entries of the directory hold RVAs, so the same bytes
+		 * at another address are other resources. This must be done
+		 * before extract_resource() fixes the alpha channel of icons. */
+		size_t digest_size = dir->size;
+		if (dir->virtual_address >= (uint64_t) fi_new.total_size)
+			digest_size = 0;
+		else if (digest_size > (size_t) (fi_new.total_size - dir->virtual_address))
+			digest_size = fi_new.total_size - dir->virtual_address;
+		fi_new.resource_digest = xxh64(fi_new.first_resource, digest_size,
+		    (uint64_t) dir->virtual_address << 8 | fi_new.binary_type);
 	} else {
 		/* no resources */
 		fi_new.first_resource = NULL;
+		fi_new.resource_digest = 0;
 	}
 	
-	munmap(fi->memory, fi->total_size);
+	/* the mapping of the file is released by load_library() */
 	*fi = fi_new;
 	return WRES_ERROR_NONE;
 	
@@ -292,9 +409,36 @@ fail:
 }
 
 
+/* copy_unless_cancelled:
+ *   memcpy() in steps, so that sections of hundreds of megabytes do not
+ *   hold up a cancelled request. Returns false if it was cancelled.
+ */
+static bool
+copy_unless_cancelled(void *dest, const void *src, size_t size)
+{
+	size_t step;
+	
+	while (size > 0) {
+		step = MIN(size, CANCEL_CHECK_BYTES);
+		memcpy(dest, src, step);
+		dest = (char *) dest + step;
+		src = (const char *) src + step;
+		size -= step;
+		if (size > 0 && wres_cancelled())
+			return false;
+	}
+	return true;
+}
+
+
 void unload_library(WinLibrary *fi)
 {
-	munmap(fi->memory, fi->total_size);
+	/* a library that failed to load may have no mapping */
+	if (fi->memory != NULL && fi->memory != MAP_FAILED && fi->total_size > 0)
+		munmap(fi->memory, fi->total_size);
+	fi->memory = NULL;
+	fi->total_size = 0;
+	fi->file_size = 0;
 }
 
 
@@ -56,6 +56,7 @@
 		return NULL; \
 	}
 
+wres_error check_library_header(const void *, size_t, size_t, int *, size_t *);
 wres_error load_library(WinLibrary *);
 void unload_library(WinLibrary *);
 bool check_offset(const char *, size_t, const char *, const void *, size_t);
@@ -0,0 +1,626 @@
+/* headerscan.c - Batched reading of the headers of many files
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Telling modules from other files needs only their first few KB, but
+ * load_library() maps the whole file. scan_headers() instead reads the
+ * headers of a batch of files and classifies them with the checks of
+ * load_library(). On Linux the opens, reads and closes of up to
+ * SCAN_RING_SLOTS files at a time go through one io_uring, so a batch
+ * costs a few system calls instead of several per file. Elsewhere, or
+ * when io_uring is not available, the files are split among a pool of
+ * threads that use pread(). */
+
+#include <config.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    define HAVE_IO_URING 1
+#    include <sys/mman.h>
+#    include <sys/syscall.h>
+#    include <linux/io_uring.h>
+#  endif
+#endif
+#include "xalloc.h"			/* Gnulib */
+#include "fileread.h"
+#include "headerscan.h"
+
+
+#define SCAN_RING_SLOTS		HEADER_SCAN_BATCH
+
+#ifdef HAVE_IO_URING
+
+enum {
+	SCAN_OP_OPEN,
+	SCAN_OP_STATX,
+	SCAN_OP_READ,
+	SCAN_OP_CLOSE
+};
+
+/* A file being scanned through the ring */
+typedef struct _ScanSlot {
+	WinHeaderScan *item;
+	int fd;
+	int pending;				/* operations not completed yet */
+	size_t wanted;				/* size of the read in flight */
+	uint8_t *buffer;
+	size_t buffer_size;
+	struct statx stx;
+} ScanSlot;
+
+typedef struct _ScanRing {
+	int fd;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_array;
+	unsigned sq_mask;
+	unsigned sq_local_tail;		/* including the SQEs not submitted yet */
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_map;
+	void *cq_map;
+	size_t sq_map_size;
+	size_t cq_map_size;
+	size_t sqes_size;
+	ScanSlot slots[SCAN_RING_SLOTS];
+	int free_slots[SCAN_RING_SLOTS];
+	int free_count;
+} ScanRing;
+
+#endif
+
+struct _WinHeaderScanner {
+#ifdef HAVE_IO_URING
+	ScanRing *ring;				/* NULL if io_uring cannot be used */
+#endif
+	/* thread pool */
+	pthread_t *threads;
+	int thread_count;
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t finish;
+	unsigned generation;
+	int busy;
+	bool quit;
+	/* batch being scanned by the pool */
+	int dirfd;
+	WinHeaderScan *items;
+	size_t count;
+	size_t next;
+};
+
+
+/* classify:
+ *   Look at the `got' bytes read out of `wanted' from the start of a
+ *   file. Returns how many bytes must be read to go on, or 0 when the
+ *   file has been classified.
+ */
+static size_t
+classify(WinHeaderScan *item, const uint8_t *buffer, size_t wanted, ssize_t got)
+{
+	size_t need = 0;
+
+	if (got < 0) {
+		item->error = (wres_error) got;
+		return 0;
+	}
+	/* a short read means we got the whole file */
+	item->error = check_library_header(buffer, got, (size_t) got < wanted ? (size_t) got : SIZE_MAX,
+	                                   &item->binary_type, &need);
+	if (item->error != WRES_ERROR_PREMATUREEND)
+		return 0;
+	if (need > HEADER_SCAN_MAX) {
+		item->error = WRES_ERROR_WRONGFORMAT;
+		return 0;
+	}
+	return need;
+}
+
+/* scan_open_flags:
+ *   Files found in a directory are not followed if they are links, as in
+ *   the crawler; paths given by the user (relative to AT_FDCWD) are.
+ */
+static int
+scan_open_flags(int dirfd)
+{
+	if (dirfd == AT_FDCWD)
+		return O_RDONLY | O_CLOEXEC;
+	return O_RDONLY | O_NOFOLLOW | O_CLOEXEC;
+}
+
+static void
+grow_buffer(uint8_t **buffer, size_t *buffer_size, size_t size)
+{
+	if (size <= *buffer_size)
+		return;
+	*buffer = xrealloc(*buffer, size);
+	*buffer_size = size;
+}
+
+static void
+scan_one(int dirfd, WinHeaderScan *item, uint8_t **buffer, size_t *buffer_size)
+{
+	size_t wanted = HEADER_SCAN_SIZE;
+	struct stat st;
+	ssize_t got;
+	int fd;
+
+	item->size = 0;
+	fd = openat(dirfd, item->path, scan_open_flags(dirfd));
+	if (fd < 0) {
+		item->error = -errno;
+		return;
+	}
+	if (fstat(fd, &st) == 0)
+		item->size = st.st_size;
+	do {
+		grow_buffer(buffer, buffer_size, wanted);
+		got = pread(fd, *buffer, wanted, 0);
+		if (got < 0)
+			got = -errno;
+		wanted = classify(item, *buffer, wanted, got);
+	} while (wanted > 0);
+	close(fd);
+}
+
+/* run_batch:
+ *   Scan the files of the current batch that nobody has taken yet.
+ */
+static void
+run_batch(WinHeaderScanner *hs)
+{
+	uint8_t *buffer = NULL;
+	size_t buffer_size = 0, i;
+
+	while ((i = __atomic_fetch_add(&hs->next, 1, __ATOMIC_RELAXED)) < hs->count)
+		scan_one(hs->dirfd, &hs->items[i], &buffer, &buffer_size);
+	free(buffer);
+}
+
+static void *
+pool_thread(void *arg)
+{
+	WinHeaderScanner *hs = arg;
+	unsigned seen = 0;
+
+	pthread_mutex_lock(&hs->lock);
+	for (;;) {
+		while (!hs->quit && hs->generation == seen)
+			pthread_cond_wait(&hs->start, &hs->lock);
+		if (hs->quit)
+			break;
+		seen = hs->generation;
+		pthread_mutex_unlock(&hs->lock);
+		run_batch(hs);
+		pthread_mutex_lock(&hs->lock);
+		if (--hs->busy == 0)
+			pthread_cond_signal(&hs->finish);
+	}
+	pthread_mutex_unlock(&hs->lock);
+	return NULL;
+}
+
+static void
+scan_with_threads(WinHeaderScanner *hs, int dirfd, WinHeaderScan *items, size_t count)
+{
+	pthread_mutex_lock(&hs->lock);
+	hs->dirfd = dirfd;
+	hs->items = items;
+	hs->count = count;
+	hs->next = 0;
+	hs->busy = hs->thread_count;
+	hs->generation++;
+	pthread_cond_broadcast(&hs->start);
+	pthread_mutex_unlock(&hs->lock);
+
+	run_batch(hs);
+
+	pthread_mutex_lock(&hs->lock);
+	while (hs->busy > 0)
+		pthread_cond_wait(&hs->finish, &hs->lock);
+	pthread_mutex_unlock(&hs->lock);
+}
+
+
+#ifdef HAVE_IO_URING
+
+static bool
+ring_supports(int fd, const int *ops, int op_count)
+{
+	struct io_uring_probe *probe;
+	bool res = true;
+	int c;
+
+	probe = xcalloc(1, sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op));
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+		free(probe);
+		return false;
+	}
+	for (c = 0; c < op_count; c++) {
+		if (ops[c] > probe->last_op || !(probe->ops[ops[c]].flags & IO_URING_OP_SUPPORTED))
+			res = false;
+	}
+	free(probe);
+	return res;
+}
+
+static void
+free_scan_ring(ScanRing *ring)
+{
+	int c;
+
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_map && ring->cq_map != ring->sq_map)
+		munmap(ring->cq_map, ring->cq_map_size);
+	if (ring->sq_map)
+		munmap(ring->sq_map, ring->sq_map_size);
+	for (c = 0; c < SCAN_RING_SLOTS; c++)
+		free(ring->slots[c].buffer);
+	close(ring->fd);
+	free(ring);
+}
+
+/* new_scan_ring:
+ *   Set up an io_uring, or return NULL if the kernel does not have it,
+ *   forbids it, or lacks one of the operations we need.
+ */
+static ScanRing *
+new_scan_ring(void)
+{
+	static const int ops[] = { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE };
+	struct io_uring_params p;
+	ScanRing *ring;
+	uint8_t *sq, *cq;
+	int fd, c;
+
+	memset(&p, 0, sizeof(p));
+	/* each file has at most two operations in flight */
+	fd = syscall(__NR_io_uring_setup, SCAN_RING_SLOTS * 2, &p);
+	if (fd < 0)
+		return NULL;
+	if (!ring_supports(fd, ops, sizeof(ops) / sizeof(ops[0]))) {
+		close(fd);
+		return NULL;
+	}
+
+	ring = xcalloc(1, sizeof(ScanRing));
+	ring->fd = fd;
+	ring->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_map_size > ring->sq_map_size)
+			ring->sq_map_size = ring->cq_map_size;
+		ring->cq_map_size = ring->sq_map_size;
+	}
+	ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	                    fd, IORING_OFF_SQ_RING);
+	if (ring->sq_map == MAP_FAILED) {
+		ring->sq_map = NULL;
+		free_scan_ring(ring);
+		return NULL;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_map = ring->sq_map;
+	} else {
+		ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		                    fd, IORING_OFF_CQ_RING);
+		if (ring->cq_map == MAP_FAILED) {
+			ring->cq_map = NULL;
+			free_scan_ring(ring);
+			return NULL;
+		}
+	}
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+	                  fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		free_scan_ring(ring);
+		return NULL;
+	}
+
+	sq = ring->sq_map;
+	cq = ring->cq_map;
+	ring->sq_head = (unsigned *) (sq + p.sq_off.head);
+	ring->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+	ring->sq_array = (unsigned *) (sq + p.sq_off.array);
+	ring->sq_mask = *(unsigned *) (sq + p.sq_off.ring_mask);
+	ring->sq_local_tail = *ring->sq_tail;
+	ring->cq_head = (unsigned *) (cq + p.cq_off.head);
+	ring->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+	ring->cq_mask = *(unsigned *) (cq + p.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+	for (c = 0; c < SCAN_RING_SLOTS; c++) {
+		ring->slots[c].fd = -1;
+		ring->free_slots[c] = SCAN_RING_SLOTS - 1 - c;
+	}
+	ring->free_count = SCAN_RING_SLOTS;
+	return ring;
+}
+
+/* queue_op:
+ *   Fill the next submission queue entry for an operation on a slot.
+ */
+static void
+queue_op(ScanRing *ring, int op, ScanSlot *slot, int fd, const void *addr, unsigned len, uint64_t off)
+{
+	unsigned index = ring->sq_local_tail & ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t) addr;
+	sqe->len = len;
+	sqe->off = off;
+	sqe->user_data = (uint64_t) (slot - ring->slots) << 2 | op;
+	switch (op) {
+	case SCAN_OP_OPEN:
+		sqe->opcode = IORING_OP_OPENAT;
+		sqe->open_flags = scan_open_flags(fd);
+		break;
+	case SCAN_OP_STATX:
+		sqe->opcode = IORING_OP_STATX;
+		sqe->statx_flags = fd == AT_FDCWD ? 0 : AT_SYMLINK_NOFOLLOW;
+		break;
+	case SCAN_OP_READ:
+		sqe->opcode = IORING_OP_READ;
+		break;
+	case SCAN_OP_CLOSE:
+		sqe->opcode = IORING_OP_CLOSE;
+		break;
+	}
+	ring->sq_array[index] = index;
+	ring->sq_local_tail++;
+	slot->pending++;
+}
+
+static void
+queue_read(ScanRing *ring, ScanSlot *slot, size_t size)
+{
+	grow_buffer(&slot->buffer, &slot->buffer_size, size);
+	slot->wanted = size;
+	queue_op(ring, SCAN_OP_READ, slot, slot->fd, slot->buffer, size, 0);
+}
+
+static void
+start_slot(ScanRing *ring, int dirfd, WinHeaderScan *item)
+{
+	ScanSlot *slot = &ring->slots[ring->free_slots[--ring->free_count]];
+
+	item->size = 0;
+	slot->item = item;
+	slot->fd = -1;
+	queue_op(ring, SCAN_OP_OPEN, slot, dirfd, item->path, 0, 0);
+	queue_op(ring, SCAN_OP_STATX, slot, dirfd, item->path, STATX_SIZE, (uintptr_t) &slot->stx);
+}
+
+/* complete_op:
+ *   Move a file on to its next operation once the previous one is done.
+ */
+static void
+complete_op(ScanRing *ring, const struct io_uring_cqe *cqe)
+{
+	ScanSlot *slot = &ring->slots[cqe->user_data >> 2];
+	size_t wanted;
+
+	slot->pending--;
+	switch (cqe->user_data & 3) {
+	case SCAN_OP_OPEN:
+		if (cqe->res < 0) {
+			slot->item->error = cqe->res;
+			break;
+		}
+		slot->fd = cqe->res;
+		queue_read(ring, slot, HEADER_SCAN_SIZE);
+		break;
+	case SCAN_OP_STATX:
+		if (cqe->res == 0)
+			slot->item->size = slot->stx.stx_size;
+		break;
+	case SCAN_OP_READ:
+		wanted = classify(slot->item, slot->buffer, slot->wanted, cqe->res);
+		if (wanted > 0)
+			queue_read(ring, slot, wanted);
+		else {
+			/* the descriptor is the ring's to close from now on */
+			queue_op(ring, SCAN_OP_CLOSE, slot, slot->fd, NULL, 0, 0);
+			slot->fd = -1;
+		}
+		break;
+	case SCAN_OP_CLOSE:
+		break;
+	}
+	if (slot->pending == 0)
+		ring->free_slots[ring->free_count++] = slot - ring->slots;
+}
+
+/* scan_with_ring:
+ *   Returns false if the ring stopped working, in which case the files
+ *   must be scanned again in some other way.
+ */
+static bool
+scan_with_ring(ScanRing *ring, int dirfd, WinHeaderScan *items, size_t count)
+{
+	size_t next = 0;
+	unsigned to_submit, head, tail;
+	int res;
+
+	while (next < count || ring->free_count < SCAN_RING_SLOTS) {
+		while (next < count && ring->free_count > 0)
+			start_slot(ring, dirfd, &items[next++]);
+
+		/* entries the kernel could not take last time are still there */
+		to_submit = ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+		__atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+		res = syscall(__NR_io_uring_enter, ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (res < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			return false;
+
+		head = *ring->cq_head;
+		tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++)
+			complete_op(ring, &ring->cqes[head & ring->cq_mask]);
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+	}
+	return true;
+}
+
+/* abandon_scan_ring:
+ *   Free a ring that stopped working. The files that the completions
+ *   already posted have opened are closed, as well as those that were
+ *   opened before; the buffers of the slots with operations still in
+ *   flight are leaked, as the kernel may write to them.
+ */
+static void
+abandon_scan_ring(ScanRing *ring)
+{
+	const struct io_uring_cqe *cqe;
+	unsigned head, tail;
+	ScanSlot *slot;
+	int c;
+
+	head = *ring->cq_head;
+	tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		cqe = &ring->cqes[head & ring->cq_mask];
+		slot = &ring->slots[cqe->user_data >> 2];
+		slot->pending--;
+		if ((cqe->user_data & 3) == SCAN_OP_OPEN && cqe->res >= 0)
+			slot->fd = cqe->res;
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+	for (c = 0; c < SCAN_RING_SLOTS; c++) {
+		slot = &ring->slots[c];
+		if (slot->fd >= 0)
+			close(slot->fd);
+		slot->fd = -1;
+		if (slot->pending > 0)
+			slot->buffer = NULL;
+	}
+	free_scan_ring(ring);
+}
+
+#endif
+
+
+/* new_header_scanner:
+ *   Create a scanner that reads the headers with `threads' threads
+ *   (counting the caller of scan_headers()) if it cannot use io_uring.
+ */
+WinHeaderScanner *
+new_header_scanner(int threads, wres_error *err)
+{
+	WinHeaderScanner *hs;
+	int c;
+
+	if (threads < 1) {
+		if (err) *err = WRES_ERROR_INVALIDPARAM;
+		return NULL;
+	}
+	hs = xcalloc(1, sizeof(WinHeaderScanner));
+#ifdef HAVE_IO_URING
+	hs->ring = new_scan_ring();
+	if (hs->ring)
+		return hs;
+#endif
+
+	pthread_mutex_init(&hs->lock, NULL);
+	pthread_cond_init(&hs->start, NULL);
+	pthread_cond_init(&hs->finish, NULL);
+	hs->threads = xcalloc(threads, sizeof(pthread_t));
+	for (c = 0; c < threads - 1; c++) {
+		if (pthread_create(&hs->threads[c], NULL, pool_thread, hs) != 0)
+			break;
+		hs->thread_count++;
+	}
+	return hs;
+}
+
+void
+free_header_scanner(WinHeaderScanner *hs)
+{
+	int c;
+
+#ifdef HAVE_IO_URING
+	if (hs->ring) {
+		free_scan_ring(hs->ring);
+		free(hs);
+		return;
+	}
+#endif
+	pthread_mutex_lock(&hs->lock);
+	hs->quit = true;
+	pthread_cond_broadcast(&hs->start);
+	pthread_mutex_unlock(&hs->lock);
+	for (c = 0; c < hs->thread_count; c++)
+		pthread_join(hs->threads[c], NULL);
+	pthread_mutex_destroy(&hs->lock);
+	pthread_cond_destroy(&hs->start);
+	pthread_cond_destroy(&hs->finish);
+	free(hs->threads);
+	free(hs);
+}
+
+/* header_scanner_backend:
+ *   Returns "io_uring" or "pread", for diagnostics.
+ */
+const char *
+header_scanner_backend(const WinHeaderScanner *hs)
+{
+#ifdef HAVE_IO_URING
+	if (hs->ring)
+		return "io_uring";
+#endif
+	return "pread";
+}
+
+/* scan_headers:
+ *   Open the `count' files whose paths are relative to the directory
+ *   `dirfd' (or AT_FDCWD), and tell which are NE or PE modules. The
+ *   result for each file is put in its WinHeaderScan: no error and its
+ *   binary type if it passed the checks of load_library() on the
+ *   headers, WRES_ERROR_WRONGFORMAT if it did not, and an errno value if
+ *   it could not be read.
+ */
+void
+scan_headers(WinHeaderScanner *hs, int dirfd, WinHeaderScan *items, size_t count)
+{
+#ifdef HAVE_IO_URING
+	if (hs->ring) {
+		if (scan_with_ring(hs->ring, dirfd, items, count))
+			return;
+		/* do not use the ring again, and scan the whole batch again with
+		 * the threads */
+		abandon_scan_ring(hs->ring);
+		hs->ring = NULL;
+		pthread_mutex_init(&hs->lock, NULL);
+		pthread_cond_init(&hs->start, NULL);
+		pthread_cond_init(&hs->finish, NULL);
+	}
+#endif
+	scan_with_threads(hs, dirfd, items, count);
+}
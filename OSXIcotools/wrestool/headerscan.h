@@ -0,0 +1,51 @@
+/* headerscan.h - Batched reading of the headers of many files
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HEADERSCAN_H
+#define HEADERSCAN_H
+
+#include "wrestool.h"
+
+
+/* Most files are classified by their first HEADER_SCAN_SIZE bytes. More
+ * is read if the headers go further, up to HEADER_SCAN_MAX bytes; files
+ * with headers beyond that are reported as having the wrong format. */
+#define HEADER_SCAN_SIZE	(4096)
+#define HEADER_SCAN_MAX		(256 * 1024)
+
+/* scan_headers() works on up to HEADER_SCAN_BATCH files at once, so
+ * batches of this size keep it busy without waiting for a slot */
+#define HEADER_SCAN_BATCH	(128)
+
+typedef struct _WinHeaderScan {
+	const char *path;			/* in: relative to the directory scanned */
+	wres_error error;			/* out: WRES_ERROR_WRONGFORMAT if not a module */
+	int binary_type;			/* out: valid if there is no error */
+	uint64_t size;				/* out: size of the file, if known */
+} WinHeaderScan;
+
+typedef struct _WinHeaderScanner WinHeaderScanner;
+
+
+WinHeaderScanner *new_header_scanner(int, wres_error *);
+void free_header_scanner(WinHeaderScanner *);
+const char *header_scanner_backend(const WinHeaderScanner *);
+void scan_headers(WinHeaderScanner *, int, WinHeaderScan *, size_t);
+
+
+#endif
@@ -0,0 +1,306 @@
+/* libcache.c - Cache of loaded libraries shared by the requests of a process
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Finder asks for the thumbnail and the preview of a file one right
+ * after the other, often in the same process. This cache keeps the
+ * libraries loaded by the first request, by the identity of their file,
+ * so that the second one gets them with the resource directory already
+ * found and the sections already relocated.
+ *
+ * Libraries are handed out with a reference of their own, so dropping
+ * them from the cache never pulls them from under a user. The only
+ * change extraction makes to a library is the alpha fix of icons, which
+ * extract.c does under a lock, so a library can be used by several
+ * requests at once. Libraries are dropped when they have not been asked
+ * for in `max_age' seconds, and the least recently used ones when their
+ * total_size adds up to more than `max_bytes'. As in the result store,
+ * a library being loaded is waited for by the other threads that want
+ * it instead of being loaded twice. */
+
+#include <config.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "xalloc.h"			/* Gnulib */
+#include "filecache.h"
+#include "libcache.h"
+
+
+typedef struct _CachedLibrary {
+	struct _CachedLibrary *prev;	/* more recently used */
+	struct _CachedLibrary *next;	/* less recently used */
+	WinFileKey key;
+	WinLibrary *fl;				/* NULL while being loaded */
+	size_t size;
+	time_t last_used;
+} CachedLibrary;
+
+struct _WinLibraryCache {
+	pthread_mutex_t lock;
+	pthread_cond_t loaded;
+	CachedLibrary *first;		/* most recently used */
+	CachedLibrary *last;
+	size_t max_bytes;
+	unsigned max_age;
+	size_t bytes;
+	uint64_t entry_count;
+	uint64_t hits;
+	uint64_t misses;
+};
+
+
+static time_t
+now_seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/* new_library_cache:
+ *   Create a cache of up to about `max_bytes' of libraries, each kept
+ *   for `max_age' seconds after it was last asked for.
+ */
+WinLibraryCache *
+new_library_cache(size_t max_bytes, unsigned max_age)
+{
+	WinLibraryCache *lc = xcalloc(1, sizeof(WinLibraryCache));
+
+	pthread_mutex_init(&lc->lock, NULL);
+	pthread_cond_init(&lc->loaded, NULL);
+	lc->max_bytes = max_bytes;
+	lc->max_age = max_age;
+	return lc;
+}
+
+/* free_library_cache:
+ *   Drop the references of the cache and free it. No thread may be in
+ *   library_cache_open() at that point.
+ */
+void
+free_library_cache(WinLibraryCache *lc)
+{
+	CachedLibrary *e, *next;
+
+	for (e = lc->first; e != NULL; e = next) {
+		next = e->next;
+		free_winlibrary(e->fl);
+		free(e);
+	}
+	pthread_cond_destroy(&lc->loaded);
+	pthread_mutex_destroy(&lc->lock);
+	free(lc);
+}
+
+static void
+unlink_entry(WinLibraryCache *lc, CachedLibrary *e)
+{
+	if (e->prev)
+		e->prev->next = e->next;
+	else
+		lc->first = e->next;
+	if (e->next)
+		e->next->prev = e->prev;
+	else
+		lc->last = e->prev;
+	e->prev = e->next = NULL;
+}
+
+static void
+link_first(WinLibraryCache *lc, CachedLibrary *e)
+{
+	e->prev = NULL;
+	e->next = lc->first;
+	if (lc->first)
+		lc->first->prev = e;
+	else
+		lc->last = e;
+	lc->first = e;
+}
+
+static CachedLibrary *
+find_entry(WinLibraryCache *lc, const WinFileKey *key)
+{
+	CachedLibrary *e;
+
+	for (e = lc->first; e != NULL; e = e->next) {
+		if (memcmp(&e->key, key, sizeof(WinFileKey)) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+/* drop_entries:
+ *   Drop the libraries that are too old, then the least recently used
+ *   ones until the cache is back in its size. Libraries still being
+ *   loaded have no size and are never dropped. The references are
+ *   collected in `dropped', to be released without holding the lock.
+ */
+static size_t
+drop_entries(WinLibraryCache *lc, WinLibrary **dropped, size_t max_dropped)
+{
+	CachedLibrary *e, *prev;
+	time_t now = now_seconds();
+	size_t count = 0;
+
+	for (e = lc->last; e != NULL && count < max_dropped; e = prev) {
+		prev = e->prev;
+		if (e->fl == NULL)
+			continue;
+		if (now - e->last_used < (time_t) lc->max_age && lc->bytes <= lc->max_bytes)
+			break;
+		unlink_entry(lc, e);
+		lc->bytes -= e->size;
+		lc->entry_count--;
+		dropped[count++] = e->fl;
+		free(e);
+	}
+	return count;
+}
+
+#define DROP_BATCH	(16)
+
+static void
+drop_and_unlock(WinLibraryCache *lc)
+{
+	WinLibrary *dropped[DROP_BATCH];
+	size_t c, count;
+
+	do {
+		count = drop_entries(lc, dropped, DROP_BATCH);
+		pthread_mutex_unlock(&lc->lock);
+		/* unmapping a big library takes a while */
+		for (c = 0; c < count; c++)
+			free_winlibrary(dropped[c]);
+		if (count == DROP_BATCH)
+			pthread_mutex_lock(&lc->lock);
+	} while (count == DROP_BATCH);
+}
+
+/* load_entry:
+ *   Load the library of a placeholder entry, and put it in the cache if
+ *   the file is still the one the entry is for. Called without the lock.
+ */
+static WinLibrary *
+load_entry(WinLibraryCache *lc, CachedLibrary *e, const char *path, wres_error *err)
+{
+	WinLibrary *fl = NULL;
+	WinFileKey key;
+	struct stat st;
+	bool keep = false;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		if (err) *err = -errno;
+	} else if (fstat(fd, &st) != 0) {
+		if (err) *err = -errno;
+		close(fd);
+	} else {
+		file_cache_key_from_stat(&st, &key);
+		fl = new_winlibrary_from_fd(fd, path, err);
+		/* if the file changed since it was looked up, it is loaded
+		 * anyway, but not kept under the old key */
+		keep = fl != NULL && memcmp(&key, &e->key, sizeof(WinFileKey)) == 0 &&
+		    (size_t) fl->total_size <= lc->max_bytes;
+	}
+
+	pthread_mutex_lock(&lc->lock);
+	if (keep) {
+		e->fl = retain_winlibrary(fl);
+		e->size = fl->total_size;
+		e->last_used = now_seconds();
+		lc->bytes += e->size;
+	} else {
+		unlink_entry(lc, e);
+		lc->entry_count--;
+		free(e);
+	}
+	pthread_cond_broadcast(&lc->loaded);
+	drop_and_unlock(lc);
+	return fl;
+}
+
+/* library_cache_open:
+ *   Return the library at `path', loading it if it is not in the cache
+ *   or if its file has changed. The caller owns a reference, to be
+ *   dropped with free_winlibrary(). The library may be shared with other
+ *   threads, so it must not be reloaded.
+ */
+WinLibrary *
+library_cache_open(WinLibraryCache *lc, const char *path, wres_error *err)
+{
+	CachedLibrary *e;
+	WinFileKey key;
+	WinLibrary *fl;
+	wres_error e_key;
+
+	e_key = file_cache_key_for_path(path, &key);
+	if (e_key) {
+		if (err) *err = e_key;
+		return NULL;
+	}
+
+	pthread_mutex_lock(&lc->lock);
+	while ((e = find_entry(lc, &key)) != NULL && e->fl == NULL)
+		pthread_cond_wait(&lc->loaded, &lc->lock);
+	if (e != NULL) {
+		lc->hits++;
+		unlink_entry(lc, e);
+		link_first(lc, e);
+		e->last_used = now_seconds();
+		fl = retain_winlibrary(e->fl);
+		drop_and_unlock(lc);
+		return fl;
+	}
+
+	lc->misses++;
+	e = xcalloc(1, sizeof(CachedLibrary));
+	e->key = key;
+	link_first(lc, e);
+	lc->entry_count++;
+	pthread_mutex_unlock(&lc->lock);
+	return load_entry(lc, e, path, err);
+}
+
+/* library_cache_expire:
+ *   Drop the libraries that have not been asked for in a while. Meant to
+ *   be called from time to time, so that a process that has gone idle
+ *   does not keep them.
+ */
+void
+library_cache_expire(WinLibraryCache *lc)
+{
+	pthread_mutex_lock(&lc->lock);
+	drop_and_unlock(lc);
+}
+
+void
+library_cache_stats(WinLibraryCache *lc, WinLibraryCacheStats *stats)
+{
+	pthread_mutex_lock(&lc->lock);
+	stats->hits = lc->hits;
+	stats->misses = lc->misses;
+	stats->entries = lc->entry_count;
+	stats->bytes = lc->bytes;
+	pthread_mutex_unlock(&lc->lock);
+}
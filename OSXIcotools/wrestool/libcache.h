@@ -0,0 +1,42 @@
+/* libcache.h - Cache of loaded libraries shared by the requests of a process
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBCACHE_H
+#define LIBCACHE_H
+
+#include "wrestool.h"
+
+
+typedef struct _WinLibraryCacheStats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t entries;
+	uint64_t bytes;				/* total_size of the libraries kept */
+} WinLibraryCacheStats;
+
+typedef struct _WinLibraryCache WinLibraryCache;
+
+
+WinLibraryCache *new_library_cache(size_t, unsigned);
+void free_library_cache(WinLibraryCache *);
+WinLibrary *library_cache_open(WinLibraryCache *, const char *, wres_error *);
+void library_cache_expire(WinLibraryCache *);
+void library_cache_stats(WinLibraryCache *, WinLibraryCacheStats *);
+
+
+#endif
@@ -0,0 +1,521 @@
+/* manifest.c - Scanner for application manifests
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Manifests are XML, but only a handful of attributes are interesting
+ * and a lot of manifests found in the wild are not well-formed, so
+ * instead of parsing them properly the scanner looks at the tags one at
+ * a time and copies the interesting values straight into a
+ * WinManifestInfo, without allocating anything. Namespace prefixes are
+ * ignored and names are compared without regard to case. Nesting is only
+ * tracked for `dependency' elements, whose assembly identities are not
+ * the one of the application. When something is found twice, the first
+ * one wins. */
+
+#include <config.h>
+#include <ctype.h>
+#include <strings.h>
+#include "manifest.h"
+
+
+#define MANIFEST_EOF ((uint32_t) -1)
+
+enum {
+	MANIFEST_UTF8,
+	MANIFEST_UTF16LE,
+	MANIFEST_UTF16BE
+};
+
+enum {
+	ELEMENT_OTHER,
+	ELEMENT_EXECUTION_LEVEL,
+	ELEMENT_DPI_AWARE,
+	ELEMENT_DPI_AWARENESS,
+	ELEMENT_SUPPORTED_OS,
+	ELEMENT_ASSEMBLY_IDENTITY,
+	ELEMENT_DEPENDENCY
+};
+
+typedef struct {
+	const uint8_t *data;
+	size_t size;
+	size_t pos;
+	int encoding;
+} ManifestReader;
+
+
+static const struct {
+	const char *guid;
+	const char *name;
+} supported_os_names[] = {
+	{ "{e2011457-1546-43c5-a5fe-008deee3d3f0}", "Windows Vista" },
+	{ "{35138b9a-5d96-4fbd-8e2d-a2440225f93a}", "Windows 7" },
+	{ "{4a2f28e3-53b9-4441-ba9c-d69d4a4a6e38}", "Windows 8" },
+	{ "{1f676c76-80e1-4239-95bb-83d0f6d0da78}", "Windows 8.1" },
+	{ "{8e0f7a12-bfb3-4fe8-b9a5-48fd50a15a9a}", "Windows 10" },
+};
+
+
+/* read_char:
+ *   Decode the character at the current position and advance past it.
+ *   Invalid sequences are returned as U+FFFD.
+ */
+static uint32_t
+read_char(ManifestReader *r)
+{
+	uint32_t c, c2;
+	int i, n;
+
+	if (r->encoding != MANIFEST_UTF8) {
+		if (r->size - r->pos < 2) {
+			r->pos = r->size;
+			return MANIFEST_EOF;
+		}
+#define UNIT_AT(p) (r->encoding == MANIFEST_UTF16LE \
+		? (uint32_t) r->data[p] | (uint32_t) r->data[(p) + 1] << 8 \
+		: (uint32_t) r->data[p] << 8 | (uint32_t) r->data[(p) + 1])
+		c = UNIT_AT(r->pos);
+		r->pos += 2;
+		if (c < 0xD800 || c > 0xDFFF)
+			return c;
+		if (c <= 0xDBFF && r->size - r->pos >= 2) {
+			c2 = UNIT_AT(r->pos);
+			if (c2 >= 0xDC00 && c2 <= 0xDFFF) {
+				r->pos += 2;
+				return 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+			}
+		}
+#undef UNIT_AT
+		return 0xFFFD;
+	}
+
+	if (r->pos >= r->size)
+		return MANIFEST_EOF;
+	c = r->data[r->pos++];
+	if (c < 0x80)
+		return c;
+	if (c >= 0xC2 && c <= 0xDF) {
+		n = 1;
+		c &= 0x1F;
+	} else if (c >= 0xE0 && c <= 0xEF) {
+		n = 2;
+		c &= 0x0F;
+	} else if (c >= 0xF0 && c <= 0xF4) {
+		n = 3;
+		c &= 0x07;
+	} else {
+		return 0xFFFD;
+	}
+	for (i = 0; i < n; i++) {
+		if (r->pos >= r->size || (r->data[r->pos] & 0xC0) != 0x80)
+			return 0xFFFD;
+		c = (c << 6) | (r->data[r->pos++] & 0x3F);
+	}
+	if ((n == 2 && c < 0x800) || (n == 3 && (c < 0x10000 || c > 0x10FFFF))
+	    || (c >= 0xD800 && c <= 0xDFFF))
+		return 0xFFFD;
+	return c;
+}
+
+static uint32_t
+peek_char(ManifestReader *r)
+{
+	size_t pos = r->pos;
+	uint32_t c = read_char(r);
+
+	r->pos = pos;
+	return c;
+}
+
+static bool
+is_space(uint32_t c)
+{
+	/* NULs pad the end of many manifests */
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == 0;
+}
+
+static void
+skip_space(ManifestReader *r)
+{
+	while (is_space(peek_char(r)))
+		read_char(r);
+}
+
+/* skip_tag:
+ *   Skip to the first `>', or to the end of a comment.
+ */
+static void
+skip_tag(ManifestReader *r, bool comment)
+{
+	int dashes = 0;
+	uint32_t c;
+
+	while ((c = read_char(r)) != MANIFEST_EOF) {
+		if (c == '>' && (!comment || dashes >= 2))
+			return;
+		dashes = (c == '-') ? dashes + 1 : 0;
+	}
+}
+
+/* put_char:
+ *   Append a character to a NUL-terminated UTF-8 string in a buffer of
+ *   `size' bytes. Once a character does not fit, nothing else is added.
+ */
+static void
+put_char(char *buf, size_t size, size_t *len, uint32_t c)
+{
+	char tmp[4];
+	size_t n, i;
+
+	if (buf == NULL || *len >= size)
+		return;
+	if (c < 0x80) {
+		tmp[0] = c;
+		n = 1;
+	} else if (c < 0x800) {
+		tmp[0] = 0xC0 | (c >> 6);
+		tmp[1] = 0x80 | (c & 0x3F);
+		n = 2;
+	} else if (c < 0x10000) {
+		tmp[0] = 0xE0 | (c >> 12);
+		tmp[1] = 0x80 | ((c >> 6) & 0x3F);
+		tmp[2] = 0x80 | (c & 0x3F);
+		n = 3;
+	} else {
+		tmp[0] = 0xF0 | (c >> 18);
+		tmp[1] = 0x80 | ((c >> 12) & 0x3F);
+		tmp[2] = 0x80 | ((c >> 6) & 0x3F);
+		tmp[3] = 0x80 | (c & 0x3F);
+		n = 4;
+	}
+	if (n >= size - *len) {
+		buf[*len] = '\0';
+		*len = size;
+		return;
+	}
+	for (i = 0; i < n; i++)
+		buf[(*len)++] = tmp[i];
+	buf[*len] = '\0';
+}
+
+/* read_entity:
+ *   Decode the character reference or predefined entity after a `&'.
+ *   If it is not one, the `&' is taken literally.
+ */
+static uint32_t
+read_entity(ManifestReader *r)
+{
+	static const struct {
+		const char *name;
+		uint32_t c;
+	} entities[] = {
+		{ "amp", '&' }, { "lt", '<' }, { "gt", '>' }, { "quot", '"' }, { "apos", '\'' }
+	};
+	size_t start = r->pos;
+	char name[12];
+	uint32_t c, value = 0;
+	size_t len = 0, i;
+
+	while (len < sizeof(name) - 1) {
+		c = read_char(r);
+		if (c == ';') {
+			name[len] = '\0';
+			if (name[0] == '#') {
+				if (name[1] == 'x' || name[1] == 'X')
+					value = strtoul(name + 2, NULL, 16);
+				else
+					value = strtoul(name + 1, NULL, 10);
+				if (value != 0 && value <= 0x10FFFF && (value < 0xD800 || value > 0xDFFF))
+					return value;
+				break;
+			}
+			for (i = 0; i < sizeof(entities) / sizeof(entities[0]); i++) {
+				if (strcmp(name, entities[i].name) == 0)
+					return entities[i].c;
+			}
+			break;
+		}
+		if (c == MANIFEST_EOF || c >= 0x80)
+			break;
+		name[len++] = c;
+	}
+	r->pos = start;
+	return '&';
+}
+
+/* read_name:
+ *   Read an element or attribute name, lowercased and without namespace
+ *   prefix. Names too long to be interesting are cut.
+ */
+static void
+read_name(ManifestReader *r, char *name, size_t size)
+{
+	size_t len = 0;
+	uint32_t c;
+
+	for (;;) {
+		c = peek_char(r);
+		if (c == MANIFEST_EOF || is_space(c) || c == '>' || c == '/' || c == '=' || c == '<')
+			break;
+		read_char(r);
+		if (c == ':')
+			len = 0;
+		else if (len < size - 1)
+			name[len++] = (c < 0x80) ? tolower(c) : '?';
+	}
+	name[len] = '\0';
+}
+
+/* read_text:
+ *   Read a value up to `quote', which is consumed, or up to the first
+ *   space or `>' if `quote' is 0, or up to the next tag if `quote' is
+ *   `<'. A `<' always ends the value, since it cannot be in one unless
+ *   a quote is missing. Leading and trailing spaces are dropped. If
+ *   `buf' is NULL, the value is skipped.
+ */
+static void
+read_text(ManifestReader *r, uint32_t quote, char *buf, size_t size)
+{
+	size_t len = 0, keep = 0;
+	uint32_t c;
+
+	if (buf)
+		buf[0] = '\0';
+	for (;;) {
+		c = peek_char(r);
+		if (c == MANIFEST_EOF || c == '<')
+			break;
+		if (quote == 0 && (is_space(c) || c == '>'))
+			break;
+		read_char(r);
+		if (c == quote)
+			break;
+		if (c == '&')
+			c = read_entity(r);
+		if (is_space(c) && len == 0)
+			continue;
+		put_char(buf, size, &len, c);
+		if (!is_space(c))
+			keep = len;
+	}
+	if (buf && keep < size)
+		buf[keep] = '\0';
+}
+
+static int
+classify_element(const char *name)
+{
+	if (strcmp(name, "requestedexecutionlevel") == 0)
+		return ELEMENT_EXECUTION_LEVEL;
+	if (strcmp(name, "dpiaware") == 0)
+		return ELEMENT_DPI_AWARE;
+	if (strcmp(name, "dpiawareness") == 0)
+		return ELEMENT_DPI_AWARENESS;
+	if (strcmp(name, "supportedos") == 0)
+		return ELEMENT_SUPPORTED_OS;
+	if (strcmp(name, "assemblyidentity") == 0)
+		return ELEMENT_ASSEMBLY_IDENTITY;
+	if (strcmp(name, "dependency") == 0)
+		return ELEMENT_DEPENDENCY;
+	return ELEMENT_OTHER;
+}
+
+/* attribute_buffer:
+ *   Returns where the value of an attribute of an element should go, or
+ *   NULL if it is not interesting or was found already.
+ */
+static char *
+attribute_buffer(WinManifestInfo *info, int element, bool in_dependency, const char *attr, size_t *size)
+{
+	char *buf = NULL;
+
+#define MATCH(e, a, field) \
+	if (element == (e) && strcmp(attr, (a)) == 0) { \
+		buf = (field); \
+		*size = sizeof(field); \
+	}
+	MATCH(ELEMENT_EXECUTION_LEVEL, "level", info->execution_level);
+	if (!in_dependency) {
+		MATCH(ELEMENT_ASSEMBLY_IDENTITY, "name", info->assembly_name);
+		MATCH(ELEMENT_ASSEMBLY_IDENTITY, "version", info->assembly_version);
+		MATCH(ELEMENT_ASSEMBLY_IDENTITY, "processorarchitecture", info->assembly_architecture);
+		MATCH(ELEMENT_ASSEMBLY_IDENTITY, "type", info->assembly_type);
+		MATCH(ELEMENT_ASSEMBLY_IDENTITY, "publickeytoken", info->assembly_public_key_token);
+	}
+	if (element == ELEMENT_SUPPORTED_OS && strcmp(attr, "id") == 0
+	    && info->supported_os_count < MANIFEST_MAX_SUPPORTED_OS) {
+		buf = info->supported_os[info->supported_os_count];
+		*size = MANIFEST_GUID_SIZE;
+	}
+#undef MATCH
+
+	return (buf && buf[0] == '\0') ? buf : NULL;
+}
+
+/* scan_attributes:
+ *   Read the attributes of a start tag, storing the interesting ones.
+ *   Returns true if the element has no content.
+ */
+static bool
+scan_attributes(ManifestReader *r, WinManifestInfo *info, int element, bool in_dependency)
+{
+	char attr[32], value[8], *buf;
+	uint32_t c, quote;
+	size_t size = 0;
+
+	for (;;) {
+		skip_space(r);
+		c = peek_char(r);
+		if (c == MANIFEST_EOF)
+			return true;
+		if (c == '<')
+			return false;		/* unterminated tag */
+		if (c == '>') {
+			read_char(r);
+			return false;
+		}
+		if (c == '/') {
+			read_char(r);
+			if (peek_char(r) == '>')
+				read_char(r);
+			return true;
+		}
+
+		read_name(r, attr, sizeof(attr));
+		if (attr[0] == '\0') {
+			read_char(r);		/* a stray `=' or garbage */
+			continue;
+		}
+		skip_space(r);
+		if (peek_char(r) != '=')
+			continue;
+		read_char(r);
+		skip_space(r);
+		quote = peek_char(r);
+		if (quote == '"' || quote == '\'')
+			read_char(r);
+		else
+			quote = 0;
+
+		if (element == ELEMENT_EXECUTION_LEVEL && strcmp(attr, "uiaccess") == 0 && !info->has_ui_access) {
+			read_text(r, quote, value, sizeof(value));
+			info->has_ui_access = true;
+			info->ui_access = strcasecmp(value, "true") == 0;
+			continue;
+		}
+		buf = attribute_buffer(info, element, in_dependency, attr, &size);
+		read_text(r, quote, buf, size);
+		if (buf && element == ELEMENT_SUPPORTED_OS && buf[0] != '\0')
+			info->supported_os_count++;
+	}
+}
+
+/* scan_manifest:
+ *   Find the execution level, DPI awareness, supported operating systems
+ *   and assembly identity in a manifest of `size' bytes, in UTF-8 or
+ *   UTF-16 with or without BOM.
+ */
+wres_error
+scan_manifest(const void *data, size_t size, WinManifestInfo *info)
+{
+	ManifestReader r;
+	char name[32];
+	int element, dependency_depth = 0;
+	bool found = false, empty;
+	uint32_t c;
+
+	memset(info, 0, sizeof(WinManifestInfo));
+	r.data = data;
+	r.size = size;
+	r.pos = 0;
+	r.encoding = MANIFEST_UTF8;
+	if (size >= 3 && r.data[0] == 0xEF && r.data[1] == 0xBB && r.data[2] == 0xBF) {
+		r.pos = 3;
+	} else if (size >= 2 && r.data[0] == 0xFF && r.data[1] == 0xFE) {
+		r.encoding = MANIFEST_UTF16LE;
+		r.pos = 2;
+	} else if (size >= 2 && r.data[0] == 0xFE && r.data[1] == 0xFF) {
+		r.encoding = MANIFEST_UTF16BE;
+		r.pos = 2;
+	} else if (size >= 2 && r.data[0] != 0 && r.data[1] == 0) {
+		r.encoding = MANIFEST_UTF16LE;
+	} else if (size >= 2 && r.data[0] == 0 && r.data[1] != 0) {
+		r.encoding = MANIFEST_UTF16BE;
+	}
+
+	while ((c = read_char(&r)) != MANIFEST_EOF) {
+		if (c != '<')
+			continue;
+
+		c = peek_char(&r);
+		if (c == '!') {
+			read_char(&r);
+			if (peek_char(&r) == '-') {
+				read_char(&r);
+				skip_tag(&r, peek_char(&r) == '-');
+			} else {
+				skip_tag(&r, false);
+			}
+			continue;
+		}
+		if (c == '?') {
+			skip_tag(&r, false);
+			continue;
+		}
+		if (c == '/') {
+			read_char(&r);
+			read_name(&r, name, sizeof(name));
+			if (classify_element(name) == ELEMENT_DEPENDENCY && dependency_depth > 0)
+				dependency_depth--;
+			skip_tag(&r, false);
+			continue;
+		}
+
+		read_name(&r, name, sizeof(name));
+		if (name[0] == '\0')
+			continue;
+		found = true;
+		element = classify_element(name);
+		empty = scan_attributes(&r, info, element, dependency_depth > 0);
+		if (empty)
+			continue;
+		if (element == ELEMENT_DEPENDENCY)
+			dependency_depth++;
+		else if (element == ELEMENT_DPI_AWARE && info->dpi_aware[0] == '\0')
+			read_text(&r, '<', info->dpi_aware, sizeof(info->dpi_aware));
+		else if (element == ELEMENT_DPI_AWARENESS && info->dpi_awareness[0] == '\0')
+			read_text(&r, '<', info->dpi_awareness, sizeof(info->dpi_awareness));
+	}
+
+	return found ? WRES_ERROR_NONE : WRES_ERROR_WRONGFORMAT;
+}
+
+/* manifest_os_name:
+ *   Returns the name of the operating system with a supportedOS GUID, or
+ *   NULL if it is not known. Windows 11 uses the same GUID as Windows 10.
+ */
+const char *
+manifest_os_name(const char *guid)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(supported_os_names) / sizeof(supported_os_names[0]); i++) {
+		if (strcasecmp(guid, supported_os_names[i].guid) == 0)
+			return supported_os_names[i].name;
+	}
+	return NULL;
+}
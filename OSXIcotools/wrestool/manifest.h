@@ -0,0 +1,51 @@
+/* manifest.h - Scanner for application manifests
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "wrestool.h"
+
+
+#define MANIFEST_MAX_SUPPORTED_OS	(8)
+#define MANIFEST_GUID_SIZE			(40)	/* `{xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}' */
+
+/* What scan_manifest() found. Every string is UTF-8 and NUL-terminated;
+ * it is empty if the attribute or element was not found, and cut if it
+ * did not fit. */
+typedef struct _WinManifestInfo {
+	char execution_level[32];		/* asInvoker, highestAvailable, requireAdministrator */
+	bool has_ui_access;
+	bool ui_access;
+	char dpi_aware[32];				/* true, true/pm, per monitor... */
+	char dpi_awareness[64];			/* PerMonitorV2, PerMonitor... */
+	char assembly_name[256];
+	char assembly_version[32];
+	char assembly_architecture[16];
+	char assembly_type[16];
+	char assembly_public_key_token[24];
+	char supported_os[MANIFEST_MAX_SUPPORTED_OS][MANIFEST_GUID_SIZE];
+	int supported_os_count;
+} WinManifestInfo;
+
+
+wres_error scan_manifest(const void *, size_t, WinManifestInfo *);
+const char *manifest_os_name(const char *);
+
+
+#endif
@@ -0,0 +1,495 @@
+/* metadata.c - Per-library metadata as JSON
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "xalloc.h"			/* Gnulib */
+#include "common/codepages.h"
+#include "common/intutil.h"
+#include "common/jsonwriter.h"
+#include "common/sha256.h"
+#include "common/xxhash.h"
+#include "restable.h"
+#include "restypes.h"
+#include "extract.h"
+#include "manifest.h"
+#include "cancel.h"
+#include "verinfo.h"
+#include "metadata.h"
+
+
+/* Version strings are converted to UTF-8 in a buffer that is reused for
+ * all of them. */
+typedef struct {
+	JSONWriter *w;
+	const WinVersionInfo *vi;
+	uint16_t codepage;
+	char *scratch;
+	size_t scratch_size;
+} VersionWriter;
+
+
+static const char *
+binary_format_name(int binary_type)
+{
+	switch (binary_type) {
+		case NE_BINARY: return "NE";
+		case PE_BINARY: return "PE32";
+		case PEPLUS_BINARY: return "PE32+";
+	}
+	return NULL;
+}
+
+static size_t
+version_text_to_scratch(VersionWriter *vw, const WinVerText *text)
+{
+	size_t len = version_info_text_utf8_length(vw->vi, text, vw->codepage);
+
+	if (len > vw->scratch_size) {
+		vw->scratch_size = len;
+		vw->scratch = xrealloc(vw->scratch, len);
+	}
+	return version_info_text_to_utf8(vw->vi, vw->scratch, len, text, vw->codepage);
+}
+
+static void
+write_version_text(VersionWriter *vw, const WinVerText *text)
+{
+	size_t len = version_text_to_scratch(vw, text);
+	json_string(vw->w, vw->scratch, len);
+}
+
+static void
+write_version_key(VersionWriter *vw, const WinVerText *text)
+{
+	size_t len = version_text_to_scratch(vw, text);
+	json_key_string(vw->w, vw->scratch, len);
+}
+
+static void
+write_version_number(JSONWriter *w, const uint16_t *v)
+{
+	char buf[24];
+
+	snprintf(buf, sizeof(buf), "%u.%u.%u.%u", v[0], v[1], v[2], v[3]);
+	json_cstring(w, buf);
+}
+
+static void
+write_fixed_info(JSONWriter *w, const WinVersionInfo *vi)
+{
+	json_key(w, "file_version");
+	write_version_number(w, vi->file_version);
+	json_key(w, "file_version_number");
+	json_uint(w, version_info_pack_version(vi->file_version));
+	json_key(w, "product_version");
+	write_version_number(w, vi->product_version);
+	json_key(w, "product_version_number");
+	json_uint(w, version_info_pack_version(vi->product_version));
+
+	json_key(w, "file_flags");
+	json_begin_object(w);
+	json_key(w, "debug");
+	json_bool(w, vi->file_flags & VS_FF_DEBUG);
+	json_key(w, "prerelease");
+	json_bool(w, vi->file_flags & VS_FF_PRERELEASE);
+	json_key(w, "patched");
+	json_bool(w, vi->file_flags & VS_FF_PATCHED);
+	json_key(w, "private_build");
+	json_bool(w, vi->file_flags & VS_FF_PRIVATEBUILD);
+	json_key(w, "special_build");
+	json_bool(w, vi->file_flags & VS_FF_SPECIALBUILD);
+	json_end_object(w);
+
+	json_key(w, "file_os");
+	json_uint(w, vi->fixed_info.file_os);
+	json_key(w, "file_os_name");
+	json_cstring(w, version_info_os_name(vi->fixed_info.file_os));
+	json_key(w, "file_type");
+	json_uint(w, vi->fixed_info.file_type);
+	json_key(w, "file_type_name");
+	json_cstring(w, version_info_file_type_name(vi->fixed_info.file_type));
+	json_key(w, "file_subtype");
+	json_uint(w, vi->fixed_info.file_subtype);
+}
+
+/* write_version_info:
+ *   Write the version resource that suits best a reader with no language
+ *   preference, with all of its string tables. Writes null if the library
+ *   has no version information.
+ */
+static void
+write_version_info(JSONWriter *w, WinLibrary *fi)
+{
+	VersionWriter vw;
+	WinVersionInfo *vi = NULL;
+	WinResource *wr;
+	const void *data;
+	size_t size;
+	uint16_t lang = 0;
+	int t, c;
+
+	wr = find_version_resource(fi, NULL, 0, NULL);
+	if (wr != NULL) {
+		data = get_resource_entry(fi, wr, &size, NULL);
+		if (data != NULL)
+			vi = new_version_info(data, size, fi->binary_type == NE_BINARY, NULL);
+		if (wr->numeric_id)
+			parse_uint16(wr->id, &lang);
+		free(wr);
+	}
+	if (vi == NULL) {
+		json_null(w);
+		return;
+	}
+
+	json_begin_object(w);
+	json_key(w, "lang");
+	json_uint(w, lang);
+	if (vi->has_fixed_info)
+		write_fixed_info(w, vi);
+
+	memset(&vw, 0, sizeof(vw));
+	vw.w = w;
+	vw.vi = vi;
+	json_key(w, "string_tables");
+	json_begin_array(w);
+	for (t = 0; t < vi->string_table_count; t++) {
+		const WinVerStringTable *table = &vi->string_tables[t];
+
+		vw.codepage = version_info_codepage(vi, table);
+		json_begin_object(w);
+		json_key(w, "name");
+		write_version_text(&vw, &table->name);
+		json_key(w, "lang");
+		json_uint(w, table->lang);
+		json_key(w, "codepage");
+		json_uint(w, table->codepage);
+		json_key(w, "strings");
+		json_begin_object(w);
+		for (c = 0; c < table->count; c++) {
+			write_version_key(&vw, &table->strings[c].key);
+			write_version_text(&vw, &table->strings[c].value);
+		}
+		json_end_object(w);
+		json_end_object(w);
+	}
+	json_end_array(w);
+	json_end_object(w);
+
+	free(vw.scratch);
+	free_version_info(vi);
+}
+
+static void
+write_optional_string(JSONWriter *w, const char *key, const char *value)
+{
+	if (value[0] == '\0')
+		return;
+	json_key(w, key);
+	json_cstring(w, value);
+}
+
+/* write_manifest:
+ *   Write what scan_manifest() finds in the first RT_MANIFEST resource,
+ *   or null if there is none.
+ */
+static void
+write_manifest(JSONWriter *w, WinLibrary *fi)
+{
+	WinManifestInfo info;
+	WinResource *wr;
+	const void *data = NULL;
+	size_t size;
+	int level, c;
+
+	wr = find_resource(fi, "24", "", "", &level, NULL);
+	if (wr != NULL) {
+		if (!wr->is_directory)
+			data = get_resource_entry(fi, wr, &size, NULL);
+		free(wr);
+	}
+	if (data == NULL || scan_manifest(data, size, &info) != WRES_ERROR_NONE) {
+		json_null(w);
+		return;
+	}
+
+	json_begin_object(w);
+	write_optional_string(w, "execution_level", info.execution_level);
+	if (info.has_ui_access) {
+		json_key(w, "ui_access");
+		json_bool(w, info.ui_access);
+	}
+	write_optional_string(w, "dpi_aware", info.dpi_aware);
+	write_optional_string(w, "dpi_awareness", info.dpi_awareness);
+	write_optional_string(w, "assembly_name", info.assembly_name);
+	write_optional_string(w, "assembly_version", info.assembly_version);
+	write_optional_string(w, "assembly_architecture", info.assembly_architecture);
+	write_optional_string(w, "assembly_type", info.assembly_type);
+	write_optional_string(w, "assembly_public_key_token", info.assembly_public_key_token);
+	json_key(w, "supported_os");
+	json_begin_array(w);
+	for (c = 0; c < info.supported_os_count; c++)
+		json_cstring(w, info.supported_os[c]);
+	json_end_array(w);
+	json_end_object(w);
+}
+
+/* write_icon:
+ *   Write the size and depth of the best image of the first icon, and
+ *   the XXH64 of its data as stored in the library, which identifies
+ *   the same icon across files. Writes null if there is no icon.
+ */
+static void
+write_icon(JSONWriter *w, WinLibrary *fi)
+{
+	WinIconImage img;
+	WinResource *wr;
+	char digest[24];
+	int level;
+
+	wr = find_resource(fi, "14", "", "", &level, NULL);
+	if (wr == NULL || wr->is_directory || find_best_group_icon_image(fi, wr, &img) != WRES_ERROR_NONE) {
+		free(wr);
+		json_null(w);
+		return;
+	}
+	free(wr);
+
+	json_begin_object(w);
+	json_key(w, "width");
+	json_uint(w, img.width);
+	json_key(w, "height");
+	json_uint(w, img.height);
+	json_key(w, "bit_count");
+	json_uint(w, img.bit_count);
+	json_key(w, "png");
+	json_bool(w, img.is_png);
+	json_key(w, "size");
+	json_uint(w, img.size);
+	json_key(w, "xxh64");
+	snprintf(digest, sizeof(digest), "%016llx", (unsigned long long) xxh64(img.data, img.size, 0));
+	json_cstring(w, digest);
+	json_end_object(w);
+}
+
+/* count_leaves:
+ *   Returns the number of resources (in all languages) under a type
+ *   directory.
+ */
+static int
+count_leaves(WinLibrary *fi, WinResource *type_wr)
+{
+	WinResource *name_wr, *lang_wr;
+	int c, name_count, lang_count, res = 0;
+
+	name_wr = list_resources(fi, type_wr, &name_count, NULL);
+	if (name_wr == NULL)
+		return 0;
+	for (c = 0; c < name_count; c++) {
+		if (!name_wr[c].is_directory) {
+			res++;
+			continue;
+		}
+		lang_wr = list_resources(fi, &name_wr[c], &lang_count, NULL);
+		if (lang_wr != NULL) {
+			res += lang_count;
+			free(lang_wr);
+		}
+	}
+	free(name_wr);
+	return res;
+}
+
+/* write_resource_summary:
+ *   Write how many resources of each type the library has. Types are
+ *   named as with the --type option when they are known. The names of
+ *   NE resources are in the ANSI code page, not in UTF-8.
+ */
+static void
+write_resource_summary(JSONWriter *w, WinLibrary *fi)
+{
+	WinResource *type_wr;
+	const char *name;
+	char *utf8;
+	int c, type_count, count, total = 0;
+	uint16_t type;
+
+	json_begin_object(w);
+	json_key(w, "types");
+	json_begin_object(w);
+	type_wr = list_resources(fi, NULL, &type_count, NULL);
+	for (c = 0; type_wr != NULL && c < type_count; c++) {
+		name = NULL;
+		if (type_wr[c].numeric_id && parse_uint16(type_wr[c].id, &type))
+			name = res_type_id_to_string(type);
+		count = count_leaves(fi, &type_wr[c]);
+		if (name == NULL && fi->binary_type == NE_BINARY) {
+			utf8 = codepage_to_utf8_dup(CODEPAGE_DEFAULT, type_wr[c].id, strlen(type_wr[c].id), NULL);
+			json_key(w, utf8);
+			free(utf8);
+		} else {
+			json_key(w, name ? name : type_wr[c].id);
+		}
+		json_uint(w, count);
+		total += count;
+	}
+	free(type_wr);
+	json_end_object(w);
+	json_key(w, "total");
+	json_uint(w, total);
+	json_end_object(w);
+}
+
+/* write_resource_metadata:
+ *   Write the members of the metadata object that depend only on the
+ *   resources of the library.
+ */
+static void
+write_resource_metadata(JSONWriter *w, WinLibrary *fi)
+{
+	json_key(w, "version_info");
+	write_version_info(w, fi);
+	json_key(w, "manifest");
+	write_manifest(w, fi);
+	json_key(w, "icon");
+	write_icon(w, fi);
+	json_key(w, "resources");
+	write_resource_summary(w, fi);
+}
+
+/* write_hashes:
+ *   Write the hashes computed when the file was loaded, and how long
+ *   they took, from which the throughput can be worked out.
+ */
+static void
+write_hashes(JSONWriter *w, const WinFileHashes *h)
+{
+	char hex[SHA256_DIGEST_SIZE * 2 + 1];
+	int i;
+
+	json_begin_object(w);
+	if (h->computed & WRES_HASH_SHA256) {
+		for (i = 0; i < SHA256_DIGEST_SIZE; i++)
+			snprintf(hex + i * 2, 3, "%02x", h->sha256[i]);
+		json_key(w, "sha256");
+		json_cstring(w, hex);
+	}
+	if (h->computed & WRES_HASH_XXH64_TREE) {
+		snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) h->xxh64_tree);
+		json_key(w, "xxh64_tree");
+		json_cstring(w, hex);
+	}
+	json_key(w, "microseconds");
+	json_uint(w, h->microseconds);
+	json_end_object(w);
+}
+
+static const int bitnesses[] = {16, 32, 64};
+
+static void
+write_file_metadata(JSONWriter *w, WinLibrary *fi)
+{
+	json_key(w, "name");
+	json_cstring(w, fi->name);
+	json_key(w, "format");
+	json_cstring(w, binary_format_name(fi->binary_type));
+	json_key(w, "bitness");
+	json_uint(w, bitnesses[fi->binary_type]);
+	json_key(w, "file_size");
+	json_uint(w, fi->file_size);
+	if (fi->hashes.computed) {
+		json_key(w, "hashes");
+		write_hashes(w, &fi->hashes);
+	}
+}
+
+/* write_library_metadata:
+ *   Append a JSON object describing a library to `w': its format, the
+ *   fixed and string version information, the interesting parts of the
+ *   manifest, a digest of the icon and how many resources of each type
+ *   it contains. The hashes of the file are added if fi->hashes.computed
+ *   is set, that is if the library was loaded with hashing on. Nothing
+ *   is written after the object, so batch tools can end each one with
+ *   json_end_line() to get NDJSON.
+ */
+void
+write_library_metadata(JSONWriter *w, WinLibrary *fi)
+{
+	json_begin_object(w);
+	write_file_metadata(w, fi);
+	write_resource_metadata(w, fi);
+	json_end_object(w);
+}
+
+/* write_library_metadata_using_store:
+ *   Like write_library_metadata(), but the part that depends only on the
+ *   resources is copied from `store' if a library with the same
+ *   resources has been written before, and put there otherwise.
+ */
+void
+write_library_metadata_using_store(JSONWriter *w, WinLibrary *fi, WinResultStore *store)
+{
+	JSONWriter part;
+	void *data;
+	size_t size;
+
+	json_begin_object(w);
+	write_file_metadata(w, fi);
+	data = result_store_get(store, fi->resource_digest, &size);
+	if (data != NULL) {
+		json_raw(w, data, size);
+		free(data);
+	} else {
+		json_writer_init(&part);
+		write_resource_metadata(&part, fi);
+		/* what was cut short by a cancellation is not for keeping */
+		if (wres_cancelled())
+			result_store_abandon(store, fi->resource_digest);
+		else
+			result_store_put(store, fi->resource_digest, part.data, part.size);
+		json_raw(w, part.data, part.size);
+		json_writer_free(&part);
+	}
+	json_end_object(w);
+}
+
+/* write_header_scan_metadata:
+ *   Append a JSON object with what scan_headers() found out about a
+ *   file: its format and bitness, as in write_library_metadata(), or
+ *   the error, and the size of the file (not of the loaded image).
+ */
+void
+write_header_scan_metadata(JSONWriter *w, const WinHeaderScan *item)
+{
+	json_begin_object(w);
+	json_key(w, "name");
+	json_cstring(w, item->path);
+	if (item->error != WRES_ERROR_NONE) {
+		json_key(w, "error");
+		json_cstring(w, wres_strerr(item->error));
+	} else {
+		json_key(w, "format");
+		json_cstring(w, binary_format_name(item->binary_type));
+		json_key(w, "bitness");
+		json_uint(w, bitnesses[item->binary_type]);
+	}
+	json_key(w, "file_size");
+	json_uint(w, item->size);
+	json_end_object(w);
+}
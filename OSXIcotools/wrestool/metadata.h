@@ -0,0 +1,33 @@
+/* metadata.h - Per-library metadata as JSON
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METADATA_H
+#define METADATA_H
+
+#include "common/jsonwriter.h"
+#include "wrestool.h"
+#include "headerscan.h"
+#include "resultstore.h"
+
+
+void write_library_metadata(JSONWriter *, WinLibrary *);
+void write_library_metadata_using_store(JSONWriter *, WinLibrary *, WinResultStore *);
+void write_header_scan_metadata(JSONWriter *, const WinHeaderScan *);
+
+
+#endif
@@ -29,6 +29,9 @@ extern NSString const *EIIcotoolsErrorDomain;
 
 
 NSData *get_resource_data (WinLibrary *, char *, char *, char *, wres_error *);
+NSData *get_resource_data_for_entry (WinLibrary *, WinResource *, char *, char *, wres_error *);
+NSData *get_icon_png_data (WinLibrary *, char *, char *, wres_error *);
+NSData *get_animated_icon_data (WinLibrary *, char *, char *, wres_error *);
 NSError *nserror_from_wreserror(wres_error err);
 
 #endif
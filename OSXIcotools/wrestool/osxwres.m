@@ -22,17 +22,26 @@
 #include "restypes.h"
 #include "restable.h"
 #include "extract.h"
+#include "anicursor.h"
 
 
 NSString *EIIcotoolsErrorDomain = @"EIErrorDomain";
 
 
+/* Wraps memory belonging to a WinLibrary without copying it. The NSData
+ * keeps a reference to the library, so it can outlive its owner. */
+static NSData *borrowed_resource_data(WinLibrary *fi, const void *memory, size_t size)
+{
+  retain_winlibrary(fi);
+  return [[NSData alloc] initWithBytesNoCopy:(void *)memory length:size deallocator:^(void *bytes, NSUInteger length) {
+    free_winlibrary(fi);
+  }];
+}
+
+
 NSData *get_resource_data(WinLibrary *fi, char *type, char *name, char *lang, wres_error *err)
 {
   int level;
-  size_t size;
-  bool free_it;
-  void *memory;
   WinResource* wr;
   NSData *icoData;
   
@@ -44,16 +53,81 @@ NSData *get_resource_data(WinLibrary *fi, char *type, char *name, char *lang, wr
   if (!wr)
     return NULL;
   
+  icoData = get_resource_data_for_entry(fi, wr, type, lang, err);
+  free(wr);
+  return icoData;
+}
+
+
+NSData *get_resource_data_for_entry(WinLibrary *fi, WinResource *wr, char *type, char *lang, wres_error *err)
+{
+  size_t size;
+  bool free_it;
+  void *memory;
+  
+  if (lang == NULL) lang = "";
+  
   memory = extract_resource(fi, wr, &size, &free_it, type, lang, false, err);
   if (!memory)
     return NULL;
   
-  if (free_it) {
-    icoData = [[NSData alloc] initWithBytesNoCopy:memory length:size freeWhenDone:YES];
-  } else {
-    icoData = [[NSData alloc] initWithBytes:memory length:size];
+  if (free_it)
+    return [[NSData alloc] initWithBytesNoCopy:memory length:size freeWhenDone:YES];
+  return borrowed_resource_data(fi, memory, size);
+}
+
+
+NSData *get_icon_png_data(WinLibrary *fi, char *name, char *lang, wres_error *err)
+{
+  int level;
+  size_t size;
+  const void *memory;
+  WinResource* wr;
+  
+  if (name == NULL) name = "";
+  if (lang == NULL) lang = "";
+  
+  wr = find_resource(fi, "14", name, lang, &level, err);
+  if (!wr)
+    return NULL;
+  
+  memory = extract_group_icon_png(fi, wr, &size, err);
+  free(wr);
+  if (!memory)
+    return NULL;
+  
+  return borrowed_resource_data(fi, memory, size);
+}
+
+
+/* Returns the best image of the first frame of an animated icon, as an
+ * `.ico' file or a PNG, for executables that have no static icon. */
+NSData *get_animated_icon_data(WinLibrary *fi, char *name, char *lang, wres_error *err)
+{
+  int level;
+  size_t size;
+  void *memory;
+  WinResource* wr;
+  WinResourceVec vec;
+  wres_error verr;
+  
+  if (name == NULL) name = "";
+  if (lang == NULL) lang = "";
+  
+  wr = find_resource(fi, "22", name, lang, &level, err);
+  if (!wr)
+    return NULL;
+  
+  verr = extract_ani_frame_vec(fi, wr, true, &vec);
+  free(wr);
+  if (verr != WRES_ERROR_NONE) {
+    if (err) *err = verr;
+    return NULL;
   }
-  return icoData;
+  
+  memory = flatten_resource_vec(&vec, &size);
+  free_resource_vec(&vec);
+  return [[NSData alloc] initWithBytesNoCopy:memory length:size freeWhenDone:YES];
 }
 
 
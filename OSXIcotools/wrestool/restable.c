@@ -23,12 +23,14 @@
 #define _(s) gettext(s)
 #define N_(s) gettext_noop(s)
 #include "common/intutil.h"
+#include "common/utf16.h"
 #include "xalloc.h"		/* Gnulib */
 #include "minmax.h"		/* Gnulib */
 #include "wrestool.h"
 #include "win32.h"
 #include "fileread.h"
 #include "restypes.h"
+#include "cancel.h"
 //#include "common/common.h"
 
 static bool decode_pe_resource_id (WinLibrary *, WinResource *, uint32_t);
@@ -91,6 +93,8 @@ do_resources_recurs (WinLibrary *fi, WinResource *base, WinResource *type_wr,
 
 	/* process each resource listed */
 	for (c = 0 ; c < rescnt ; c++) {
+		if (wres_cancelled())
+			return WRES_ERROR_CANCELLED;
 		/* (over)write the corresponding WinResource holder with the current */
 		memcpy(WINRESOURCE_BY_LEVEL(wr[c].level), wr+c, sizeof(WinResource));
 		if ((base && (wr[c].level <= base->level))
@@ -191,7 +195,7 @@ static bool
 decode_pe_resource_id (WinLibrary *fi, WinResource *wr, uint32_t value)
 {
 	if (value & IMAGE_RESOURCE_NAME_IS_STRING) {	/* numeric id */
-		int c, len;
+		size_t len;
 		uint16_t *mem = (uint16_t *)
 		  (fi->first_resource + (value & ~IMAGE_RESOURCE_NAME_IS_STRING));
 
@@ -200,9 +204,8 @@ decode_pe_resource_id (WinLibrary *fi, WinResource *wr, uint32_t value)
 		len = mem[0];
 		RETURN_IF_BAD_OFFSET(fi, false, &mem[1], sizeof(uint16_t) * len);
 
-		len = MIN(mem[0], WINRES_ID_MAXLEN);
-		for (c = 0 ; c < len ; c++)
-			wr->id[c] = mem[c+1] & 0x00FF;
+		/* names longer than the buffer are cut at a character boundary */
+		len = utf16le_to_utf8(wr->id, sizeof(wr->id) - 1, &mem[1], len);
 		wr->id[len] = '\0';
 	} else {					/* Unicode string id */
 		/* translate id into a string */
@@ -291,6 +294,11 @@ list_pe_resources (WinLibrary *fi, Win32ImageResourceDirectory *pe_res, int leve
 	/* fill in the WinResource's */
     out_c = 0;
     for (dirent_c = 0 ; dirent_c < rescnt ; dirent_c++) {
+		if (dirent_c % CANCEL_CHECK_ENTRIES == CANCEL_CHECK_ENTRIES - 1 && wres_cancelled()) {
+			free(wr);
+			if (err) *err = WRES_ERROR_CANCELLED;
+			return NULL;
+		}
 		RET_NULL_AND_SET_ERR_IF_BAD_POINTER(fi, err, dirent[dirent_c]);
 		wr[out_c].this = pe_res;
 		wr[out_c].level = level;
@@ -337,6 +345,11 @@ list_ne_name_resources (WinLibrary *fi, WinResource *typeres, int *count, wres_e
 
 	/* fill in the WinResource's */
 	for (c = 0 ; c < rescnt ; c++) {
+		if (c % CANCEL_CHECK_ENTRIES == CANCEL_CHECK_ENTRIES - 1 && wres_cancelled()) {
+			free(wr);
+			if (err) *err = WRES_ERROR_CANCELLED;
+			return NULL;
+		}
 		RET_NULL_AND_SET_ERR_IF_BAD_POINTER(fi, err, nameinfo[c]);
 		wr[c].this = nameinfo+c;
 		wr[c].is_directory = false;
@@ -366,6 +379,10 @@ list_ne_type_resources(WinLibrary *fi, int *count, wres_error *err)
 	RET_NULL_AND_SET_ERR_IF_BAD_POINTER(fi, err, *typeinfo);
 	
 	for (rescnt = 0 ; typeinfo->type_id != 0 ; rescnt++) {
+		if (rescnt % CANCEL_CHECK_ENTRIES == CANCEL_CHECK_ENTRIES - 1 && wres_cancelled()) {
+			if (err) *err = WRES_ERROR_CANCELLED;
+			return NULL;
+		}
 		if (((char *) NE_TYPEINFO_NEXT(typeinfo))+sizeof(uint16_t) > fi->memory + fi->total_size) {
 			if (err) *err = WRES_ERROR_INVALIDRESTABLE;
 		    return NULL;
@@ -411,6 +428,10 @@ list_ne_type_resources(WinLibrary *fi, int *count, wres_error *err)
 /*static*/ WinResource *
 list_resources(WinLibrary *fi, WinResource *res, int *count, wres_error *err)
 {
+	if (wres_cancelled()) {
+		if (err) *err = WRES_ERROR_CANCELLED;
+		return NULL;
+	}
 	if (res != NULL && !res->is_directory) {
 		if (err) *err = WRES_ERROR_INVALIDPARAM;
 		return NULL;
@@ -455,6 +476,7 @@ find_with_resource_array(WinLibrary *fi, WinResource *wr, const char *id, wres_e
 		}
 	}
 
+	free(wr);
 	if (err) *err = WRES_ERROR_RESNOTFOUND;
 	return NULL;
 }
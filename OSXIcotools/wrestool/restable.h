@@ -29,6 +29,7 @@ void print_resources_callback (WinLibrary *, WinResource *, WinResource *, WinRe
 
 WinResource *list_resources(WinLibrary *, WinResource *, int *, wres_error *);
 WinResource *find_resource(WinLibrary *, const char *, const char *, const char *, int *, wres_error *);
+bool compare_resource_id(WinResource *, const char *);
 void *get_resource_entry(WinLibrary *, WinResource *, size_t *, wres_error *);
 
 
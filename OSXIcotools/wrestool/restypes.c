@@ -29,7 +29,7 @@ static const char *res_types[] = {
     /* the following are not defined in winbase.h, but found in wrc. */
     /* 0x10: */ 
     "version", "dlginclude", NULL, "plugplay", "vxd",
-    "anicursor", "aniicon"
+    "anicursor", "aniicon", "html", "manifest"
 };
 #define RES_TYPE_COUNT (sizeof(res_types)/sizeof(char *))
 
@@ -55,7 +55,7 @@ const char *res_type_string_to_id (char *type)
     static const char *res_type_ids[] = {
 	"-1", "-2", "-3", "-4", "-5", "-6", "-7", "-8", "-9", "-10",
 	"-11", "-12", NULL, "-14", NULL, "-16", "-17", NULL, "-19",
-	"-20", "-21", "-22"
+	"-20", "-21", "-22", "-23", "-24"
     };
     int c;
 
@@ -0,0 +1,252 @@
+/* resultstore.c - Results shared by libraries with identical resources
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Copies of the same DLL are everywhere: every Wine prefix and game has
+ * its own runtime libraries, and launchers are often the same program
+ * under another name. This store keeps whatever has been extracted from
+ * a library, by the resource_digest of the library instead of by its
+ * name, so that it is worked out once for all the copies.
+ *
+ * When a thread misses, the entry is marked as being made, and the other
+ * threads asking for it wait until the first one puts the result or
+ * gives up. The oldest results are dropped when the store gets too big. */
+
+#include <config.h>
+#include <pthread.h>
+#include "xalloc.h"			/* Gnulib */
+#include "resultstore.h"
+
+
+typedef struct _StoredResult {
+	struct _StoredResult *chain;	/* next in the same bucket */
+	struct _StoredResult *newer;	/* next to be dropped */
+	uint64_t digest;
+	bool ready;
+	size_t size;
+	char *data;
+} StoredResult;
+
+struct _WinResultStore {
+	pthread_mutex_t lock;
+	pthread_cond_t made;
+	StoredResult **buckets;
+	size_t bucket_count;		/* a power of two */
+	size_t entry_count;
+	StoredResult *oldest;
+	StoredResult *newest;
+	size_t bytes;
+	size_t max_bytes;
+	uint64_t hits;
+	uint64_t misses;
+};
+
+
+/* new_result_store:
+ *   Create a store that keeps up to about `max_bytes' of results.
+ */
+WinResultStore *
+new_result_store(size_t max_bytes)
+{
+	WinResultStore *rs = xcalloc(1, sizeof(WinResultStore));
+
+	pthread_mutex_init(&rs->lock, NULL);
+	pthread_cond_init(&rs->made, NULL);
+	rs->bucket_count = 256;
+	rs->buckets = xcalloc(rs->bucket_count, sizeof(StoredResult *));
+	rs->max_bytes = max_bytes;
+	return rs;
+}
+
+void
+free_result_store(WinResultStore *rs)
+{
+	StoredResult *e, *next;
+	size_t c;
+
+	for (c = 0; c < rs->bucket_count; c++) {
+		for (e = rs->buckets[c]; e != NULL; e = next) {
+			next = e->chain;
+			free(e->data);
+			free(e);
+		}
+	}
+	free(rs->buckets);
+	pthread_cond_destroy(&rs->made);
+	pthread_mutex_destroy(&rs->lock);
+	free(rs);
+}
+
+static StoredResult **
+find_link(WinResultStore *rs, uint64_t digest)
+{
+	StoredResult **link = &rs->buckets[digest & (rs->bucket_count - 1)];
+
+	while (*link != NULL && (*link)->digest != digest)
+		link = &(*link)->chain;
+	return link;
+}
+
+static void
+grow_buckets(WinResultStore *rs)
+{
+	StoredResult **old = rs->buckets, *e, *next;
+	size_t c, old_count = rs->bucket_count;
+
+	rs->bucket_count *= 2;
+	rs->buckets = xcalloc(rs->bucket_count, sizeof(StoredResult *));
+	for (c = 0; c < old_count; c++) {
+		for (e = old[c]; e != NULL; e = next) {
+			next = e->chain;
+			e->chain = rs->buckets[e->digest & (rs->bucket_count - 1)];
+			rs->buckets[e->digest & (rs->bucket_count - 1)] = e;
+		}
+	}
+	free(old);
+}
+
+static void
+remove_entry(WinResultStore *rs, StoredResult **link)
+{
+	StoredResult *e = *link;
+
+	*link = e->chain;
+	rs->entry_count--;
+	if (e->ready)
+		rs->bytes -= e->size;
+	free(e->data);
+	free(e);
+}
+
+/* drop_oldest:
+ *   Drop results until the store is back in its size. Entries still
+ *   being made are not in the list, so they are never dropped.
+ */
+static void
+drop_oldest(WinResultStore *rs)
+{
+	StoredResult *e;
+
+	while (rs->bytes > rs->max_bytes && rs->oldest != NULL) {
+		e = rs->oldest;
+		rs->oldest = e->newer;
+		if (rs->oldest == NULL)
+			rs->newest = NULL;
+		remove_entry(rs, find_link(rs, e->digest));
+	}
+}
+
+/* result_store_get:
+ *   Returns a copy of the result stored for `digest', which must be
+ *   freed, waiting if another thread is making it. Returns NULL if there
+ *   is none: the caller must then make it, and call result_store_put()
+ *   or result_store_abandon() for the same digest.
+ */
+void *
+result_store_get(WinResultStore *rs, uint64_t digest, size_t *size)
+{
+	StoredResult **link, *e;
+	void *data = NULL;
+
+	pthread_mutex_lock(&rs->lock);
+	for (;;) {
+		link = find_link(rs, digest);
+		e = *link;
+		if (e == NULL) {
+			e = xcalloc(1, sizeof(StoredResult));
+			e->digest = digest;
+			*link = e;
+			if (++rs->entry_count > rs->bucket_count)
+				grow_buckets(rs);
+			rs->misses++;
+			break;
+		}
+		if (e->ready) {
+			data = xmalloc(e->size ? e->size : 1);
+			memcpy(data, e->data, e->size);
+			*size = e->size;
+			rs->hits++;
+			break;
+		}
+		/* the entry may be gone when we wake up, so look it up again */
+		pthread_cond_wait(&rs->made, &rs->lock);
+	}
+	pthread_mutex_unlock(&rs->lock);
+	return data;
+}
+
+/* result_store_put:
+ *   Store the result for `digest' after a miss, and wake up the threads
+ *   waiting for it.
+ */
+void
+result_store_put(WinResultStore *rs, uint64_t digest, const void *data, size_t size)
+{
+	StoredResult **link, *e;
+
+	pthread_mutex_lock(&rs->lock);
+	link = find_link(rs, digest);
+	e = *link;
+	if (e != NULL && !e->ready) {
+		if (size > rs->max_bytes) {
+			/* too big to keep; the waiters will make it themselves */
+			remove_entry(rs, link);
+		} else {
+			e->data = xmalloc(size ? size : 1);
+			memcpy(e->data, data, size);
+			e->size = size;
+			e->ready = true;
+			rs->bytes += size;
+			if (rs->newest)
+				rs->newest->newer = e;
+			else
+				rs->oldest = e;
+			rs->newest = e;
+			drop_oldest(rs);
+		}
+	}
+	pthread_cond_broadcast(&rs->made);
+	pthread_mutex_unlock(&rs->lock);
+}
+
+/* result_store_abandon:
+ *   Give up making the result for `digest' after a miss. One of the
+ *   threads waiting for it, if any, will try instead.
+ */
+void
+result_store_abandon(WinResultStore *rs, uint64_t digest)
+{
+	StoredResult **link;
+
+	pthread_mutex_lock(&rs->lock);
+	link = find_link(rs, digest);
+	if (*link != NULL && !(*link)->ready)
+		remove_entry(rs, link);
+	pthread_cond_broadcast(&rs->made);
+	pthread_mutex_unlock(&rs->lock);
+}
+
+void
+result_store_stats(WinResultStore *rs, WinResultStoreStats *stats)
+{
+	pthread_mutex_lock(&rs->lock);
+	stats->hits = rs->hits;
+	stats->misses = rs->misses;
+	stats->entries = rs->entry_count;
+	stats->bytes = rs->bytes;
+	pthread_mutex_unlock(&rs->lock);
+}
@@ -0,0 +1,43 @@
+/* resultstore.h - Results shared by libraries with identical resources
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RESULTSTORE_H
+#define RESULTSTORE_H
+
+#include "wrestool.h"
+
+
+typedef struct _WinResultStoreStats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t entries;
+	uint64_t bytes;
+} WinResultStoreStats;
+
+typedef struct _WinResultStore WinResultStore;
+
+
+WinResultStore *new_result_store(size_t);
+void free_result_store(WinResultStore *);
+void *result_store_get(WinResultStore *, uint64_t, size_t *);
+void result_store_put(WinResultStore *, uint64_t, const void *, size_t);
+void result_store_abandon(WinResultStore *, uint64_t);
+void result_store_stats(WinResultStore *, WinResultStoreStats *);
+
+
+#endif
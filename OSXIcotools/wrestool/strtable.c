@@ -0,0 +1,216 @@
+/* strtable.c - Reading RT_STRING string tables
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "xalloc.h"			/* Gnulib */
+#include "common/intutil.h"
+#include "common/utf16.h"
+#include "win32.h"
+#include "fileread.h"
+#include "restable.h"
+#include "strtable.h"
+
+
+static int
+compare_string_blocks(const void *a, const void *b)
+{
+	const WinStringBlock *ba = a, *bb = b;
+
+	if (ba->block_id == bb->block_id)
+		return 0;
+	return ba->block_id < bb->block_id ? -1 : 1;
+}
+
+/* new_string_table:
+ *   Collect the RT_STRING blocks of a library in language `lang'. If
+ *   `lang' is NULL or empty, the first language found for each block is
+ *   used. Only the resource directory is read; the strings themselves
+ *   are looked at when they are first accessed.
+ */
+WinStringTable *
+new_string_table(WinLibrary *fi, const char *lang, wres_error *err)
+{
+	WinStringTable *tbl;
+	WinResource *type_wr, *name_wr, *lang_wr;
+	int level, c, d, name_count, lang_count;
+
+	if (fi->binary_type == NE_BINARY) {
+		/* 16-bit string tables hold 8-bit strings */
+		if (err) *err = WRES_ERROR_UNSUPPRESTYPE;
+		return NULL;
+	}
+	if (lang == NULL)
+		lang = "";
+
+	type_wr = find_resource(fi, "-6", NULL, NULL, &level, err);
+	if (type_wr == NULL)
+		return NULL;
+	name_wr = list_resources(fi, type_wr, &name_count, err);
+	free(type_wr);
+	if (name_wr == NULL)
+		return NULL;
+
+	tbl = xmalloc(sizeof(WinStringTable));
+	tbl->fi = fi;
+	tbl->blocks = xcalloc(name_count, sizeof(WinStringBlock));
+	tbl->block_count = 0;
+
+	for (c = 0; c < name_count; c++) {
+		WinStringBlock *block = &tbl->blocks[tbl->block_count];
+		WinResource *wr = NULL;
+		int32_t id;
+		size_t size;
+		void *data;
+
+		if (!name_wr[c].numeric_id || !parse_int32(name_wr[c].id, &id) || id <= 0)
+			continue;
+		if (!name_wr[c].is_directory)
+			continue;
+
+		lang_wr = list_resources(fi, &name_wr[c], &lang_count, NULL);
+		if (lang_wr == NULL)
+			continue;
+		for (d = 0; d < lang_count && wr == NULL; d++) {
+			if (compare_resource_id(&lang_wr[d], lang))
+				wr = &lang_wr[d];
+		}
+		data = wr ? get_resource_entry(fi, wr, &size, NULL) : NULL;
+		free(lang_wr);
+		if (data == NULL)
+			continue;
+
+		block->block_id = id;
+		block->data = data;
+		block->size = size / sizeof(uint16_t);
+		tbl->block_count++;
+	}
+	free(name_wr);
+
+	qsort(tbl->blocks, tbl->block_count, sizeof(WinStringBlock), compare_string_blocks);
+	return tbl;
+}
+
+void
+free_string_table(WinStringTable *tbl)
+{
+	free(tbl->blocks);
+	free(tbl);
+}
+
+/* index_string_block:
+ *   Find where each of the 16 strings of a block starts. Strings that
+ *   do not fit in the resource are treated as empty.
+ */
+static void
+index_string_block(WinStringBlock *block)
+{
+	size_t pos = 0;
+	int c;
+
+	for (c = 0; c < STRING_BLOCK_SIZE; c++) {
+		uint16_t len = 0;
+
+		if (pos < block->size) {
+			len = block->data[pos];
+			pos++;
+			if (len > block->size - pos)
+				len = 0;
+		}
+		block->offsets[c] = (uint32_t) pos;
+		block->lengths[c] = len;
+		pos += len;
+	}
+	block->indexed = true;
+}
+
+static WinStringBlock *
+find_string_block(WinStringTable *tbl, uint32_t block_id)
+{
+	WinStringBlock key;
+
+	key.block_id = block_id;
+	return bsearch(&key, tbl->blocks, tbl->block_count, sizeof(WinStringBlock), compare_string_blocks);
+}
+
+/* string_table_lookup:
+ *   Find the string with the given id. The view refers to the memory of
+ *   the library. Empty strings are reported as not found, like
+ *   LoadString() does.
+ */
+bool
+string_table_lookup(WinStringTable *tbl, uint32_t id, WinUTF16View *view, wres_error *err)
+{
+	WinStringBlock *block;
+	int slot = id % STRING_BLOCK_SIZE;
+
+	block = find_string_block(tbl, id / STRING_BLOCK_SIZE + 1);
+	if (block == NULL) {
+		if (err) *err = WRES_ERROR_RESNOTFOUND;
+		return false;
+	}
+	if (!block->indexed)
+		index_string_block(block);
+	if (block->lengths[slot] == 0) {
+		if (err) *err = WRES_ERROR_RESNOTFOUND;
+		return false;
+	}
+
+	view->chars = block->data + block->offsets[slot];
+	view->length = block->lengths[slot];
+	return true;
+}
+
+/* string_table_get_utf8:
+ *   Like string_table_lookup, but returns an allocated UTF-8 copy of the
+ *   string, which should be freed with free().
+ */
+char *
+string_table_get_utf8(WinStringTable *tbl, uint32_t id, wres_error *err)
+{
+	WinUTF16View view;
+
+	if (!string_table_lookup(tbl, id, &view, err))
+		return NULL;
+	return utf16le_to_utf8_dup(view.chars, view.length, NULL);
+}
+
+/* string_table_foreach:
+ *   Call `cb' for each non-empty string, in order of id, until it
+ *   returns false.
+ */
+void
+string_table_foreach(WinStringTable *tbl, StringTableCallback cb, void *ctx)
+{
+	WinUTF16View view;
+	int c, slot;
+
+	for (c = 0; c < tbl->block_count; c++) {
+		WinStringBlock *block = &tbl->blocks[c];
+
+		if (!block->indexed)
+			index_string_block(block);
+		for (slot = 0; slot < STRING_BLOCK_SIZE; slot++) {
+			if (block->lengths[slot] == 0)
+				continue;
+			view.chars = block->data + block->offsets[slot];
+			view.length = block->lengths[slot];
+			if (!cb((block->block_id - 1) * STRING_BLOCK_SIZE + slot, &view, ctx))
+				return;
+		}
+	}
+}
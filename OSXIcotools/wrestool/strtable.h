@@ -0,0 +1,63 @@
+/* strtable.h - Reading RT_STRING string tables
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STRTABLE_H
+#define STRTABLE_H
+
+#include "wrestool.h"
+
+
+/* A string in the memory of a library; it is not NUL-terminated */
+typedef struct _WinUTF16View {
+	const uint16_t *chars;
+	size_t length;				/* in code units */
+} WinUTF16View;
+
+/* Each RT_STRING resource holds a block of 16 strings, stored as
+ * length-prefixed UTF-16 strings one after the other */
+#define STRING_BLOCK_SIZE (16)
+
+typedef struct _WinStringBlock {
+	uint32_t block_id;			/* name of the resource; (string id / 16) + 1 */
+	const uint16_t *data;
+	size_t size;				/* in code units */
+	bool indexed;
+	uint32_t offsets[STRING_BLOCK_SIZE];	/* filled on first access */
+	uint16_t lengths[STRING_BLOCK_SIZE];
+} WinStringBlock;
+
+/* All the string blocks of a library in a given language, sorted by id.
+ * Blocks are indexed lazily, so a table must not be shared between
+ * threads without locking. */
+typedef struct _WinStringTable {
+	WinLibrary *fi;
+	WinStringBlock *blocks;
+	int block_count;
+} WinStringTable;
+
+typedef bool (*StringTableCallback) (uint32_t, const WinUTF16View *, void *);
+
+
+WinStringTable *new_string_table(WinLibrary *, const char *, wres_error *);
+void free_string_table(WinStringTable *);
+bool string_table_lookup(WinStringTable *, uint32_t, WinUTF16View *, wres_error *);
+char *string_table_get_utf8(WinStringTable *, uint32_t, wres_error *);
+void string_table_foreach(WinStringTable *, StringTableCallback, void *);
+
+
+#endif
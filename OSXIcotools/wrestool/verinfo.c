@@ -0,0 +1,784 @@
+/* verinfo.c - Parsing of VERSIONINFO resources
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* A VS_VERSIONINFO block is a tree of nodes. Each node is made of
+ *   - a header: total size of the node including its children, size of
+ *     the value and (32-bit only) type of the value
+ *   - a NUL-terminated name, UTF-16LE in 32-bit blocks, ANSI in 16-bit
+ *     blocks
+ *   - the value, aligned to 32 bit
+ *   - the children, each aligned to 32 bit.
+ * See Raymond Chen's posts on the subject:
+ *   http://blogs.msdn.com/b/oldnewthing/archive/2006/12/20/1332035.aspx (16 bit)
+ *   http://blogs.msdn.com/b/oldnewthing/archive/2006/12/21/1340571.aspx (32 bit)
+ *   http://blogs.msdn.com/b/oldnewthing/archive/2006/12/22/1348663.aspx (kludge)
+ * The whole tree is walked once by new_version_info(); afterwards every
+ * query is answered from the node array. */
+
+#include <config.h>
+#include <string.h>
+#include "xalloc.h"			/* Gnulib */
+#include "common/intutil.h"
+#include "common/utf16.h"
+#include "common/codepages.h"
+#include "restable.h"
+#include "verinfo.h"
+
+
+#define VERINFO_MAX_DEPTH (16)
+#define PAD32(x) (((x) + 3) & ~(uint32_t)3)
+
+#pragma pack(1)
+typedef struct {
+	uint16_t length;			/* size of the node, children included */
+	uint16_t value_length;
+	uint16_t type;				/* 1 if the value is text */
+} VersionNodeHeader;
+
+typedef struct {
+	uint16_t length;
+	uint16_t value_length;
+} VersionNode16Header;
+#pragma pack()
+
+typedef struct {
+	WinVersionInfo *vi;
+	int node_capacity;
+} VersionParser;
+
+
+static int
+add_node(VersionParser *p)
+{
+	WinVersionInfo *vi = p->vi;
+
+	if (vi->node_count == p->node_capacity) {
+		p->node_capacity = p->node_capacity ? p->node_capacity * 2 : 32;
+		vi->nodes = xrealloc(vi->nodes, p->node_capacity * sizeof(WinVerNode));
+	}
+	return vi->node_count++;
+}
+
+/* parse_node:
+ *   Parse the node at offset `off' and all of its children. The node must
+ *   end before `end'. The offset of the byte after the node is put in
+ *   `*next'. Returns false if the node is malformed.
+ */
+static bool
+parse_node(VersionParser *p, uint32_t off, uint32_t end, int parent, int depth, uint32_t *next)
+{
+	WinVersionInfo *vi = p->vi;
+	const uint8_t *base = vi->data;
+	uint32_t hdr_size, length, value_length, type, name_off, name_len, value_off, value_size;
+	uint32_t node_end, child_off, child_next;
+	int index, last_child = -1;
+	WinVerNode *node;
+
+	if (vi->is_16bit) {
+		const VersionNode16Header *hdr = (const VersionNode16Header *) (base + off);
+
+		hdr_size = sizeof(VersionNode16Header);
+		if (end - off < hdr_size)
+			return false;
+		length = hdr->length;
+		value_length = hdr->value_length;
+		type = 0;
+	} else {
+		const VersionNodeHeader *hdr = (const VersionNodeHeader *) (base + off);
+
+		hdr_size = sizeof(VersionNodeHeader);
+		if (end - off < hdr_size)
+			return false;
+		length = hdr->length;
+		value_length = hdr->value_length;
+		type = hdr->type;
+	}
+	if (length < hdr_size)
+		return false;
+	/* some linkers get the size of the last node wrong; trust the parent */
+	node_end = length > end - off ? end : off + length;
+	*next = off + length;
+
+	name_off = off + hdr_size;
+	name_len = 0;
+	if (vi->is_16bit) {
+		const char *name = (const char *) (base + name_off);
+
+		while (name_off + name_len < node_end && name[name_len] != '\0')
+			name_len++;
+		if (name_off + name_len >= node_end)
+			return false;
+		value_off = PAD32(name_off + name_len + 1);
+	} else {
+		const uint16_t *name = (const uint16_t *) (base + name_off);
+
+		while (name_off + (name_len + 1) * 2 <= node_end && name[name_len] != 0)
+			name_len++;
+		if (name_off + (name_len + 1) * 2 > node_end)
+			return false;
+		value_off = PAD32(name_off + (name_len + 1) * 2);
+	}
+
+	if (type == 1) {
+		/* Text values are measured in characters, but shortly after the
+		 * switch to Unicode many resource compilers wrote a byte count
+		 * instead. If the character count does not fit, it is bytes. */
+		value_size = value_length * 2;
+		if (value_off > node_end || value_size > node_end - value_off)
+			value_size = value_length;
+	} else {
+		value_size = value_length;
+	}
+	if (value_off > node_end)
+		value_off = node_end;
+	if (value_size > node_end - value_off)
+		value_size = node_end - value_off;
+
+	index = add_node(p);
+	node = &vi->nodes[index];
+	node->name.chars = base + name_off;
+	node->name.length = name_len;
+	node->value = base + value_off;
+	node->value_size = value_size;
+	node->type = type;
+	node->depth = depth;
+	node->parent = parent;
+	node->first_child = -1;
+	node->next_sibling = -1;
+
+	if (depth >= VERINFO_MAX_DEPTH)
+		return true;
+
+	child_off = PAD32(value_off + value_size);
+	while (child_off < node_end && node_end - child_off >= hdr_size) {
+		int child = vi->node_count;
+
+		/* a zero length marks padding at the end of the parent */
+		if (*(const uint16_t *) (base + child_off) == 0)
+			break;
+		if (!parse_node(p, child_off, node_end, index, depth + 1, &child_next))
+			return false;
+		if (last_child < 0)
+			vi->nodes[index].first_child = child;
+		else
+			vi->nodes[last_child].next_sibling = child;
+		last_child = child;
+		child_off = PAD32(child_next);
+	}
+	return true;
+}
+
+static uint16_t
+text_char_at(const WinVersionInfo *vi, const WinVerText *text, uint32_t i)
+{
+	if (vi->is_16bit)
+		return ((const uint8_t *) text->chars)[i];
+	return ((const uint16_t *) text->chars)[i];
+}
+
+static uint32_t
+fold_ascii(uint32_t c)
+{
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+/* fold_case:
+ *   Simple case folding for the Latin-1, Greek and Cyrillic letters,
+ *   which is enough for the names used in version information blocks.
+ */
+static uint16_t
+fold_case(uint16_t c)
+{
+	if (c < 0x80)
+		return fold_ascii(c);
+	if ((c >= 0xC0 && c <= 0xDE && c != 0xD7)
+	    || (c >= 0x391 && c <= 0x3AB && c != 0x3A2)
+	    || (c >= 0x410 && c <= 0x42F))
+		return c + 0x20;
+	if (c >= 0x400 && c <= 0x40F)
+		return c + 0x50;
+	return c;
+}
+
+/* utf8_next:
+ *   Decode the UTF-8 sequence at `*s' and advance `*s' past it.
+ */
+static uint32_t
+utf8_next(const uint8_t **s, const uint8_t *end)
+{
+	uint32_t c = *(*s)++;
+	int extra;
+
+	if (c < 0x80)
+		return c;
+	extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : 1;
+	c &= 0x3F >> extra;
+	for (; extra > 0 && *s < end; extra--)
+		c = (c << 6) | (*(*s)++ & 0x3F);
+	return c;
+}
+
+/* text_equals:
+ *   Compare a name in the block with `len' bytes of UTF-8, ignoring the
+ *   case of ASCII letters. Names in 16-bit blocks are compared byte by
+ *   byte.
+ */
+static bool
+text_equals(const WinVersionInfo *vi, const WinVerText *text, const char *s, size_t len)
+{
+	const uint8_t *u = (const uint8_t *) s, *end = u + len;
+	uint32_t i = 0;
+
+	while (u < end) {
+		uint32_t c = vi->is_16bit ? *u++ : utf8_next(&u, end);
+
+		if (c >= 0x10000) {
+			c -= 0x10000;
+			if (i + 1 >= text->length
+			    || text_char_at(vi, text, i) != 0xD800 + (c >> 10)
+			    || text_char_at(vi, text, i + 1) != 0xDC00 + (c & 0x3FF))
+				return false;
+			i += 2;
+			continue;
+		}
+		if (i >= text->length || fold_ascii(text_char_at(vi, text, i)) != fold_ascii(c))
+			return false;
+		i++;
+	}
+	return i == text->length;
+}
+
+static int
+parse_hex_digit(uint16_t c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c = fold_ascii(c);
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/* parse_table_name:
+ *   Read the language and code page from the name of a StringTable, which
+ *   is made of 8 hexadecimal digits.
+ */
+static void
+parse_table_name(const WinVersionInfo *vi, WinVerStringTable *table)
+{
+	uint32_t value = 0, i;
+
+	table->lang = table->codepage = 0;
+	if (table->name.length != 8)
+		return;
+	for (i = 0; i < 8; i++) {
+		int d = parse_hex_digit(text_char_at(vi, &table->name, i));
+		if (d < 0)
+			return;
+		value = (value << 4) | d;
+	}
+	table->lang = value >> 16;
+	table->codepage = value & 0xFFFF;
+}
+
+static int
+find_child(const WinVersionInfo *vi, int parent, const char *name)
+{
+	int c;
+
+	for (c = vi->nodes[parent].first_child; c >= 0; c = vi->nodes[c].next_sibling)
+		if (text_equals(vi, &vi->nodes[c].name, name, strlen(name)))
+			return c;
+	return -1;
+}
+
+/* collect_tables:
+ *   Fill the fixed info, the translations and the string tables from the
+ *   node array.
+ */
+static void
+collect_tables(WinVersionInfo *vi)
+{
+	const WinVerNode *root = &vi->nodes[0];
+	int sfi, vfi, tr, t, s, c, n;
+
+	if (root->value_size >= sizeof(WinVerFixedInfo)) {
+		const WinVerFixedInfo *ffi = &vi->fixed_info;
+
+		memcpy(&vi->fixed_info, root->value, sizeof(WinVerFixedInfo));
+		vi->has_fixed_info = ffi->signature == VS_FFI_SIGNATURE;
+		if (vi->has_fixed_info) {
+			vi->file_version[0] = ffi->file_version_ms >> 16;
+			vi->file_version[1] = ffi->file_version_ms & 0xFFFF;
+			vi->file_version[2] = ffi->file_version_ls >> 16;
+			vi->file_version[3] = ffi->file_version_ls & 0xFFFF;
+			vi->product_version[0] = ffi->product_version_ms >> 16;
+			vi->product_version[1] = ffi->product_version_ms & 0xFFFF;
+			vi->product_version[2] = ffi->product_version_ls >> 16;
+			vi->product_version[3] = ffi->product_version_ls & 0xFFFF;
+			vi->file_flags = ffi->file_flags & ffi->file_flags_mask;
+		}
+	}
+
+	vfi = find_child(vi, 0, "VarFileInfo");
+	tr = vfi >= 0 ? find_child(vi, vfi, "Translation") : -1;
+	if (tr >= 0) {
+		const uint16_t *pairs = vi->nodes[tr].value;
+
+		vi->translation_count = vi->nodes[tr].value_size / 4;
+		vi->translations = xmalloc(vi->translation_count * sizeof(WinVerTranslation) + 1);
+		for (c = 0; c < vi->translation_count; c++) {
+			vi->translations[c].lang = pairs[c * 2];
+			vi->translations[c].codepage = pairs[c * 2 + 1];
+		}
+	}
+
+	sfi = find_child(vi, 0, "StringFileInfo");
+	if (sfi < 0)
+		return;
+	for (t = vi->nodes[sfi].first_child; t >= 0; t = vi->nodes[t].next_sibling) {
+		vi->string_table_count++;
+		for (s = vi->nodes[t].first_child; s >= 0; s = vi->nodes[s].next_sibling)
+			vi->string_count++;
+	}
+	vi->string_tables = xmalloc(vi->string_table_count * sizeof(WinVerStringTable) + 1);
+	vi->strings = xmalloc(vi->string_count * sizeof(WinVerString) + 1);
+
+	c = n = 0;
+	for (t = vi->nodes[sfi].first_child; t >= 0; t = vi->nodes[t].next_sibling) {
+		WinVerStringTable *table = &vi->string_tables[c++];
+
+		table->name = vi->nodes[t].name;
+		parse_table_name(vi, table);
+		table->strings = &vi->strings[n];
+		table->count = 0;
+		for (s = vi->nodes[t].first_child; s >= 0; s = vi->nodes[s].next_sibling) {
+			vi->strings[n].key = vi->nodes[s].name;
+			vi->strings[n].value = version_info_node_text(vi, &vi->nodes[s]);
+			n++;
+			table->count++;
+		}
+	}
+}
+
+/* new_version_info:
+ *   Parse a VS_VERSIONINFO block of `size' bytes. `is_16bit' selects the
+ *   layout used by NE binaries. The block is not copied.
+ */
+WinVersionInfo *
+new_version_info(const void *data, size_t size, bool is_16bit, wres_error *err)
+{
+	WinVersionInfo *vi;
+	VersionParser p;
+	uint32_t next;
+
+	if (size > UINT16_MAX)
+		size = UINT16_MAX;	/* wLength of the root is 16 bits */
+
+	vi = xcalloc(1, sizeof(WinVersionInfo));
+	vi->data = data;
+	vi->size = size;
+	vi->is_16bit = is_16bit;
+
+	p.vi = vi;
+	p.node_capacity = 0;
+	if (!parse_node(&p, 0, size, -1, 0, &next)) {
+		free_version_info(vi);
+		if (err) *err = WRES_ERROR_INVALIDVERINFO;
+		return NULL;
+	}
+
+	collect_tables(vi);
+	return vi;
+}
+
+void
+free_version_info(WinVersionInfo *vi)
+{
+	free(vi->nodes);
+	free(vi->translations);
+	free(vi->string_tables);
+	free(vi->strings);
+	free(vi);
+}
+
+/* version_info_node_text:
+ *   Returns the value of a node as a string, stopping at the first NUL.
+ */
+WinVerText
+version_info_node_text(const WinVersionInfo *vi, const WinVerNode *node)
+{
+	WinVerText text;
+	uint32_t max, i;
+
+	text.chars = node->value;
+	if (vi->is_16bit) {
+		const char *chars = node->value;
+
+		max = node->value_size;
+		for (i = 0; i < max && chars[i] != '\0'; i++);
+	} else {
+		const uint16_t *chars = node->value;
+
+		max = node->value_size / 2;
+		for (i = 0; i < max && chars[i] != 0; i++);
+	}
+	text.length = i;
+	return text;
+}
+
+/* version_info_node_string_table:
+ *   Returns the string table that `node' is in, or that it is, or NULL if
+ *   it is not under StringFileInfo. Use it to pick the code page of a node
+ *   found with version_query_run().
+ */
+const WinVerStringTable *
+version_info_node_string_table(const WinVersionInfo *vi, int node)
+{
+	int c;
+
+	if (node < 0 || node >= vi->node_count || vi->nodes[node].depth < 2)
+		return NULL;
+	while (vi->nodes[node].depth > 2)
+		node = vi->nodes[node].parent;
+	for (c = 0; c < vi->string_table_count; c++) {
+		if (vi->string_tables[c].name.chars == vi->nodes[node].name.chars)
+			return &vi->string_tables[c];
+	}
+	return NULL;
+}
+
+/* version_info_pack_version:
+ *   Pack the four parts of a version in a single number, which sorts
+ *   like the version does.
+ */
+uint64_t
+version_info_pack_version(const uint16_t *parts)
+{
+	return ((uint64_t) parts[0] << 48) | ((uint64_t) parts[1] << 32)
+	       | ((uint64_t) parts[2] << 16) | parts[3];
+}
+
+/* version_info_os_name:
+ *   Returns a description of a file_os value, or NULL if it is not one of
+ *   the combinations documented by Microsoft.
+ */
+const char *
+version_info_os_name(uint32_t file_os)
+{
+	switch (file_os) {
+		case VOS_DOS: return "MS-DOS";
+		case VOS_NT: return "Windows NT";
+		case VOS__WINDOWS16: return "16-bit Windows";
+		case VOS__WINDOWS32: return "32-bit Windows";
+		case VOS_OS216: return "16-bit OS/2";
+		case VOS_OS232: return "32-bit OS/2";
+		case VOS__PM16: return "16-bit Presentation Manager";
+		case VOS__PM32: return "32-bit Presentation Manager";
+		case VOS_DOS | VOS__WINDOWS16: return "16-bit Windows on MS-DOS";
+		case VOS_DOS | VOS__WINDOWS32: return "32-bit Windows on MS-DOS";
+		case VOS_NT | VOS__WINDOWS32: return "Windows NT";
+		case VOS_OS216 | VOS__PM16: return "16-bit Presentation Manager on 16-bit OS/2";
+		case VOS_OS232 | VOS__PM32: return "32-bit Presentation Manager on 32-bit OS/2";
+		case VOS_WINCE: return "Windows CE";
+	}
+	return NULL;
+}
+
+/* version_info_file_type_name:
+ *   Returns a description of a file_type value, or NULL if it is unknown.
+ */
+const char *
+version_info_file_type_name(uint32_t file_type)
+{
+	switch (file_type) {
+		case VFT_APP: return "Application";
+		case VFT_DLL: return "Dynamic-Link Library";
+		case VFT_DRV: return "Device Driver";
+		case VFT_FONT: return "Font";
+		case VFT_VXD: return "Virtual Device";
+		case VFT_STATIC_LIB: return "Static-Link Library";
+	}
+	return NULL;
+}
+
+/* language_match_score:
+ *   Rate how well the language `lang' satisfies a list of preferred
+ *   languages, most preferred first. In order, the best matches are:
+ *   the exact language, a language with the same primary language,
+ *   a neutral language, US English, anything else. Ties are broken by
+ *   the position in the preference list.
+ */
+int
+language_match_score(uint16_t lang, const uint16_t *prefs, int count)
+{
+	int c, best = 0;
+
+	for (c = 0; c < count && c < 255; c++) {
+		if (lang == prefs[c])
+			return (4 << 8) | (255 - c);
+		if (best == 0 && PRIMARY_LANG_ID(lang) == PRIMARY_LANG_ID(prefs[c]))
+			best = (3 << 8) | (255 - c);
+	}
+	if (best)
+		return best;
+	if (PRIMARY_LANG_ID(lang) == 0)
+		return 2 << 8;
+	if (lang == LANG_ENGLISH_US)
+		return 1 << 8;
+	return 0;
+}
+
+/* find_version_resource:
+ *   Find the RT_VERSION resource in the language that matches best the
+ *   preferences in `prefs', listing the available languages only once.
+ */
+WinResource *
+find_version_resource(WinLibrary *fi, const uint16_t *prefs, int count, wres_error *err)
+{
+	WinResource *name_wr, *lang_wr, *res;
+	int level, c, lang_count, score, best = -1, best_score = -1;
+	uint16_t lang;
+
+	name_wr = find_resource(fi, "16", "", NULL, &level, err);
+	if (name_wr == NULL || !name_wr->is_directory)
+		return name_wr;		/* NE resources have no language */
+
+	lang_wr = list_resources(fi, name_wr, &lang_count, err);
+	free(name_wr);
+	if (lang_wr == NULL)
+		return NULL;
+
+	for (c = 0; c < lang_count; c++) {
+		if (!lang_wr[c].numeric_id || !parse_uint16(lang_wr[c].id, &lang))
+			continue;
+		score = language_match_score(lang, prefs, count);
+		if (score > best_score) {
+			best = c;
+			best_score = score;
+		}
+	}
+	if (best < 0) {
+		free(lang_wr);
+		if (err) *err = WRES_ERROR_RESNOTFOUND;
+		return NULL;
+	}
+
+	res = xmalloc(sizeof(WinResource));
+	memcpy(res, &lang_wr[best], sizeof(WinResource));
+	free(lang_wr);
+	return res;
+}
+
+/* version_info_best_string_table:
+ *   Choose the string table in the language that matches best the
+ *   preferences in `prefs'. When the match is equally good, tables whose
+ *   language is listed in the Translation table win; after that, the
+ *   first one wins. Returns NULL if there are no string tables.
+ */
+const WinVerStringTable *
+version_info_best_string_table(const WinVersionInfo *vi, const uint16_t *prefs, int count)
+{
+	const WinVerStringTable *best = NULL;
+	int t, c, score, best_score = -1;
+
+	for (t = 0; t < vi->string_table_count; t++) {
+		const WinVerStringTable *table = &vi->string_tables[t];
+
+		score = language_match_score(table->lang, prefs, count) * 2;
+		for (c = 0; c < vi->translation_count; c++) {
+			if (vi->translations[c].lang == table->lang) {
+				score++;
+				break;
+			}
+		}
+		if (score > best_score) {
+			best = table;
+			best_score = score;
+		}
+	}
+	return best;
+}
+
+/* version_info_foreach_string:
+ *   Call `cb' for every string of every string table, in the order they
+ *   appear in the block, until it returns false.
+ */
+void
+version_info_foreach_string(const WinVersionInfo *vi, VersionStringCallback cb, void *ctx)
+{
+	int t, c;
+
+	for (t = 0; t < vi->string_table_count; t++) {
+		const WinVerStringTable *table = &vi->string_tables[t];
+
+		for (c = 0; c < table->count; c++)
+			if (!cb(table, &table->strings[c], ctx))
+				return;
+	}
+}
+
+/* version_info_codepage:
+ *   Returns the code page of the strings in `table', or of the names in
+ *   the block if `table' is NULL. 32-bit blocks are always in UTF-16LE.
+ *   16-bit blocks use the code page in the name of the string table, or
+ *   the first one in the Translation table that can be decoded.
+ */
+uint16_t
+version_info_codepage(const WinVersionInfo *vi, const WinVerStringTable *table)
+{
+	int c;
+
+	if (!vi->is_16bit)
+		return CODEPAGE_UTF16LE;
+	if (table && codepage_is_supported(table->codepage))
+		return table->codepage;
+	for (c = 0; c < vi->translation_count; c++)
+		if (codepage_is_supported(vi->translations[c].codepage))
+			return vi->translations[c].codepage;
+	return CODEPAGE_DEFAULT;
+}
+
+/* version_info_text_utf8_length:
+ *   Returns the number of bytes needed to convert `text' to UTF-8. The
+ *   code page is only used for 16-bit blocks.
+ */
+size_t
+version_info_text_utf8_length(const WinVersionInfo *vi, const WinVerText *text, uint16_t cp)
+{
+	if (vi->is_16bit)
+		return codepage_to_utf8_length(cp, text->chars, text->length);
+	return utf16le_to_utf8_length(text->chars, text->length);
+}
+
+/* version_info_text_to_utf8:
+ *   Convert `text' to UTF-8, writing at most `size' bytes to `dst'.
+ *   Returns the number of bytes written.
+ */
+size_t
+version_info_text_to_utf8(const WinVersionInfo *vi, char *dst, size_t size, const WinVerText *text, uint16_t cp)
+{
+	if (vi->is_16bit)
+		return codepage_to_utf8(cp, dst, size, text->chars, text->length);
+	return utf16le_to_utf8(dst, size, text->chars, text->length);
+}
+
+char *
+version_info_text_to_utf8_dup(const WinVersionInfo *vi, const WinVerText *text, uint16_t cp, size_t *outlen)
+{
+	if (vi->is_16bit)
+		return codepage_to_utf8_dup(cp, text->chars, text->length, outlen);
+	return utf16le_to_utf8_dup(text->chars, text->length, outlen);
+}
+
+/* new_version_query:
+ *   Compile a path like the ones accepted by VerQueryValue(), for
+ *   example `\StringFileInfo\040904b0\ProductName', into case folded
+ *   UTF-16 segments; `*' matches the first child. The query can then be
+ *   run on any number of blocks by version_query_run() without
+ *   allocating memory. In 16-bit blocks, names are compared as if they
+ *   were in Latin-1.
+ */
+WinVerQuery *
+new_version_query(const char *path)
+{
+	const uint8_t *u = (const uint8_t *) path, *end = u + strlen(path);
+	size_t max_segments = (end - u) / 2 + 1;
+	WinVerQuery *q;
+	uint16_t *chars;
+
+	/* a segment takes at least one byte and a separator; a code unit
+	 * takes at least one byte */
+	q = xmalloc(sizeof(WinVerQuery) + max_segments * sizeof(WinVerQuerySegment)
+	            + (end - u) * sizeof(uint16_t));
+	q->segments = (WinVerQuerySegment *) (q + 1);
+	q->segment_count = 0;
+	chars = (uint16_t *) (q->segments + max_segments);
+
+	while (u < end) {
+		WinVerQuerySegment *seg;
+
+		if (*u == '\\') {
+			u++;
+			continue;
+		}
+		seg = &q->segments[q->segment_count++];
+		seg->chars = chars;
+		seg->length = 0;
+		seg->wildcard = false;
+		if (*u == '*' && (u + 1 == end || u[1] == '\\')) {
+			seg->wildcard = true;
+			u++;
+			continue;
+		}
+		while (u < end && *u != '\\') {
+			uint32_t c = utf8_next(&u, end);
+
+			if (c >= 0x10000) {
+				c -= 0x10000;
+				*chars++ = 0xD800 + (c >> 10);
+				*chars++ = 0xDC00 + (c & 0x3FF);
+				seg->length += 2;
+			} else {
+				*chars++ = fold_case(c);
+				seg->length++;
+			}
+		}
+	}
+	return q;
+}
+
+void
+free_version_query(WinVerQuery *q)
+{
+	free(q);
+}
+
+static bool
+query_segment_matches(const WinVersionInfo *vi, const WinVerText *name, const WinVerQuerySegment *seg)
+{
+	uint32_t i;
+
+	if (seg->wildcard)
+		return true;
+	if (name->length != seg->length)
+		return false;
+	for (i = 0; i < seg->length; i++)
+		if (fold_case(text_char_at(vi, name, i)) != seg->chars[i])
+			return false;
+	return true;
+}
+
+/* version_query_run:
+ *   Returns the index of the node matched by a compiled query, or -1.
+ */
+int
+version_query_run(const WinVerQuery *q, const WinVersionInfo *vi)
+{
+	int cur = 0, s, c;
+
+	for (s = 0; s < q->segment_count; s++) {
+		for (c = vi->nodes[cur].first_child; c >= 0; c = vi->nodes[c].next_sibling)
+			if (query_segment_matches(vi, &vi->nodes[c].name, &q->segments[s]))
+				break;
+		if (c < 0)
+			return -1;
+		cur = c;
+	}
+	return cur;
+}
@@ -0,0 +1,176 @@
+/* verinfo.h - Parsing of VERSIONINFO resources
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VERINFO_H
+#define VERINFO_H
+
+#include "wrestool.h"
+
+
+/* A string in a version information block. In 32-bit blocks it is in
+ * UTF-16LE, in 16-bit blocks it is in the ANSI code page the block was
+ * written in; see version_info_codepage(). It is never NUL-terminated. */
+typedef struct _WinVerText {
+	const void *chars;
+	uint32_t length;			/* in code units */
+} WinVerText;
+
+typedef struct _WinVerNode {
+	WinVerText name;
+	const void *value;
+	uint32_t value_size;		/* in bytes */
+	uint16_t type;				/* 1 if the value is text; always 0 in 16-bit blocks */
+	uint16_t depth;				/* 0 for VS_VERSION_INFO */
+	int32_t parent;				/* indexes in the node array, or -1 */
+	int32_t first_child;
+	int32_t next_sibling;
+} WinVerNode;
+
+/* VS_FIXEDFILEINFO */
+typedef struct _WinVerFixedInfo {
+	uint32_t signature;			/* 0xFEEF04BD */
+	uint32_t struct_version;
+	uint32_t file_version_ms;
+	uint32_t file_version_ls;
+	uint32_t product_version_ms;
+	uint32_t product_version_ls;
+	uint32_t file_flags_mask;
+	uint32_t file_flags;
+	uint32_t file_os;
+	uint32_t file_type;
+	uint32_t file_subtype;
+	uint32_t file_date_ms;
+	uint32_t file_date_ls;
+} WinVerFixedInfo;
+
+#define VS_FFI_SIGNATURE (0xFEEF04BD)
+
+#define CODEPAGE_UTF16LE (1200)
+
+#define LANG_ENGLISH_US (0x0409)
+#define PRIMARY_LANG_ID(lcid) ((lcid) & 0x3FF)
+
+/* file_flags */
+#define VS_FF_DEBUG			(0x01)
+#define VS_FF_PRERELEASE	(0x02)
+#define VS_FF_PATCHED		(0x04)
+#define VS_FF_PRIVATEBUILD	(0x08)
+#define VS_FF_INFOINFERRED	(0x10)
+#define VS_FF_SPECIALBUILD	(0x20)
+
+/* file_os: the high word is the operating system, the low word the
+ * windowing system */
+#define VOS_UNKNOWN			(0x00000)
+#define VOS_DOS				(0x10000)
+#define VOS_OS216			(0x20000)
+#define VOS_OS232			(0x30000)
+#define VOS_NT				(0x40000)
+#define VOS_WINCE			(0x50000)
+#define VOS__WINDOWS16		(0x1)
+#define VOS__PM16			(0x2)
+#define VOS__PM32			(0x3)
+#define VOS__WINDOWS32		(0x4)
+
+/* file_type */
+#define VFT_UNKNOWN			(0)
+#define VFT_APP				(1)
+#define VFT_DLL				(2)
+#define VFT_DRV				(3)
+#define VFT_FONT			(4)
+#define VFT_VXD				(5)
+#define VFT_STATIC_LIB		(7)
+
+typedef struct _WinVerTranslation {
+	uint16_t lang;
+	uint16_t codepage;
+} WinVerTranslation;
+
+typedef struct _WinVerString {
+	WinVerText key;
+	WinVerText value;			/* without the terminator */
+} WinVerString;
+
+/* A StringTable node in StringFileInfo, named after its language and
+ * code page (for example `040904b0') */
+typedef struct _WinVerStringTable {
+	WinVerText name;
+	uint16_t lang;
+	uint16_t codepage;
+	const WinVerString *strings;
+	int count;
+} WinVerStringTable;
+
+/* A VS_VERSIONINFO block parsed once. All the strings refer to the memory
+ * of the block, which must outlive this structure. Nothing in here is
+ * changed after new_version_info() returns, so it can be shared between
+ * threads. */
+typedef struct _WinVersionInfo {
+	const void *data;
+	size_t size;
+	bool is_16bit;
+	WinVerNode *nodes;			/* in document order */
+	int node_count;
+	bool has_fixed_info;
+	WinVerFixedInfo fixed_info;
+	uint16_t file_version[4];	/* major, minor, build, revision */
+	uint16_t product_version[4];
+	uint32_t file_flags;		/* VS_FF_*, only the bits in file_flags_mask */
+	WinVerTranslation *translations;
+	int translation_count;
+	WinVerStringTable *string_tables;
+	int string_table_count;
+	WinVerString *strings;		/* all the string tables, one after the other */
+	int string_count;
+} WinVersionInfo;
+
+/* A path compiled by new_version_query() */
+typedef struct _WinVerQuerySegment {
+	const uint16_t *chars;		/* case folded */
+	uint32_t length;
+	bool wildcard;				/* `*', matches the first child */
+} WinVerQuerySegment;
+
+typedef struct _WinVerQuery {
+	WinVerQuerySegment *segments;
+	int segment_count;
+} WinVerQuery;
+
+typedef bool (*VersionStringCallback) (const WinVerStringTable *, const WinVerString *, void *);
+
+
+WinVersionInfo *new_version_info(const void *, size_t, bool, wres_error *);
+void free_version_info(WinVersionInfo *);
+WinVerText version_info_node_text(const WinVersionInfo *, const WinVerNode *);
+const WinVerStringTable *version_info_node_string_table(const WinVersionInfo *, int);
+uint64_t version_info_pack_version(const uint16_t *);
+const char *version_info_os_name(uint32_t);
+const char *version_info_file_type_name(uint32_t);
+int language_match_score(uint16_t, const uint16_t *, int);
+WinResource *find_version_resource(WinLibrary *, const uint16_t *, int, wres_error *);
+const WinVerStringTable *version_info_best_string_table(const WinVersionInfo *, const uint16_t *, int);
+void version_info_foreach_string(const WinVersionInfo *, VersionStringCallback, void *);
+uint16_t version_info_codepage(const WinVersionInfo *, const WinVerStringTable *);
+size_t version_info_text_utf8_length(const WinVersionInfo *, const WinVerText *, uint16_t);
+size_t version_info_text_to_utf8(const WinVersionInfo *, char *, size_t, const WinVerText *, uint16_t);
+char *version_info_text_to_utf8_dup(const WinVersionInfo *, const WinVerText *, uint16_t, size_t *);
+WinVerQuery *new_version_query(const char *);
+void free_version_query(WinVerQuery *);
+int version_query_run(const WinVerQuery *, const WinVersionInfo *);
+
+
+#endif
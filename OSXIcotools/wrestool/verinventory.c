@@ -0,0 +1,377 @@
+/* verinventory.c - All the version information of a library in one blob
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <string.h>
+#include "xalloc.h"			/* Gnulib */
+#include "common/intutil.h"
+#include "restable.h"
+#include "verinfo.h"
+#include "verinventory.h"
+
+
+typedef struct {
+	void *data;
+	size_t count;
+	size_t capacity;
+	size_t elem_size;
+} InventoryArray;
+
+typedef struct {
+	InventoryArray resources;
+	InventoryArray tables;
+	InventoryArray strings;
+	char *text;
+	size_t text_size;
+	size_t text_capacity;
+	uint32_t *slots;			/* text offset + 1 of interned strings, 0 if free */
+	size_t slot_count;
+	size_t slots_used;
+} InventoryBuilder;
+
+
+static void *
+inventory_array_add(InventoryArray *a)
+{
+	if (a->count == a->capacity) {
+		a->capacity = a->capacity ? a->capacity * 2 : 16;
+		a->data = xrealloc(a->data, a->capacity * a->elem_size);
+	}
+	return (char *) a->data + a->elem_size * a->count++;
+}
+
+static uint32_t
+hash_text(const char *s, size_t len)
+{
+	uint32_t h = 2166136261u;	/* FNV-1a */
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		h = (h ^ (uint8_t) s[i]) * 16777619u;
+	return h;
+}
+
+static void
+grow_slots(InventoryBuilder *b)
+{
+	uint32_t *old = b->slots;
+	size_t old_count = b->slot_count, c, i;
+
+	b->slot_count = old_count ? old_count * 2 : 64;
+	b->slots = xcalloc(b->slot_count, sizeof(uint32_t));
+	for (c = 0; c < old_count; c++) {
+		const char *s;
+
+		if (old[c] == 0)
+			continue;
+		s = b->text + old[c] - 1;
+		i = hash_text(s, strlen(s)) & (b->slot_count - 1);
+		while (b->slots[i] != 0)
+			i = (i + 1) & (b->slot_count - 1);
+		b->slots[i] = old[c];
+	}
+	free(old);
+}
+
+static void
+reserve_text(InventoryBuilder *b, size_t len)
+{
+	if (b->text_size + len <= b->text_capacity)
+		return;
+	while (b->text_size + len > b->text_capacity)
+		b->text_capacity = b->text_capacity ? b->text_capacity * 2 : 1024;
+	b->text = xrealloc(b->text, b->text_capacity);
+}
+
+/* intern_tail:
+ *   Intern the `len' bytes already written at the end of the text pool,
+ *   which is followed by a NUL. If the same string is already there, the
+ *   new copy is dropped. Returns the offset of the string.
+ */
+static uint32_t
+intern_tail(InventoryBuilder *b, size_t len)
+{
+	const char *s = b->text + b->text_size;
+	size_t i;
+
+	if (b->slots_used * 2 >= b->slot_count)
+		grow_slots(b);
+
+	i = hash_text(s, len) & (b->slot_count - 1);
+	while (b->slots[i] != 0) {
+		const char *other = b->text + b->slots[i] - 1;
+
+		if (memcmp(other, s, len + 1) == 0)
+			return b->slots[i] - 1;
+		i = (i + 1) & (b->slot_count - 1);
+	}
+
+	b->slots[i] = b->text_size + 1;
+	b->slots_used++;
+	b->text_size += len + 1;
+	return b->slots[i] - 1;
+}
+
+static uint32_t
+intern_string(InventoryBuilder *b, const char *s)
+{
+	size_t len = strlen(s);
+
+	reserve_text(b, len + 1);
+	memcpy(b->text + b->text_size, s, len + 1);
+	return intern_tail(b, len);
+}
+
+static uint32_t
+intern_version_text(InventoryBuilder *b, const WinVersionInfo *vi, const WinVerText *text, uint16_t cp)
+{
+	size_t len = version_info_text_utf8_length(vi, text, cp);
+
+	reserve_text(b, len + 1);
+	version_info_text_to_utf8(vi, b->text + b->text_size, len, text, cp);
+	b->text[b->text_size + len] = '\0';
+	return intern_tail(b, len);
+}
+
+/* add_resource:
+ *   Parse the version information in `wr' and add it to the inventory.
+ *   Blocks that cannot be parsed are skipped.
+ */
+static void
+add_resource(InventoryBuilder *b, WinLibrary *fi, const char *name, WinResource *wr, uint16_t lang)
+{
+	WinVerInventoryResource *res;
+	WinVersionInfo *vi;
+	const void *data;
+	size_t size;
+	int t, c;
+
+	data = get_resource_entry(fi, wr, &size, NULL);
+	if (data == NULL)
+		return;
+	vi = new_version_info(data, size, fi->binary_type == NE_BINARY, NULL);
+	if (vi == NULL)
+		return;
+
+	res = inventory_array_add(&b->resources);
+	memset(res, 0, sizeof(WinVerInventoryResource));
+	res->name = intern_string(b, name);
+	res->lang = lang;
+	if (vi->is_16bit)
+		res->flags |= VERINV_RES_16BIT;
+	if (vi->has_fixed_info) {
+		res->flags |= VERINV_RES_HAS_FIXED_INFO;
+		memcpy(res->file_version, vi->file_version, sizeof(res->file_version));
+		memcpy(res->product_version, vi->product_version, sizeof(res->product_version));
+		res->file_flags = vi->file_flags;
+		res->file_os = vi->fixed_info.file_os;
+		res->file_type = vi->fixed_info.file_type;
+		res->file_subtype = vi->fixed_info.file_subtype;
+	}
+	res->first_table = b->tables.count;
+	res->table_count = vi->string_table_count;
+
+	for (t = 0; t < vi->string_table_count; t++) {
+		const WinVerStringTable *table = &vi->string_tables[t];
+		WinVerInventoryTable *itable;
+		uint16_t cp = version_info_codepage(vi, table);
+
+		itable = inventory_array_add(&b->tables);
+		itable->name = intern_version_text(b, vi, &table->name, cp);
+		itable->lang = table->lang;
+		itable->codepage = table->codepage;
+		itable->first_string = b->strings.count;
+		itable->string_count = table->count;
+
+		for (c = 0; c < table->count; c++) {
+			WinVerInventoryString *str = inventory_array_add(&b->strings);
+
+			str->key = intern_version_text(b, vi, &table->strings[c].key, cp);
+			str->value = intern_version_text(b, vi, &table->strings[c].value, cp);
+		}
+	}
+	free_version_info(vi);
+}
+
+/* finish_inventory:
+ *   Copy everything collected by the builder into a single block.
+ */
+static void *
+finish_inventory(InventoryBuilder *b, size_t *size, wres_error *err)
+{
+	WinVerInventoryHeader *hdr;
+	size_t res_size, tables_size, strings_size, total;
+	char *inv;
+
+	res_size = b->resources.count * sizeof(WinVerInventoryResource);
+	tables_size = b->tables.count * sizeof(WinVerInventoryTable);
+	strings_size = b->strings.count * sizeof(WinVerInventoryString);
+	total = sizeof(WinVerInventoryHeader) + res_size + tables_size + strings_size + b->text_size;
+	if (total > UINT32_MAX) {
+		if (err) *err = WRES_ERROR_INVALIDVERINFO;
+		return NULL;
+	}
+
+	inv = xmalloc(total);
+	hdr = (WinVerInventoryHeader *) inv;
+	hdr->magic = VERINV_MAGIC;
+	hdr->version = VERINV_VERSION;
+	hdr->size = total;
+	hdr->resource_count = b->resources.count;
+	hdr->resources_offset = sizeof(WinVerInventoryHeader);
+	hdr->table_count = b->tables.count;
+	hdr->tables_offset = hdr->resources_offset + res_size;
+	hdr->string_count = b->strings.count;
+	hdr->strings_offset = hdr->tables_offset + tables_size;
+	hdr->text_size = b->text_size;
+	hdr->text_offset = hdr->strings_offset + strings_size;
+
+	if (res_size)
+		memcpy(inv + hdr->resources_offset, b->resources.data, res_size);
+	if (tables_size)
+		memcpy(inv + hdr->tables_offset, b->tables.data, tables_size);
+	if (strings_size)
+		memcpy(inv + hdr->strings_offset, b->strings.data, strings_size);
+	if (b->text_size)
+		memcpy(inv + hdr->text_offset, b->text, b->text_size);
+
+	*size = total;
+	return inv;
+}
+
+/* extract_version_inventory:
+ *   Collect the version information of every RT_VERSION resource of a
+ *   library, in every language, with all of their string tables. The
+ *   resource directory is walked once and each block is parsed once.
+ *   Returns an inventory of `*size' bytes, which should be freed with
+ *   free().
+ */
+void *
+extract_version_inventory(WinLibrary *fi, size_t *size, wres_error *err)
+{
+	InventoryBuilder b;
+	WinResource *type_wr, *name_wr, *lang_wr;
+	int level, c, d, name_count, lang_count;
+	void *inv;
+
+	type_wr = find_resource(fi, "16", NULL, NULL, &level, err);
+	if (type_wr == NULL)
+		return NULL;
+	name_wr = list_resources(fi, type_wr, &name_count, err);
+	free(type_wr);
+	if (name_wr == NULL)
+		return NULL;
+
+	memset(&b, 0, sizeof(b));
+	b.resources.elem_size = sizeof(WinVerInventoryResource);
+	b.tables.elem_size = sizeof(WinVerInventoryTable);
+	b.strings.elem_size = sizeof(WinVerInventoryString);
+
+	for (c = 0; c < name_count; c++) {
+		if (!name_wr[c].is_directory) {
+			/* NE resources have no language */
+			add_resource(&b, fi, name_wr[c].id, &name_wr[c], 0);
+			continue;
+		}
+		lang_wr = list_resources(fi, &name_wr[c], &lang_count, NULL);
+		if (lang_wr == NULL)
+			continue;
+		for (d = 0; d < lang_count; d++) {
+			uint16_t lang = 0;
+
+			parse_uint16(lang_wr[d].id, &lang);
+			add_resource(&b, fi, name_wr[c].id, &lang_wr[d], lang);
+		}
+		free(lang_wr);
+	}
+	free(name_wr);
+
+	inv = finish_inventory(&b, size, err);
+	free(b.resources.data);
+	free(b.tables.data);
+	free(b.strings.data);
+	free(b.text);
+	free(b.slots);
+	return inv;
+}
+
+static bool
+array_in_bounds(uint32_t offset, uint32_t count, size_t elem_size, uint32_t size)
+{
+	return offset <= size && count <= (size - offset) / elem_size && offset % 4 == 0;
+}
+
+/* version_inventory_is_valid:
+ *   Check that an inventory of `size' bytes read from elsewhere can be
+ *   accessed safely: every offset and index must be in bounds and every
+ *   string terminated.
+ */
+bool
+version_inventory_is_valid(const void *inv, size_t size)
+{
+	const WinVerInventoryHeader *hdr = inv;
+	const WinVerInventoryResource *res;
+	const WinVerInventoryTable *tables;
+	const WinVerInventoryString *strings;
+	const char *text;
+	uint32_t c;
+
+	if (size < sizeof(WinVerInventoryHeader) || (uintptr_t) inv % 4 != 0)
+		return false;
+	if (hdr->magic != VERINV_MAGIC || hdr->version != VERINV_VERSION || hdr->size > size)
+		return false;
+	if (!array_in_bounds(hdr->resources_offset, hdr->resource_count, sizeof(*res), hdr->size)
+	    || !array_in_bounds(hdr->tables_offset, hdr->table_count, sizeof(*tables), hdr->size)
+	    || !array_in_bounds(hdr->strings_offset, hdr->string_count, sizeof(*strings), hdr->size)
+	    || hdr->text_offset > hdr->size || hdr->text_size > hdr->size - hdr->text_offset)
+		return false;
+
+	text = (const char *) inv + hdr->text_offset;
+	if (hdr->text_size > 0 && text[hdr->text_size - 1] != '\0')
+		return false;
+#define TEXT_OK(off) ((off) < hdr->text_size)
+
+	res = VERINV_RESOURCES(inv);
+	for (c = 0; c < hdr->resource_count; c++) {
+		if (!TEXT_OK(res[c].name) || res[c].first_table > hdr->table_count
+		    || res[c].table_count > hdr->table_count - res[c].first_table)
+			return false;
+	}
+	tables = VERINV_TABLES(inv);
+	for (c = 0; c < hdr->table_count; c++) {
+		if (!TEXT_OK(tables[c].name) || tables[c].first_string > hdr->string_count
+		    || tables[c].string_count > hdr->string_count - tables[c].first_string)
+			return false;
+	}
+	strings = VERINV_STRINGS(inv);
+	for (c = 0; c < hdr->string_count; c++) {
+		if (!TEXT_OK(strings[c].key) || !TEXT_OK(strings[c].value))
+			return false;
+	}
+#undef TEXT_OK
+	return true;
+}
+
+/* version_inventory_text:
+ *   Returns the string at offset `off' of the text pool.
+ */
+const char *
+version_inventory_text(const void *inv, uint32_t off)
+{
+	return (const char *) inv + VERINV_HEADER(inv)->text_offset + off;
+}
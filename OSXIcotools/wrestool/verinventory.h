@@ -0,0 +1,94 @@
+/* verinventory.h - All the version information of a library in one blob
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VERINVENTORY_H
+#define VERINVENTORY_H
+
+#include "wrestool.h"
+
+
+/* An inventory is a single block of memory with no pointers in it, so it
+ * can be written to disk or sent elsewhere as it is. All the offsets are
+ * from the start of the inventory, except the ones to strings, which are
+ * from the start of the text pool. Strings are UTF-8, NUL-terminated and
+ * stored once even when they are used many times. All the numbers are in
+ * the byte order of the machine that made the inventory. */
+
+#define VERINV_MAGIC	(0x4E495657)	/* `WVIN' */
+#define VERINV_VERSION	(1)
+
+typedef struct _WinVerInventoryHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;				/* of the whole inventory */
+	uint32_t resource_count;
+	uint32_t resources_offset;	/* WinVerInventoryResource[resource_count] */
+	uint32_t table_count;
+	uint32_t tables_offset;		/* WinVerInventoryTable[table_count] */
+	uint32_t string_count;
+	uint32_t strings_offset;	/* WinVerInventoryString[string_count] */
+	uint32_t text_size;
+	uint32_t text_offset;
+} WinVerInventoryHeader;
+
+#define VERINV_RES_HAS_FIXED_INFO	(0x1)
+#define VERINV_RES_16BIT			(0x2)
+
+/* One RT_VERSION resource, in one language */
+typedef struct _WinVerInventoryResource {
+	uint32_t name;				/* string */
+	uint16_t lang;
+	uint16_t flags;				/* VERINV_RES_* */
+	uint16_t file_version[4];
+	uint16_t product_version[4];
+	uint32_t file_flags;
+	uint32_t file_os;
+	uint32_t file_type;
+	uint32_t file_subtype;
+	uint32_t first_table;		/* index in the table array */
+	uint32_t table_count;
+} WinVerInventoryResource;
+
+typedef struct _WinVerInventoryTable {
+	uint32_t name;				/* string, like `040904b0' */
+	uint16_t lang;
+	uint16_t codepage;
+	uint32_t first_string;		/* index in the string array */
+	uint32_t string_count;
+} WinVerInventoryTable;
+
+typedef struct _WinVerInventoryString {
+	uint32_t key;				/* string */
+	uint32_t value;				/* string */
+} WinVerInventoryString;
+
+
+void *extract_version_inventory(WinLibrary *, size_t *, wres_error *);
+bool version_inventory_is_valid(const void *, size_t);
+const char *version_inventory_text(const void *, uint32_t);
+
+#define VERINV_HEADER(inv) ((const WinVerInventoryHeader *) (inv))
+#define VERINV_RESOURCES(inv) \
+	((const WinVerInventoryResource *) ((const char *) (inv) + VERINV_HEADER(inv)->resources_offset))
+#define VERINV_TABLES(inv) \
+	((const WinVerInventoryTable *) ((const char *) (inv) + VERINV_HEADER(inv)->tables_offset))
+#define VERINV_STRINGS(inv) \
+	((const WinVerInventoryString *) ((const char *) (inv) + VERINV_HEADER(inv)->strings_offset))
+
+
+#endif
@@ -0,0 +1,406 @@
+/* wresdclient.c - Protocol of wresd and client for it
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The client of wresd is kept small so that the Quick Look and Spotlight
+ * plugins can use it without loading anything themselves. A client has
+ * one connection, made when it is first needed and made again if wresd
+ * has been restarted in the meantime. The requests of a call are sent
+ * in batches of up to WRESD_MAX_BATCH, and the replies are read back
+ * before the next batch is sent. A client must not be used by two
+ * threads at once. */
+
+#include <config.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "xalloc.h"			/* Gnulib */
+#include "wresdclient.h"
+
+#ifdef MSG_NOSIGNAL
+#  define SEND_FLAGS MSG_NOSIGNAL
+#else
+#  define SEND_FLAGS 0
+#endif
+
+/* added to the time limits of the requests of a batch, for the time
+ * wresd takes to get to them */
+#define REPLY_GRACE_MS		(1000)
+
+struct _WresdClient {
+	char *path;
+	int fd;						/* -1 if not connected */
+	bool reused;				/* the connection has had a batch already */
+};
+
+
+/* wresd_default_socket_path:
+ *   Returns the path of the socket both ends use unless told otherwise:
+ *   $WRESD_SOCKET, or wresd.sock in $XDG_RUNTIME_DIR, or wresd-<uid>.sock
+ *   in $TMPDIR or /tmp. The string must be freed.
+ */
+char *
+wresd_default_socket_path(void)
+{
+	const char *env, *dir, *name = "wresd.sock";
+	char *path;
+
+	env = getenv("WRESD_SOCKET");
+	if (env != NULL && env[0] != '\0')
+		return xstrdup(env);
+	/* XDG_RUNTIME_DIR and TMPDIR on macOS are private to the user; /tmp
+	 * is not, so another user can take the name there first, but then
+	 * the check of the peer makes both ends refuse to talk */
+	dir = getenv("XDG_RUNTIME_DIR");
+	if (dir == NULL || dir[0] == '\0') {
+		dir = getenv("TMPDIR");
+		name = NULL;
+	}
+	if (dir == NULL || dir[0] == '\0')
+		dir = "/tmp";
+	path = xmalloc(strlen(dir) + 32);
+	if (name)
+		sprintf(path, "%s%s%s", dir, dir[strlen(dir) - 1] == '/' ? "" : "/", name);
+	else
+		sprintf(path, "%s%swresd-%u.sock", dir, dir[strlen(dir) - 1] == '/' ? "" : "/",
+		        (unsigned) getuid());
+	return path;
+}
+
+/* wresd_check_peer:
+ *   Make sure that the other end of the socket `fd' is run by the same
+ *   user, so that neither end talks to a process of another user who
+ *   got hold of the path of the socket. Returns -EPERM if it is not.
+ */
+wres_error
+wresd_check_peer(int fd)
+{
+#if defined(SO_PEERCRED)
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+		return -errno;
+	return cred.uid == getuid() ? WRES_ERROR_NONE : -EPERM;
+#else
+	uid_t uid;
+	gid_t gid;
+
+	if (getpeereid(fd, &uid, &gid) < 0)
+		return -errno;
+	return uid == getuid() ? WRES_ERROR_NONE : -EPERM;
+#endif
+}
+
+/* wresd_send:
+ *   Write all of `size' bytes to the socket `fd'.
+ */
+wres_error
+wresd_send(int fd, const void *data, size_t size)
+{
+	const char *p = data;
+	ssize_t n;
+
+	while (size > 0) {
+		n = send(fd, p, size, SEND_FLAGS);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += n;
+		size -= n;
+	}
+	return WRES_ERROR_NONE;
+}
+
+/* wresd_receive:
+ *   Read exactly `size' bytes from the socket `fd'. Returns
+ *   WRES_ERROR_PREMATUREEND if the other end closes it first.
+ */
+wres_error
+wresd_receive(int fd, void *data, size_t size)
+{
+	char *p = data;
+	ssize_t n;
+
+	while (size > 0) {
+		n = recv(fd, p, size, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (n == 0)
+			return WRES_ERROR_PREMATUREEND;
+		p += n;
+		size -= n;
+	}
+	return WRES_ERROR_NONE;
+}
+
+/* wresd_connect:
+ *   Connect to the socket at `path'. Returns the descriptor, or -1 with
+ *   the error in `err': -EPERM if the socket belongs to another user.
+ */
+int
+wresd_connect(const char *path, wres_error *err)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		*err = -ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		*err = -errno;
+		return -1;
+	}
+#ifdef SO_NOSIGPIPE
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &(int){1}, sizeof(int));
+#endif
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		*err = -errno;
+		close(fd);
+		return -1;
+	}
+	*err = wresd_check_peer(fd);
+	if (*err != WRES_ERROR_NONE) {
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	return fd;
+}
+
+/* new_wresd_client:
+ *   Make a client of the wresd listening at `path', or at the default
+ *   path if NULL. Fails if wresd cannot be reached.
+ */
+WresdClient *
+new_wresd_client(const char *path, wres_error *err)
+{
+	WresdClient *c;
+
+	c = xcalloc(1, sizeof(WresdClient));
+	c->path = path ? xstrdup(path) : wresd_default_socket_path();
+	c->fd = wresd_connect(c->path, err);
+	if (c->fd < 0) {
+		free_wresd_client(c);
+		return NULL;
+	}
+	return c;
+}
+
+void
+free_wresd_client(WresdClient *c)
+{
+	if (c->fd >= 0)
+		close(c->fd);
+	free(c->path);
+	free(c);
+}
+
+static void
+disconnect(WresdClient *c)
+{
+	close(c->fd);
+	c->fd = -1;
+	c->reused = false;
+}
+
+/* set_reply_timeout:
+ *   Wait for the replies of a batch no longer than its requests may
+ *   take, unless one of them has no limit.
+ */
+static void
+set_reply_timeout(int fd, const WresdCall *calls, size_t count)
+{
+	struct timeval tv = {0, 0};
+	uint64_t total_ms = REPLY_GRACE_MS;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (calls[i].timeout_ms == 0) {
+			total_ms = 0;
+			break;
+		}
+		total_ms += calls[i].timeout_ms;
+	}
+	tv.tv_sec = total_ms / 1000;
+	tv.tv_usec = (total_ms % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static wres_error
+send_batch(WresdClient *c, const WresdCall *calls, size_t count)
+{
+	WresdBatchHeader bh;
+	WresdRequestHeader rh;
+	size_t size, pathlen, i;
+	wres_error err;
+	char *buf, *p;
+
+	size = sizeof(bh);
+	for (i = 0; i < count; i++)
+		size += sizeof(rh) + strlen(calls[i].path);
+	p = buf = xmalloc(size);
+
+	bh.magic = WRESD_MAGIC;
+	bh.count = (uint32_t) count;
+	memcpy(p, &bh, sizeof(bh));
+	p += sizeof(bh);
+	for (i = 0; i < count; i++) {
+		pathlen = strlen(calls[i].path);
+		rh.kind = (uint16_t) calls[i].kind;
+		rh.path_size = (uint16_t) pathlen;
+		rh.arg = calls[i].arg;
+		rh.timeout_ms = calls[i].timeout_ms;
+		memcpy(p, &rh, sizeof(rh));
+		p += sizeof(rh);
+		memcpy(p, calls[i].path, pathlen);
+		p += pathlen;
+	}
+
+	err = wresd_send(c->fd, buf, size);
+	free(buf);
+	return err;
+}
+
+static wres_error
+receive_replies(WresdClient *c, WresdCall *calls, size_t count)
+{
+	WresdBatchHeader bh;
+	WresdReplyHeader rh;
+	wres_error err;
+	size_t i;
+
+	err = wresd_receive(c->fd, &bh, sizeof(bh));
+	if (err != WRES_ERROR_NONE)
+		return err;
+	if (bh.magic != WRESD_MAGIC || bh.count != count)
+		return WRES_ERROR_BADMESSAGE;
+
+	for (i = 0; i < count; i++) {
+		err = wresd_receive(c->fd, &rh, sizeof(rh));
+		if (err != WRES_ERROR_NONE)
+			return err;
+		if (rh.size > WRESD_MAX_REPLY_SIZE || rh.error < WRES_ERROR_FIRST || rh.error > WRES_ERROR_LAST)
+			return WRES_ERROR_BADMESSAGE;
+		calls[i].error = rh.error;
+		calls[i].size = rh.size;
+		if (rh.size > 0) {
+			calls[i].data = xmalloc(rh.size);
+			err = wresd_receive(c->fd, calls[i].data, rh.size);
+			if (err != WRES_ERROR_NONE)
+				return err;
+		}
+	}
+	return WRES_ERROR_NONE;
+}
+
+/* call_batch:
+ *   Send up to WRESD_MAX_BATCH requests and read their replies. wresd
+ *   may have closed a connection that has been idle, or been restarted,
+ *   so a failure on a connection that was used before is retried once
+ *   on a new one. Requests have no side effects, so it does not matter
+ *   if wresd has already done some of them.
+ */
+static wres_error
+call_batch(WresdClient *c, WresdCall *calls, size_t count)
+{
+	wres_error err;
+	bool retry;
+
+	for (;;) {
+		if (c->fd < 0) {
+			c->fd = wresd_connect(c->path, &err);
+			if (c->fd < 0)
+				return err;
+		}
+		set_reply_timeout(c->fd, calls, count);
+		err = send_batch(c, calls, count);
+		if (err == WRES_ERROR_NONE)
+			err = receive_replies(c, calls, count);
+		if (err == WRES_ERROR_NONE) {
+			c->reused = true;
+			return WRES_ERROR_NONE;
+		}
+
+		free_wresd_call_data(calls, count);
+		retry = c->reused && (err == -EPIPE || err == -ECONNRESET || err == WRES_ERROR_PREMATUREEND);
+		disconnect(c);
+		if (!retry)
+			return err;
+	}
+}
+
+/* wresd_client_call:
+ *   Send the `count' requests in `calls' and fill in their replies. The
+ *   paths must be absolute, since wresd does not know the current
+ *   directory of the caller. Returns an error if the requests could not
+ *   be made at all; the error of each request is in its WresdCall. The
+ *   data of the replies must be freed with free_wresd_call_data().
+ */
+wres_error
+wresd_client_call(WresdClient *c, WresdCall *calls, size_t count)
+{
+	wres_error err;
+	size_t i, n;
+
+	for (i = 0; i < count; i++) {
+		calls[i].error = WRES_ERROR_UNKNOWN;
+		calls[i].data = NULL;
+		calls[i].size = 0;
+		if (calls[i].kind <= 0 || calls[i].kind >= WRESD_REQUEST_END
+		    || calls[i].path == NULL || calls[i].path[0] != '/'
+		    || strlen(calls[i].path) > WRESD_MAX_PATH)
+			return WRES_ERROR_INVALIDPARAM;
+	}
+
+	for (i = 0; i < count; i += n) {
+		n = count - i < WRESD_MAX_BATCH ? count - i : WRESD_MAX_BATCH;
+		err = call_batch(c, calls + i, n);
+		if (err != WRES_ERROR_NONE) {
+			free_wresd_call_data(calls, i);
+			return err;
+		}
+	}
+	return WRES_ERROR_NONE;
+}
+
+/* free_wresd_call_data:
+ *   Free the data of the replies to `count' requests.
+ */
+void
+free_wresd_call_data(WresdCall *calls, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		free(calls[i].data);
+		calls[i].data = NULL;
+		calls[i].size = 0;
+	}
+}
@@ -0,0 +1,93 @@
+/* wresdclient.h - Protocol of wresd and client for it
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WRESDCLIENT_H
+#define WRESDCLIENT_H
+
+#include "wrestool.h"
+
+
+/* wresd keeps libraries loaded and what was extracted from them, and
+ * answers batches of requests on a Unix domain socket. A batch is a
+ * WresdBatchHeader followed by `count' requests, each a WresdRequestHeader
+ * followed by the path of the file (absolute, not NUL-terminated). The
+ * replies come back in the same order, as a WresdBatchHeader followed by
+ * a WresdReplyHeader and `size' bytes of data for each request. Numbers
+ * are in the byte order of the machine, since both ends are on it. */
+
+#define WRESD_MAGIC				(0x31445257)	/* `WRD1' */
+#define WRESD_MAX_BATCH			(256)
+#define WRESD_MAX_PATH			(4096)
+#define WRESD_MAX_REPLY_SIZE	(64 * 1024 * 1024)
+
+/* Kinds of requests */
+enum {
+	WRESD_CLASSIFY = 1,		/* JSON object with the format, from the headers only */
+	WRESD_ICON,				/* best image of the first icon to be shown at `arg'
+							 * pixels (0 for the biggest): a PNG or an `.ico';
+							 * the first frame of an animated icon if there
+							 * is no other */
+	WRESD_VERSION_INFO,		/* version inventory, see verinventory.h */
+	WRESD_METADATA,			/* JSON object, as written by wrescan */
+	WRESD_REQUEST_END
+};
+
+typedef struct _WresdBatchHeader {
+	uint32_t magic;
+	uint32_t count;
+} WresdBatchHeader;
+
+typedef struct _WresdRequestHeader {
+	uint16_t kind;
+	uint16_t path_size;
+	uint32_t arg;
+	uint32_t timeout_ms;	/* 0 for no limit */
+} WresdRequestHeader;
+
+typedef struct _WresdReplyHeader {
+	int32_t error;			/* wres_error */
+	uint32_t size;
+} WresdReplyHeader;
+
+/* A request and its reply, as seen by the client */
+typedef struct _WresdCall {
+	int kind;				/* in */
+	const char *path;		/* in */
+	uint32_t arg;			/* in */
+	uint32_t timeout_ms;	/* in */
+	wres_error error;		/* out */
+	void *data;				/* out: allocated, NULL if empty */
+	size_t size;			/* out */
+} WresdCall;
+
+typedef struct _WresdClient WresdClient;
+
+
+char *wresd_default_socket_path(void);
+int wresd_connect(const char *, wres_error *);
+wres_error wresd_check_peer(int);
+wres_error wresd_send(int, const void *, size_t);
+wres_error wresd_receive(int, void *, size_t);
+
+WresdClient *new_wresd_client(const char *, wres_error *);
+void free_wresd_client(WresdClient *);
+wres_error wresd_client_call(WresdClient *, WresdCall *, size_t);
+void free_wresd_call_data(WresdCall *, size_t);
+
+
+#endif
@@ -18,6 +18,8 @@
  */
 
 #include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include "fileread.h"
 #include "wrestool.h"
 
@@ -26,6 +28,7 @@ WinLibrary *new_winlibrary_from_file(const char *fn, wres_error *err)
 {
 	WinLibrary *fl = calloc(sizeof(WinLibrary), 1);
 	
+	fl->refcount = 1;
 	fl->name = strdup(fn);
 	if (!fl->name) {
 		if (err) *err = WRES_ERROR_OUTOFMEMORY;
@@ -55,12 +58,135 @@ WinLibrary *new_winlibrary_from_file(const char *fn, wres_error *err)
 }
 
 
+/* new_winlibrary:
+ *   Make an empty library, to be loaded with reload_winlibrary(). This
+ *   way options such as `hash_flags' can be set before the first load.
+ *   Returns NULL if out of memory.
+ */
+WinLibrary *new_winlibrary(void)
+{
+	WinLibrary *fl = calloc(sizeof(WinLibrary), 1);
+	
+	if (fl)
+		fl->refcount = 1;
+	return fl;
+}
+
+
+/* new_winlibrary_from_fd:
+ *   Load a library from an open file descriptor, which is owned by the
+ *   library from then on (and closed even if loading fails). `fn' is
+ *   only used as the name of the library.
+ */
+WinLibrary *new_winlibrary_from_fd(int fd, const char *fn, wres_error *err)
+{
+	WinLibrary *fl = calloc(sizeof(WinLibrary), 1);
+	wres_error e;
+	
+	if (!fl) {
+		close(fd);
+		if (err) *err = WRES_ERROR_OUTOFMEMORY;
+		return NULL;
+	}
+	fl->refcount = 1;
+	if ((e = reload_winlibrary_from_fd(fl, fd, fn))) {
+		free_winlibrary(fl);
+		if (err) *err = e;
+		return NULL;
+	}
+	return fl;
+}
+
+
+/* reload_winlibrary:
+ *   Unload the file of a WinLibrary nobody else has references to, and
+ *   load another one in the same structure. Meant for tools that go
+ *   through many files one after the other. If loading fails, the
+ *   library is left empty, but it can still be reloaded or freed.
+ */
+wres_error reload_winlibrary(WinLibrary *fl, const char *fn)
+{
+	int fd = open(fn, O_RDONLY | O_CLOEXEC);
+	
+	if (fd < 0)
+		return -errno;
+	return reload_winlibrary_from_fd(fl, fd, fn);
+}
+
+
+/* reload_winlibrary_from_fd:
+ *   Like reload_winlibrary(), but the file is already open. The library
+ *   owns `fd' from then on.
+ */
+wres_error reload_winlibrary_from_fd(WinLibrary *fl, int fd, const char *fn)
+{
+	char *name;
+	wres_error e;
+	
+	if (fl->refcount != 1) {
+		close(fd);
+		return WRES_ERROR_INVALIDPARAM;
+	}
+	
+	if (fl->memory)
+		unload_library(fl);
+	if (fl->file)
+		fclose(fl->file);
+	fl->file = NULL;
+	fl->memory = NULL;
+	fl->first_resource = NULL;
+	fl->total_size = 0;
+	fl->file_size = 0;
+	fl->resource_digest = 0;
+	memset(&fl->hashes, 0, sizeof(fl->hashes));
+	
+	name = realloc(fl->name, strlen(fn) + 1);
+	if (!name) {
+		close(fd);
+		return WRES_ERROR_OUTOFMEMORY;
+	}
+	fl->name = strcpy(name, fn);
+	
+	fl->file = fdopen(fd, "rb");
+	if (fl->file == NULL) {
+		e = -errno;
+		close(fd);
+		return e;
+	}
+	
+	if ((e = load_library(fl))) {
+		unload_library(fl);
+		return e;
+	}
+	return WRES_ERROR_NONE;
+}
+
+
+/* retain_winlibrary:
+ *   Add a reference to a WinLibrary. Used by whoever hands out pointers
+ *   into the library's memory that may outlive the original owner.
+ */
+WinLibrary *retain_winlibrary(WinLibrary *fl)
+{
+	__atomic_add_fetch(&fl->refcount, 1, __ATOMIC_RELAXED);
+	return fl;
+}
+
+
+/* free_winlibrary:
+ *   Drop a reference to a WinLibrary; the library is unloaded and freed
+ *   when the last reference goes away.
+ */
 void free_winlibrary(WinLibrary *fl)
 {
+	if (__atomic_sub_fetch(&fl->refcount, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+	
 	unload_library(fl);
 	if (fl->file)
     	fclose(fl->file);
   	free(fl->name);
+  	free(fl);
 }
 
 
@@ -85,6 +211,9 @@ const char *wres_strerr(wres_error err)
 		"unsupported resource type", /* WRES_ERROR_UNSUPPRESTYPE */
 		"invalid section layout", /* WRES_ERROR_INVALIDSECLAYOUT */
 		"invalid bitmap data", /* WRES_ERROR_INVALIDDIB */
+		"invalid version information", /* WRES_ERROR_INVALIDVERINFO */
+		"operation cancelled", /* WRES_ERROR_CANCELLED */
+		"invalid message from wresd", /* WRES_ERROR_BADMESSAGE */
 	};
 	return errors[err];
 }
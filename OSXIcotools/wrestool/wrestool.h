@@ -31,17 +31,39 @@
 #include <getopt.h>		/* GNU Libc/Gnulib */
 
 
+/* ELAST is a BSD extension; Linux keeps errno values below 4096 */
+#ifndef ELAST
+#define ELAST			4095
+#endif
+
 #define NE_BINARY		0
 #define PE_BINARY		1
 #define PEPLUS_BINARY	2
 
+/* hashes of the whole file that load_library() can compute */
+#define WRES_HASH_SHA256		1
+#define WRES_HASH_XXH64_TREE	2
+
+typedef struct _WinFileHashes {
+	int computed;				/* WRES_HASH_* flags of the valid fields */
+	uint8_t sha256[32];
+	uint64_t xxh64_tree;		/* see xxh64_tree() */
+	uint64_t size;				/* bytes hashed, the size of the file */
+	uint64_t microseconds;		/* from the mapping of the file to the last hash */
+} WinFileHashes;
+
 typedef struct _WinLibrary {
 	char *name;
 	FILE *file;
 	char *memory;
 	uint8_t *first_resource;
 	int binary_type;
-	off_t total_size;
+	off_t total_size;			/* of the memory, the loaded image for PE */
+	off_t file_size;			/* of the file on disk */
+	int refcount;
+	uint64_t resource_digest;	/* XXH64 of the resources, as loaded */
+	int hash_flags;				/* WRES_HASH_* to compute when loading */
+	WinFileHashes hashes;
 } WinLibrary;
 
 typedef struct _WinResource {
@@ -73,6 +95,9 @@ enum {
 	WRES_ERROR_UNSUPPRESTYPE,
 	WRES_ERROR_INVALIDSECLAYOUT,
 	WRES_ERROR_INVALIDDIB,
+	WRES_ERROR_INVALIDVERINFO,
+	WRES_ERROR_CANCELLED,
+	WRES_ERROR_BADMESSAGE,
 	
 	WRES_ERROR_END,
 	WRES_ERROR_FIRST = WRES_ERROR_ERRNO_FIRST,
@@ -80,7 +105,12 @@ enum {
 };
 
 
+WinLibrary *new_winlibrary(void);
 WinLibrary *new_winlibrary_from_file(const char *fn, wres_error *);
+WinLibrary *new_winlibrary_from_fd(int fd, const char *fn, wres_error *);
+wres_error reload_winlibrary(WinLibrary *fl, const char *fn);
+wres_error reload_winlibrary_from_fd(WinLibrary *fl, int fd, const char *fn);
+WinLibrary *retain_winlibrary(WinLibrary *fl);
 void free_winlibrary(WinLibrary *fl);
 const char *wres_strerr(wres_error);
 
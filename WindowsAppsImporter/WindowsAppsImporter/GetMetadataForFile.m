@@ -10,12 +10,13 @@
 #import <Foundation/Foundation.h>
 #import "EIExeFile.h"
 #import "EIVersionInfo.h"
+#import "EIFileCache.h"
 
 
 Boolean GetMetadataForFile(void *thisInterface, CFMutableDictionaryRef attributes, CFStringRef contentTypeUTI, CFStringRef pathToFile);
 
 
-BOOL EIMetadataForFile(NSURL *url, NSMutableDictionary *attr)
+static BOOL EIExtractMetadataForFile(NSURL *url, NSMutableDictionary *attr)
 {
   static NSSet *recognizedTags;
   static dispatch_once_t onceToken;
@@ -39,34 +40,100 @@ BOOL EIMetadataForFile(NSURL *url, NSMutableDictionary *attr)
   [attr setObject:fmt forKey:@"com_danielecattaneo_windowsappsimporter_binaryformat"];
   
   EIVersionInfo *vir = [f versionInfo];
-  if (vir) {
-    NSString *queryHeader = @"\\StringFileInfo\\*";
-    NSArray *resSrch = [vir querySubNodesUnder:queryHeader error:NULL];
+  [vir enumerateStringsInTable:nil usingBlock:^(NSString *node, NSString *value, BOOL *stop) {
+    if ([@"" isEqual:value])
+      return;
     
-    if (resSrch) {
-      for (NSString *node in resSrch) {
-        NSString *vpath = [NSString stringWithFormat:@"%@\\%@", queryHeader, node];
-        NSString *value = [vir queryStringValue:vpath error:NULL];
-        if (!value || [@"" isEqual:value])
-          continue;
-        
-        NSString *destkey;
-        if ([node isEqual:@"Comments"])
-          destkey = (NSString *)kMDItemComment;
-        else if ([node isEqual:@"LegalCopyright"])
-          destkey = (NSString *)kMDItemCopyright;
-        else {
-          NSString *test = [@"com_danielecattaneo_windowsappsimporter_" stringByAppendingString:[node lowercaseString]];
-          if ([recognizedTags containsObject:test])
-            destkey = test;
-        }
-        
-        if (destkey)
-          [attr setObject:value forKey:destkey];
-      }
+    NSString *destkey;
+    if ([node isEqual:@"Comments"])
+      destkey = (NSString *)kMDItemComment;
+    else if ([node isEqual:@"LegalCopyright"])
+      destkey = (NSString *)kMDItemCopyright;
+    else {
+      NSString *test = [@"com_danielecattaneo_windowsappsimporter_" stringByAppendingString:[node lowercaseString]];
+      if ([recognizedTags containsObject:test])
+        destkey = test;
     }
+    
+    if (destkey)
+      [attr setObject:value forKey:destkey];
+  }];
+  
+  if ([vir hasFixedFileInfo]) {
+    NSArray *partKeys = @[
+      @"com_danielecattaneo_windowsappsimporter_fileversionmajor",
+      @"com_danielecattaneo_windowsappsimporter_fileversionminor",
+      @"com_danielecattaneo_windowsappsimporter_fileversionbuild",
+      @"com_danielecattaneo_windowsappsimporter_fileversionrevision"];
+    for (int i = 0; i < 4; i++)
+      [attr setObject:@([vir fixedFileVersionPart:i]) forKey:partKeys[i]];
+    
+    /* Packed as major << 48 | minor << 32 | build << 16 | revision, so
+     * that version ranges can be queried with a numeric comparison */
+    [attr setObject:@([vir fixedFileVersionNumber])
+             forKey:@"com_danielecattaneo_windowsappsimporter_fileversionnumber"];
+    [attr setObject:@([vir fixedProductVersionNumber])
+             forKey:@"com_danielecattaneo_windowsappsimporter_productversionnumber"];
+    
+    uint32_t flags = [vir fixedFileFlags];
+    [attr setObject:[NSNumber numberWithBool:(flags & VS_FF_DEBUG) != 0]
+             forKey:@"com_danielecattaneo_windowsappsimporter_debugbuild"];
+    [attr setObject:[NSNumber numberWithBool:(flags & VS_FF_PRERELEASE) != 0]
+             forKey:@"com_danielecattaneo_windowsappsimporter_prerelease"];
+    [attr setObject:[NSNumber numberWithBool:(flags & VS_FF_PATCHED) != 0]
+             forKey:@"com_danielecattaneo_windowsappsimporter_patched"];
+    
+    [attr setObject:@([vir fixedFileOS]) forKey:@"com_danielecattaneo_windowsappsimporter_fileos"];
+    [attr setObject:@([vir fixedFileType]) forKey:@"com_danielecattaneo_windowsappsimporter_filetype"];
   }
   
+  NSDictionary *manifestKeys = @{
+    @"requestedExecutionLevel": @"com_danielecattaneo_windowsappsimporter_executionlevel",
+    @"uiAccess": @"com_danielecattaneo_windowsappsimporter_uiaccess",
+    @"dpiAware": @"com_danielecattaneo_windowsappsimporter_dpiaware",
+    @"dpiAwareness": @"com_danielecattaneo_windowsappsimporter_dpiawareness",
+    @"supportedOS": @"com_danielecattaneo_windowsappsimporter_supportedos",
+    @"name": @"com_danielecattaneo_windowsappsimporter_assemblyname",
+    @"version": @"com_danielecattaneo_windowsappsimporter_assemblyversion",
+    @"processorArchitecture": @"com_danielecattaneo_windowsappsimporter_processorarchitecture"};
+  [[f manifestAttributes] enumerateKeysAndObjectsUsingBlock:^(NSString *key, id value, BOOL *stop) {
+    NSString *destkey = [manifestKeys objectForKey:key];
+    if (destkey)
+      [attr setObject:value forKey:destkey];
+  }];
+  
+  return YES;
+}
+
+
+/* Spotlight reimports files often even if they did not change, so the
+ * attributes are kept in a cache, as a binary property list. */
+BOOL EIMetadataForFile(NSURL *url, NSMutableDictionary *attr)
+{
+  static EIFileCache *cache;
+  static dispatch_once_t onceToken;
+  dispatch_once(&onceToken, ^{
+    cache = [EIFileCache cacheNamed:@"WindowsAppsImporter.cache" maximumSize:16 * 1024 * 1024];
+  });
+  
+  if (!cache)
+    return EIExtractMetadataForFile(url, attr);
+  
+  NSData *plist = [cache dataOfKind:FILE_CACHE_METADATA forFileURL:url generatedBy:^NSData *{
+    NSMutableDictionary *fresh = [NSMutableDictionary dictionary];
+    if (!EIExtractMetadataForFile(url, fresh))
+      return nil;
+    return [NSPropertyListSerialization dataWithPropertyList:fresh
+      format:NSPropertyListBinaryFormat_v1_0 options:0 error:nil];
+  }];
+  if (!plist)
+    return NO;
+  
+  NSDictionary *cached = [NSPropertyListSerialization propertyListWithData:plist
+    options:NSPropertyListImmutable format:NULL error:nil];
+  if (![cached isKindOfClass:[NSDictionary class]])
+    return NO;
+  [attr addEntriesFromDictionary:cached];
   return YES;
 }
 
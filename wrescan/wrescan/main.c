@@ -0,0 +1,323 @@
+/* main.c - Scan directory trees for Windows executables
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* wrescan hands the trees given on the command line to crawl_trees(),
+ * which spreads the directories and files among a pool of threads. Each
+ * thread keeps its own JSON buffer, and writes one NDJSON record per
+ * executable, a few hundred lines at a time. Files that are not Windows
+ * executables are skipped silently. What is extracted from the resources
+ * is kept by their digest, so that copies of the same library are only
+ * looked into once. With -H, the files are also hashed while they are
+ * loaded, and the time the hashes took is added up per worker. With -i,
+ * the first icon of each executable is written with writev() straight
+ * from the mapping of the file, one file per distinct set of resources. */
+
+#include <config.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include "wrestool.h"
+#include "crawler.h"
+#include "extract.h"
+#include "metadata.h"
+#include "restable.h"
+#include "resultstore.h"
+#include "common/jsonwriter.h"
+
+
+#define PROGRAM_NAME		"wrescan"
+#define MAX_WORKERS			(256)
+#define OUTPUT_CHUNK_SIZE	(64 * 1024)
+#define DEFAULT_STORE_MIB	(64)
+
+/* what the hashes of the files of a worker took */
+typedef struct {
+	uint64_t bytes;
+	uint64_t microseconds;
+} HashTotals;
+
+typedef struct {
+	FILE *out;
+	pthread_mutex_t out_lock;
+	bool report_errors;
+	int icon_dir;				/* -1 if icons are not saved */
+	WinResultStore *store;		/* NULL if disabled */
+	JSONWriter writers[MAX_WORKERS];
+	HashTotals hash_totals[MAX_WORKERS];
+} ScanOutput;
+
+
+static void
+flush_output(ScanOutput *so, JSONWriter *w)
+{
+	if (w->size == 0)
+		return;
+	pthread_mutex_lock(&so->out_lock);
+	fwrite(w->data, 1, w->size, so->out);
+	pthread_mutex_unlock(&so->out_lock);
+	json_writer_reset(w);
+}
+
+static void
+write_error_record(JSONWriter *w, const char *path, wres_error err)
+{
+	json_begin_object(w);
+	json_key(w, "name");
+	json_cstring(w, path);
+	json_key(w, "error");
+	json_cstring(w, wres_strerr(err));
+	json_end_object(w);
+	json_end_line(w);
+}
+
+/* save_icon:
+ *   Write the first icon of a library in the icon directory, named after
+ *   the digest of its resources, so that copies of a library are written
+ *   only once. The images are not copied out of the mapping of the file.
+ */
+static void
+save_icon(ScanOutput *so, WinLibrary *fl)
+{
+	WinResourceVec vec;
+	WinResource *wr;
+	wres_error err;
+	char name[24];
+	int level, fd;
+
+	wr = find_resource(fl, "14", "", "", &level, NULL);
+	if (wr == NULL)
+		return;
+	err = extract_resource_vec(fl, wr, "14", "", &vec);
+	free(wr);
+	if (err != WRES_ERROR_NONE)
+		return;
+
+	snprintf(name, sizeof(name), "%016llx.ico", (unsigned long long) fl->resource_digest);
+	fd = openat(so->icon_dir, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if (fd >= 0) {
+		if (write_resource_vec(fd, &vec) < 0 || close(fd) != 0) {
+			fd = -1;
+			unlinkat(so->icon_dir, name, 0);
+		}
+	}
+	if (fd < 0 && errno != EEXIST) {
+		pthread_mutex_lock(&so->out_lock);
+		fprintf(stderr, "%s: %s: %s\n", PROGRAM_NAME, name, strerror(errno));
+		pthread_mutex_unlock(&so->out_lock);
+	}
+	free_resource_vec(&vec);
+}
+
+static void
+scan_library(int worker, WinLibrary *fl, const char *path, wres_error err, void *ctx)
+{
+	ScanOutput *so = ctx;
+	JSONWriter *w = &so->writers[worker];
+
+	if (fl != NULL) {
+		if (so->store)
+			write_library_metadata_using_store(w, fl, so->store);
+		else
+			write_library_metadata(w, fl);
+		json_end_line(w);
+		if (so->icon_dir >= 0)
+			save_icon(so, fl);
+		if (fl->hashes.computed) {
+			so->hash_totals[worker].bytes += fl->hashes.size;
+			so->hash_totals[worker].microseconds += fl->hashes.microseconds;
+		}
+	} else if (err == WRES_ERROR_WRONGFORMAT) {
+		/* not being a Windows executable is not an error */
+		return;
+	} else if (so->report_errors) {
+		write_error_record(w, path, err);
+	} else if (err < WRES_ERROR_NONE) {
+		/* I/O errors, such as unreadable directories */
+		pthread_mutex_lock(&so->out_lock);
+		fprintf(stderr, "%s: %s: %s\n", PROGRAM_NAME, path, wres_strerr(err));
+		pthread_mutex_unlock(&so->out_lock);
+	}
+
+	if (w->size >= OUTPUT_CHUNK_SIZE)
+		flush_output(so, w);
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+print_summary(const ScanOutput *so, int jobs, const WinCrawlStats *stats, double elapsed)
+{
+	WinResultStoreStats store_stats;
+	HashTotals hashed = {0, 0};
+	double mb = stats->bytes / (1024.0 * 1024.0);
+	int i;
+
+	if (elapsed <= 0)
+		elapsed = 1e-9;
+	fprintf(stderr, "%s: %llu files, %llu executables, %llu errors, %.1f MiB in %.2f s "
+	        "(%.0f files/s, %.1f MiB/s)\n", PROGRAM_NAME,
+	        (unsigned long long) stats->files, (unsigned long long) stats->libraries,
+	        (unsigned long long) stats->errors, mb, elapsed,
+	        stats->files / elapsed, mb / elapsed);
+	if (so->store) {
+		result_store_stats(so->store, &store_stats);
+		fprintf(stderr, "%s: resources of %llu executables already seen, %llu unique\n", PROGRAM_NAME,
+		        (unsigned long long) store_stats.hits, (unsigned long long) store_stats.misses);
+	}
+	for (i = 0; i < jobs; i++) {
+		hashed.bytes += so->hash_totals[i].bytes;
+		hashed.microseconds += so->hash_totals[i].microseconds;
+	}
+	if (hashed.bytes > 0) {
+		/* the throughput of a file is what matters for hashing while
+		 * loading, whatever the number of workers */
+		mb = hashed.bytes / (1024.0 * 1024.0);
+		fprintf(stderr, "%s: hashed %.1f MiB at %.1f MiB/s per file\n", PROGRAM_NAME,
+		        mb, mb / (hashed.microseconds > 0 ? hashed.microseconds / 1e6 : 1e-9));
+	}
+}
+
+/* parse_hash:
+ *   Returns the WRES_HASH_* flag of a hash named on the command line.
+ */
+static int
+parse_hash(const char *name)
+{
+	if (strcmp(name, "sha256") == 0)
+		return WRES_HASH_SHA256;
+	if (strcmp(name, "xxh64-tree") == 0)
+		return WRES_HASH_XXH64_TREE;
+	return 0;
+}
+
+static void
+usage(FILE *f)
+{
+	fprintf(f, "Usage: %s [-j jobs] [-o output] [-m MiB] [-H hash]... [-i dir] [-e] [-q]\n"
+	        "          path...\n"
+	        "Write one JSON record per Windows executable found under each path.\n\n"
+	        "  -j jobs    number of worker threads (default: one per CPU)\n"
+	        "  -o output  write the records to output instead of stdout\n"
+	        "  -m MiB     memory for reusing what was extracted from identical\n"
+	        "             resources (default: %d, 0 to disable)\n"
+	        "  -H hash    add a hash of each file to its record, computed while it\n"
+	        "             is loaded: sha256 or xxh64-tree (can be repeated)\n"
+	        "  -i dir     write the first icon of each executable in dir, as an\n"
+	        "             .ico file named after the digest of its resources\n"
+	        "  -e         also write a record for each file that cannot be read\n"
+	        "  -q         do not print the summary at the end\n", PROGRAM_NAME, DEFAULT_STORE_MIB);
+}
+
+int
+main(int argc, char **argv)
+{
+	static ScanOutput so;
+	WinCrawlStats stats;
+	bool quiet = false;
+	long jobs, store_mib = DEFAULT_STORE_MIB;
+	double start;
+	int c, i, hash, hash_flags = 0;
+
+	so.out = stdout;
+	so.icon_dir = -1;
+	pthread_mutex_init(&so.out_lock, NULL);
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((c = getopt(argc, argv, "j:o:m:H:i:eqh")) != -1) {
+		switch (c) {
+		case 'j':
+			jobs = strtol(optarg, NULL, 10);
+			break;
+		case 'o':
+			so.out = fopen(optarg, "w");
+			if (so.out == NULL) {
+				fprintf(stderr, "%s: %s: %s\n", PROGRAM_NAME, optarg, strerror(errno));
+				return 1;
+			}
+			break;
+		case 'm':
+			store_mib = strtol(optarg, NULL, 10);
+			break;
+		case 'H':
+			hash = parse_hash(optarg);
+			if (hash == 0) {
+				fprintf(stderr, "%s: %s: unknown hash\n", PROGRAM_NAME, optarg);
+				return 1;
+			}
+			hash_flags |= hash;
+			break;
+		case 'i':
+			so.icon_dir = open(optarg, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+			if (so.icon_dir < 0) {
+				fprintf(stderr, "%s: %s: %s\n", PROGRAM_NAME, optarg, strerror(errno));
+				return 1;
+			}
+			break;
+		case 'e':
+			so.report_errors = true;
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		case 'h':
+			usage(stdout);
+			return 0;
+		default:
+			usage(stderr);
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(stderr);
+		return 1;
+	}
+	if (jobs < 1)
+		jobs = 1;
+	if (jobs > MAX_WORKERS)
+		jobs = MAX_WORKERS;
+
+	for (i = 0; i < jobs; i++)
+		json_writer_init(&so.writers[i]);
+	if (store_mib > 0)
+		so.store = new_result_store((size_t) store_mib * 1024 * 1024);
+
+	start = now();
+	crawl_trees(argv + optind, argc - optind, (int)jobs, hash_flags, scan_library, &so, &stats);
+
+	for (i = 0; i < jobs; i++) {
+		flush_output(&so, &so.writers[i]);
+		json_writer_free(&so.writers[i]);
+	}
+	if (fclose(so.out) != 0) {
+		fprintf(stderr, "%s: %s\n", PROGRAM_NAME, strerror(errno));
+		return 1;
+	}
+	if (!quiet)
+		print_summary(&so, (int)jobs, &stats, now() - start);
+	if (so.store)
+		free_result_store(so.store);
+	if (so.icon_dir >= 0)
+		close(so.icon_dir);
+	return stats.errors ? 2 : 0;
+}
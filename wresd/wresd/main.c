@@ -0,0 +1,662 @@
+/* main.c - Daemon answering requests about Windows executables
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* wresd keeps what it has loaded and extracted between the requests of
+ * its clients, so that asking again about a file, or about one with the
+ * same resources, costs no more than a look-up. Libraries are kept in a
+ * WinLibraryCache, and icons and version inventories in a WinResultStore
+ * by a key made of the resource_digest of the library and the request;
+ * the part of the metadata that only depends on the resources is kept
+ * in the same store by write_library_metadata_using_store().
+ *
+ * Each connection is served by a thread of its own, up to a limit, and
+ * the next ones wait in the backlog of the socket. The requests of a
+ * batch are answered in order, except that all the classifications of
+ * a batch are done first with one call to scan_headers(), and the replies
+ * go back in one write. Each request runs under a cancel token that
+ * expires after its time limit. The socket is only accessible to the
+ * user running wresd, and connections from other users are refused. */
+
+#include <config.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "xalloc.h"			/* Gnulib */
+#include "wrestool.h"
+#include "anicursor.h"
+#include "cancel.h"
+#include "extract.h"
+#include "headerscan.h"
+#include "libcache.h"
+#include "metadata.h"
+#include "restable.h"
+#include "resultstore.h"
+#include "verinventory.h"
+#include "wresdclient.h"
+#include "common/jsonwriter.h"
+#include "common/xxhash.h"
+
+
+#define PROGRAM_NAME			"wresd"
+#define DEFAULT_LIBRARY_MIB		(256)
+#define DEFAULT_LIBRARY_AGE		(60)
+#define DEFAULT_STORE_MIB		(64)
+#define DEFAULT_MAX_CLIENTS		(64)
+#define CLIENT_IDLE_TIMEOUT		(60)		/* seconds between batches */
+#define POLL_INTERVAL_MS		(1000)
+
+typedef struct {
+	WinLibraryCache *libraries;
+	WinResultStore *store;
+	pthread_mutex_t lock;
+	int clients;
+	int max_clients;
+	double last_activity;
+	uint64_t batches;
+	uint64_t requests;
+	uint64_t failures;			/* requests answered with an error */
+} Server;
+
+typedef struct {
+	WresdRequestHeader header;
+	char *path;
+	wres_error error;			/* found before answering */
+	WinHeaderScan scan;			/* WRESD_CLASSIFY only */
+} Request;
+
+typedef struct {
+	Server *srv;
+	int fd;
+	WinHeaderScanner *scanner;	/* made on the first classification */
+	JSONWriter json;
+	char *out;					/* replies of the batch */
+	size_t out_size;
+	size_t out_capacity;
+	uint64_t failures;
+} Connection;
+
+
+static volatile sig_atomic_t stopping;
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+append_output(Connection *c, const void *data, size_t size)
+{
+	if (size == 0)
+		return;
+	if (c->out_size + size > c->out_capacity) {
+		c->out_capacity = c->out_capacity ? c->out_capacity * 2 : 64 * 1024;
+		if (c->out_capacity < c->out_size + size)
+			c->out_capacity = c->out_size + size;
+		c->out = xrealloc(c->out, c->out_capacity);
+	}
+	memcpy(c->out + c->out_size, data, size);
+	c->out_size += size;
+}
+
+/* append_reply:
+ *   Add the reply to a request to the output of the batch. The data is
+ *   left out if there is an error.
+ */
+static void
+append_reply(Connection *c, wres_error err, const void *data, size_t size)
+{
+	WresdReplyHeader rh;
+
+	if (err != WRES_ERROR_NONE || size > WRESD_MAX_REPLY_SIZE) {
+		rh.error = err != WRES_ERROR_NONE ? err : WRES_ERROR_OUTOFMEMORY;
+		rh.size = 0;
+		c->failures++;
+	} else {
+		rh.error = WRES_ERROR_NONE;
+		rh.size = (uint32_t) size;
+	}
+	append_output(c, &rh, sizeof(rh));
+	append_output(c, data, rh.size);
+}
+
+/* result_key:
+ *   The key of what a request extracts from a library in the result
+ *   store. It must not be the bare digest, which is used for metadata.
+ */
+static uint64_t
+result_key(const WinLibrary *fl, const Request *rq)
+{
+	uint64_t parts[2];
+
+	parts[0] = fl->resource_digest;
+	parts[1] = (uint64_t) rq->header.kind << 32 | rq->header.arg;
+	return xxh64(parts, sizeof(parts), 0);
+}
+
+/* extract_icon:
+ *   The image of the first icon of the library that fits best `size_px'
+ *   pixels, made into a file of its own. Libraries with no static icon
+ *   get the best image of the first frame of their first animated icon.
+ */
+static void *
+extract_icon(WinLibrary *fl, uint32_t size_px, size_t *size, wres_error *err)
+{
+	WinResourceVec vec;
+	WinIconImage img;
+	WinResource *wr;
+	void *data;
+	int level;
+
+	if (size_px > INT16_MAX) {
+		*err = WRES_ERROR_INVALIDPARAM;
+		return NULL;
+	}
+	wr = find_resource(fl, "14", "", "", &level, err);
+	if (wr != NULL) {
+		*err = find_group_icon_image_for_size(fl, wr, (int) size_px, &img);
+		free(wr);
+		if (*err == WRES_ERROR_NONE)
+			*err = icon_image_vec(&img, true, &vec);
+	} else if (*err == WRES_ERROR_RESNOTFOUND
+	           && (wr = find_resource(fl, "22", "", "", &level, err)) != NULL) {
+		*err = extract_ani_frame_vec(fl, wr, true, &vec);
+		free(wr);
+	} else {
+		return NULL;
+	}
+	if (*err != WRES_ERROR_NONE)
+		return NULL;
+	data = flatten_resource_vec(&vec, size);
+	free_resource_vec(&vec);
+	return data;
+}
+
+/* answer_from_store:
+ *   Answer a request for an icon or a version inventory with what is in
+ *   the store, or extract it and put it there. The whole reply is kept,
+ *   so that files without the resource are not looked into again; but
+ *   nothing made after the token of the request fired is, since any
+ *   error may then come from the cancellation, and neither are errors
+ *   that another try may not get, such as I/O errors.
+ */
+static void
+answer_from_store(Connection *c, WinLibrary *fl, const Request *rq)
+{
+	WinResultStore *store = c->srv->store;
+	wres_error err = WRES_ERROR_NONE;
+	uint64_t key = result_key(fl, rq);
+	size_t size = 0, start;
+	void *data;
+
+	data = result_store_get(store, key, &size);
+	if (data != NULL) {
+		append_output(c, data, size);
+		if (((WresdReplyHeader *) data)->error != WRES_ERROR_NONE)
+			c->failures++;
+		free(data);
+		return;
+	}
+
+	if (rq->header.kind == WRESD_ICON)
+		data = extract_icon(fl, rq->header.arg, &size, &err);
+	else
+		data = extract_version_inventory(fl, &size, &err);
+	/* an error after the token fired is most likely its doing */
+	if (err != WRES_ERROR_NONE && wres_cancelled())
+		err = WRES_ERROR_CANCELLED;
+	start = c->out_size;
+	append_reply(c, err, data, size);
+	free(data);
+
+	if (wres_cancelled() || err == WRES_ERROR_CANCELLED
+	    || (err >= WRES_ERROR_ERRNO_FIRST && err <= WRES_ERROR_ERRNO_LAST))
+		result_store_abandon(store, key);
+	else
+		result_store_put(store, key, c->out + start, c->out_size - start);
+}
+
+static void
+answer_library_request(Connection *c, const Request *rq)
+{
+	WinCancelToken token, *old_token;
+	WinLibrary *fl;
+	wres_error err;
+
+	cancel_token_init(&token, (uint64_t) rq->header.timeout_ms * 1000);
+	old_token = set_thread_cancel_token(&token);
+
+	fl = library_cache_open(c->srv->libraries, rq->path, &err);
+	if (fl == NULL) {
+		append_reply(c, err, NULL, 0);
+	} else if (rq->header.kind == WRESD_METADATA) {
+		json_writer_reset(&c->json);
+		write_library_metadata_using_store(&c->json, fl, c->srv->store);
+		/* parts that were cut short are missing from the object */
+		err = wres_cancelled() ? WRES_ERROR_CANCELLED : WRES_ERROR_NONE;
+		append_reply(c, err, c->json.data, c->json.size);
+	} else {
+		answer_from_store(c, fl, rq);
+	}
+	if (fl != NULL)
+		free_winlibrary(fl);
+
+	set_thread_cancel_token(old_token);
+}
+
+/* classify_batch:
+ *   Scan the headers of all the files of the batch that are to be
+ *   classified at once.
+ */
+static void
+classify_batch(Connection *c, Request *rqs, size_t count)
+{
+	WinHeaderScan items[WRESD_MAX_BATCH];
+	wres_error err;
+	size_t i, n = 0;
+
+	for (i = 0; i < count; i++) {
+		if (rqs[i].header.kind == WRESD_CLASSIFY && rqs[i].error == WRES_ERROR_NONE)
+			items[n++].path = rqs[i].path;
+	}
+	if (n == 0)
+		return;
+
+	if (c->scanner == NULL)
+		c->scanner = new_header_scanner(1, &err);
+	if (c->scanner == NULL) {
+		for (i = 0; i < count; i++)
+			if (rqs[i].header.kind == WRESD_CLASSIFY && rqs[i].error == WRES_ERROR_NONE)
+				rqs[i].error = err;
+		return;
+	}
+	scan_headers(c->scanner, AT_FDCWD, items, n);
+
+	for (i = 0, n = 0; i < count; i++) {
+		if (rqs[i].header.kind == WRESD_CLASSIFY && rqs[i].error == WRES_ERROR_NONE) {
+			rqs[i].scan = items[n++];
+			rqs[i].error = rqs[i].scan.error;
+		}
+	}
+}
+
+/* receive_batch:
+ *   Read the requests of a batch. Requests that make no sense get an
+ *   error of their own; anything that breaks the framing ends the
+ *   connection. Returns the number of requests, or 0 if the connection
+ *   is to be closed.
+ */
+static size_t
+receive_batch(Connection *c, Request *rqs)
+{
+	WresdBatchHeader bh;
+	Request *rq;
+	size_t i;
+
+	if (wresd_receive(c->fd, &bh, sizeof(bh)) != WRES_ERROR_NONE)
+		return 0;
+	if (bh.magic != WRESD_MAGIC || bh.count == 0 || bh.count > WRESD_MAX_BATCH)
+		return 0;
+
+	for (i = 0; i < bh.count; i++) {
+		rq = &rqs[i];
+		rq->path = NULL;
+		if (wresd_receive(c->fd, &rq->header, sizeof(rq->header)) != WRES_ERROR_NONE
+		    || rq->header.path_size > WRESD_MAX_PATH)
+			goto fail;
+		rq->path = xmalloc(rq->header.path_size + 1);
+		if (wresd_receive(c->fd, rq->path, rq->header.path_size) != WRES_ERROR_NONE)
+			goto fail;
+		rq->path[rq->header.path_size] = '\0';
+
+		/* paths are resolved by wresd, not by the client */
+		rq->error = WRES_ERROR_NONE;
+		if (rq->header.kind == 0 || rq->header.kind >= WRESD_REQUEST_END
+		    || rq->path[0] != '/' || strlen(rq->path) != rq->header.path_size)
+			rq->error = WRES_ERROR_INVALIDPARAM;
+	}
+	return bh.count;
+
+fail:
+	free(rqs[i].path);
+	while (i > 0)
+		free(rqs[--i].path);
+	return 0;
+}
+
+static void
+answer_batch(Connection *c, Request *rqs, size_t count)
+{
+	WresdBatchHeader bh;
+	size_t i;
+
+	classify_batch(c, rqs, count);
+
+	c->out_size = 0;
+	c->failures = 0;
+	bh.magic = WRESD_MAGIC;
+	bh.count = (uint32_t) count;
+	append_output(c, &bh, sizeof(bh));
+	for (i = 0; i < count; i++) {
+		if (rqs[i].error != WRES_ERROR_NONE) {
+			append_reply(c, rqs[i].error, NULL, 0);
+		} else if (rqs[i].header.kind == WRESD_CLASSIFY) {
+			json_writer_reset(&c->json);
+			write_header_scan_metadata(&c->json, &rqs[i].scan);
+			append_reply(c, WRES_ERROR_NONE, c->json.data, c->json.size);
+		} else {
+			answer_library_request(c, &rqs[i]);
+		}
+	}
+
+	pthread_mutex_lock(&c->srv->lock);
+	c->srv->batches++;
+	c->srv->requests += count;
+	c->srv->failures += c->failures;
+	c->srv->last_activity = now();
+	pthread_mutex_unlock(&c->srv->lock);
+}
+
+static void *
+serve_connection(void *arg)
+{
+	Connection *c = arg;
+	Server *srv = c->srv;
+	Request *rqs;
+	size_t count, i;
+
+	rqs = xmalloc(sizeof(Request) * WRESD_MAX_BATCH);
+	json_writer_init(&c->json);
+	while ((count = receive_batch(c, rqs)) > 0) {
+		answer_batch(c, rqs, count);
+		for (i = 0; i < count; i++)
+			free(rqs[i].path);
+		if (wresd_send(c->fd, c->out, c->out_size) != WRES_ERROR_NONE)
+			break;
+	}
+
+	close(c->fd);
+	if (c->scanner)
+		free_header_scanner(c->scanner);
+	json_writer_free(&c->json);
+	free(c->out);
+	free(rqs);
+	free(c);
+
+	pthread_mutex_lock(&srv->lock);
+	srv->clients--;
+	srv->last_activity = now();
+	pthread_mutex_unlock(&srv->lock);
+	return NULL;
+}
+
+static void
+start_connection(Server *srv, int fd)
+{
+	struct timeval tv = {CLIENT_IDLE_TIMEOUT, 0};
+	pthread_attr_t attr;
+	pthread_t thread;
+	Connection *c;
+
+	/* the socket is only accessible to us, but it may have been made
+	 * accessible to others afterwards */
+	if (wresd_check_peer(fd) != WRES_ERROR_NONE) {
+		close(fd);
+		return;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &(int){1}, sizeof(int));
+#endif
+	/* the client reconnects if it comes back after this */
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	c = xcalloc(1, sizeof(Connection));
+	c->srv = srv;
+	c->fd = fd;
+
+	pthread_mutex_lock(&srv->lock);
+	srv->clients++;
+	pthread_mutex_unlock(&srv->lock);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, serve_connection, c) != 0) {
+		close(fd);
+		free(c);
+		pthread_mutex_lock(&srv->lock);
+		srv->clients--;
+		pthread_mutex_unlock(&srv->lock);
+	}
+	pthread_attr_destroy(&attr);
+}
+
+/* listen_at:
+ *   Make the socket at `path', replacing the one left by a wresd that is
+ *   not running anymore. Returns -1 after printing the error.
+ */
+static int
+listen_at(const char *path)
+{
+	struct sockaddr_un addr;
+	wres_error err;
+	mode_t old_mask;
+	int fd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: %s: %s\n", PROGRAM_NAME, path, strerror(ENAMETOOLONG));
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	fd = wresd_connect(path, &err);
+	if (fd >= 0) {
+		close(fd);
+		fprintf(stderr, "%s: %s: already in use by another wresd\n", PROGRAM_NAME, path);
+		return -1;
+	}
+	if (err == -EPERM) {
+		fprintf(stderr, "%s: %s: in use by another user\n", PROGRAM_NAME, path);
+		return -1;
+	}
+	if (err == -ECONNREFUSED)
+		unlink(path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s\n", PROGRAM_NAME, strerror(errno));
+		return -1;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	old_mask = umask(077);
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+		fprintf(stderr, "%s: %s: %s\n", PROGRAM_NAME, path, strerror(errno));
+		umask(old_mask);
+		close(fd);
+		return -1;
+	}
+	umask(old_mask);
+	return fd;
+}
+
+static void
+handle_stop(int sig)
+{
+	(void) sig;
+	stopping = 1;
+}
+
+static void
+print_summary(Server *srv, double elapsed)
+{
+	WinLibraryCacheStats lib_stats;
+	WinResultStoreStats store_stats;
+
+	library_cache_stats(srv->libraries, &lib_stats);
+	result_store_stats(srv->store, &store_stats);
+	fprintf(stderr, "%s: %llu requests in %llu batches, %llu failed, in %.0f s\n", PROGRAM_NAME,
+	        (unsigned long long) srv->requests, (unsigned long long) srv->batches,
+	        (unsigned long long) srv->failures, elapsed);
+	fprintf(stderr, "%s: libraries: %llu hits, %llu misses, %llu kept (%.1f MiB)\n", PROGRAM_NAME,
+	        (unsigned long long) lib_stats.hits, (unsigned long long) lib_stats.misses,
+	        (unsigned long long) lib_stats.entries, lib_stats.bytes / (1024.0 * 1024.0));
+	fprintf(stderr, "%s: results: %llu hits, %llu misses, %llu kept (%.1f MiB)\n", PROGRAM_NAME,
+	        (unsigned long long) store_stats.hits, (unsigned long long) store_stats.misses,
+	        (unsigned long long) store_stats.entries, store_stats.bytes / (1024.0 * 1024.0));
+}
+
+static void
+usage(FILE *f)
+{
+	fprintf(f, "Usage: %s [-s socket] [-l MiB] [-a seconds] [-m MiB] [-c clients] [-i seconds] [-q]\n"
+	        "Answer requests about Windows executables on a local socket.\n\n"
+	        "  -s socket   path of the socket (default: $WRESD_SOCKET, else\n"
+	        "              wresd.sock in $XDG_RUNTIME_DIR, else\n"
+	        "              wresd-<uid>.sock in $TMPDIR or /tmp)\n"
+	        "  -l MiB      size of the libraries kept loaded (default: %d)\n"
+	        "  -a seconds  how long unused libraries are kept (default: %d)\n"
+	        "  -m MiB      memory for what was extracted from them (default: %d)\n"
+	        "  -c clients  connections served at once (default: %d)\n"
+	        "  -i seconds  exit after being idle this long (default: never)\n"
+	        "  -q          do not print the summary at the end\n", PROGRAM_NAME,
+	        DEFAULT_LIBRARY_MIB, DEFAULT_LIBRARY_AGE, DEFAULT_STORE_MIB, DEFAULT_MAX_CLIENTS);
+}
+
+int
+main(int argc, char **argv)
+{
+	static Server srv;
+	struct sigaction sa;
+	struct pollfd pfd;
+	char *path = NULL;
+	bool quiet = false;
+	long library_mib = DEFAULT_LIBRARY_MIB, library_age = DEFAULT_LIBRARY_AGE;
+	long store_mib = DEFAULT_STORE_MIB, max_clients = DEFAULT_MAX_CLIENTS, idle = 0;
+	double start;
+	int c, fd;
+
+	while ((c = getopt(argc, argv, "s:l:a:m:c:i:qh")) != -1) {
+		switch (c) {
+		case 's':
+			path = xstrdup(optarg);
+			break;
+		case 'l':
+			library_mib = strtol(optarg, NULL, 10);
+			break;
+		case 'a':
+			library_age = strtol(optarg, NULL, 10);
+			break;
+		case 'm':
+			store_mib = strtol(optarg, NULL, 10);
+			break;
+		case 'c':
+			max_clients = strtol(optarg, NULL, 10);
+			break;
+		case 'i':
+			idle = strtol(optarg, NULL, 10);
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		case 'h':
+			usage(stdout);
+			return 0;
+		default:
+			usage(stderr);
+			return 1;
+		}
+	}
+	if (optind < argc) {
+		usage(stderr);
+		return 1;
+	}
+	if (library_mib < 0)
+		library_mib = 0;
+	if (library_age < 1)
+		library_age = 1;
+	if (store_mib < 0)
+		store_mib = 0;
+	if (max_clients < 1)
+		max_clients = 1;
+	if (path == NULL)
+		path = wresd_default_socket_path();
+
+	fd = listen_at(path);
+	if (fd < 0) {
+		free(path);
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_stop;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+
+	srv.libraries = new_library_cache((size_t) library_mib * 1024 * 1024, (unsigned) library_age);
+	srv.store = new_result_store((size_t) store_mib * 1024 * 1024);
+	srv.max_clients = (int) max_clients;
+	pthread_mutex_init(&srv.lock, NULL);
+	start = srv.last_activity = now();
+
+	while (!stopping) {
+		pthread_mutex_lock(&srv.lock);
+		if (idle > 0 && srv.clients == 0 && now() - srv.last_activity >= idle)
+			stopping = 1;
+		/* when all the clients are being served, the next ones wait in
+		 * the backlog */
+		pfd.fd = srv.clients < srv.max_clients ? fd : -1;
+		pthread_mutex_unlock(&srv.lock);
+		if (stopping)
+			break;
+
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, POLL_INTERVAL_MS) > 0) {
+			c = accept(fd, NULL, NULL);
+			if (c >= 0)
+				start_connection(&srv, c);
+		}
+		library_cache_expire(srv.libraries);
+	}
+
+	close(fd);
+	unlink(path);
+	if (!quiet) {
+		pthread_mutex_lock(&srv.lock);
+		print_summary(&srv, now() - start);
+		pthread_mutex_unlock(&srv.lock);
+	}
+	/* connections still being served are cut off by the exit, so the
+	 * caches are left to them */
+	free(path);
+	return 0;
+}
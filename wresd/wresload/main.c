@@ -0,0 +1,356 @@
+/* main.c - Load generator for wresd
+ *
+ * Copyright (C) 2026 Daniele Cattaneo
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* wresload stands in for the Quick Look and Spotlight plugins: each of
+ * its threads has a connection of its own, and sends batches of requests
+ * about the files given on the command line, going round them, for a
+ * given time. The latency of each batch is recorded to report the
+ * throughput and the percentiles at the end. With -p, the replies to one
+ * round of requests are printed instead. */
+
+#include <config.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include "xalloc.h"			/* Gnulib */
+#include "wrestool.h"
+#include "wresdclient.h"
+
+
+#define PROGRAM_NAME		"wresload"
+#define MAX_THREADS			(256)
+#define DEFAULT_THREADS		(4)
+#define DEFAULT_BATCH		(16)
+#define DEFAULT_SECONDS		(10)
+
+typedef struct {
+	const char *socket_path;
+	char **paths;
+	size_t path_count;
+	int kinds[WRESD_REQUEST_END];
+	int kind_count;
+	uint32_t icon_size;
+	uint32_t timeout_ms;
+	size_t batch;
+	double end;
+} LoadSetup;
+
+typedef struct {
+	const LoadSetup *setup;
+	int index;
+	uint64_t requests;
+	uint64_t failures;
+	uint64_t bytes;
+	wres_error error;			/* of the connection, if it failed */
+	double *latencies;			/* of each batch, in seconds */
+	size_t latency_count;
+	size_t latency_capacity;
+} LoadThread;
+
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* fill_batch:
+ *   Make the requests of the n-th batch of a thread. The kinds of
+ *   request go round like the files, so that a file is not always asked
+ *   the same thing.
+ */
+static void
+fill_batch(const LoadSetup *ls, WresdCall *calls, size_t n)
+{
+	size_t i, k;
+
+	for (i = 0; i < ls->batch; i++) {
+		k = n * ls->batch + i;
+		calls[i].path = ls->paths[k % ls->path_count];
+		calls[i].kind = ls->kinds[(k / ls->path_count) % ls->kind_count];
+		calls[i].arg = calls[i].kind == WRESD_ICON ? ls->icon_size : 0;
+		calls[i].timeout_ms = ls->timeout_ms;
+	}
+}
+
+static void *
+run_thread(void *arg)
+{
+	LoadThread *lt = arg;
+	const LoadSetup *ls = lt->setup;
+	WresdClient *client;
+	WresdCall *calls;
+	double start;
+	size_t n, i;
+
+	client = new_wresd_client(ls->socket_path, &lt->error);
+	if (client == NULL)
+		return NULL;
+	calls = xcalloc(ls->batch, sizeof(WresdCall));
+
+	/* threads start at different places so that they do not all miss
+	 * the same files at first */
+	for (n = lt->index * 7919; now() < ls->end; n++) {
+		fill_batch(ls, calls, n);
+		start = now();
+		lt->error = wresd_client_call(client, calls, ls->batch);
+		if (lt->error != WRES_ERROR_NONE)
+			break;
+		if (lt->latency_count == lt->latency_capacity) {
+			lt->latency_capacity = lt->latency_capacity ? lt->latency_capacity * 2 : 1024;
+			lt->latencies = xrealloc(lt->latencies, lt->latency_capacity * sizeof(double));
+		}
+		lt->latencies[lt->latency_count++] = now() - start;
+		for (i = 0; i < ls->batch; i++) {
+			lt->requests++;
+			lt->bytes += calls[i].size;
+			if (calls[i].error != WRES_ERROR_NONE)
+				lt->failures++;
+		}
+		free_wresd_call_data(calls, ls->batch);
+	}
+
+	free(calls);
+	free_wresd_client(client);
+	return NULL;
+}
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void
+print_summary(LoadThread *threads, int count, double elapsed)
+{
+	uint64_t requests = 0, failures = 0, bytes = 0;
+	double *all;
+	size_t n = 0, i;
+	int t;
+
+	for (t = 0; t < count; t++) {
+		requests += threads[t].requests;
+		failures += threads[t].failures;
+		bytes += threads[t].bytes;
+		n += threads[t].latency_count;
+	}
+	all = xmalloc((n ? n : 1) * sizeof(double));
+	for (t = 0, i = 0; t < count; t++) {
+		memcpy(all + i, threads[t].latencies, threads[t].latency_count * sizeof(double));
+		i += threads[t].latency_count;
+	}
+	qsort(all, n, sizeof(double), compare_doubles);
+
+	if (elapsed <= 0)
+		elapsed = 1e-9;
+	printf("%llu requests in %zu batches, %llu failed, %.1f MiB of replies in %.2f s\n",
+	       (unsigned long long) requests, n, (unsigned long long) failures,
+	       bytes / (1024.0 * 1024.0), elapsed);
+	printf("%.0f requests/s, %.0f batches/s\n", requests / elapsed, n / elapsed);
+	if (n > 0)
+		printf("batch latency: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		       all[n / 2] * 1e3, all[n * 9 / 10] * 1e3, all[n * 99 / 100] * 1e3, all[n - 1] * 1e3);
+	free(all);
+}
+
+/* probe:
+ *   Print the reply to each kind of request about each file: the JSON
+ *   objects as they are, and the size of the rest.
+ */
+static int
+probe(const LoadSetup *ls)
+{
+	WresdClient *client;
+	WresdCall call;
+	wres_error err;
+	size_t i;
+	int k;
+
+	client = new_wresd_client(ls->socket_path, &err);
+	if (client == NULL) {
+		fprintf(stderr, "%s: %s\n", PROGRAM_NAME, wres_strerr(err));
+		return 1;
+	}
+	for (i = 0; i < ls->path_count; i++) {
+		for (k = 0; k < ls->kind_count; k++) {
+			memset(&call, 0, sizeof(call));
+			call.path = ls->paths[i];
+			call.kind = ls->kinds[k];
+			call.arg = call.kind == WRESD_ICON ? ls->icon_size : 0;
+			call.timeout_ms = ls->timeout_ms;
+			err = wresd_client_call(client, &call, 1);
+			if (err != WRES_ERROR_NONE) {
+				fprintf(stderr, "%s: %s\n", PROGRAM_NAME, wres_strerr(err));
+				free_wresd_client(client);
+				return 1;
+			}
+			if (call.error != WRES_ERROR_NONE)
+				printf("%s: %d: %s\n", call.path, call.kind, wres_strerr(call.error));
+			else if (call.kind == WRESD_CLASSIFY || call.kind == WRESD_METADATA)
+				printf("%.*s\n", (int) call.size, (char *) call.data);
+			else
+				printf("%s: %d: %zu bytes\n", call.path, call.kind, call.size);
+			free_wresd_call_data(&call, 1);
+		}
+	}
+	free_wresd_client(client);
+	return 0;
+}
+
+/* parse_kinds:
+ *   Fill in the kinds of request from a comma-separated list of names.
+ */
+static bool
+parse_kinds(LoadSetup *ls, char *list)
+{
+	static const char *names[WRESD_REQUEST_END] = {
+		NULL, "classify", "icon", "version", "metadata"
+	};
+	char *name;
+	int k;
+
+	ls->kind_count = 0;
+	for (name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+		for (k = 1; k < WRESD_REQUEST_END; k++)
+			if (strcmp(name, names[k]) == 0)
+				break;
+		if (k == WRESD_REQUEST_END || ls->kind_count == WRESD_REQUEST_END)
+			return false;
+		ls->kinds[ls->kind_count++] = k;
+	}
+	return ls->kind_count > 0;
+}
+
+static void
+usage(FILE *f)
+{
+	fprintf(f, "Usage: %s [-s socket] [-j threads] [-b batch] [-d seconds] [-k kinds]\n"
+	        "          [-z pixels] [-t ms] [-p] file...\n"
+	        "Send requests about the files to wresd as fast as it answers them.\n\n"
+	        "  -s socket   path of the socket of wresd\n"
+	        "  -j threads  number of connections (default: %d)\n"
+	        "  -b batch    requests per batch (default: %d)\n"
+	        "  -d seconds  how long to go on (default: %d)\n"
+	        "  -k kinds    comma-separated requests to make: classify, icon,\n"
+	        "              version, metadata (default: all of them)\n"
+	        "  -z pixels   size the icons are asked for (default: 0, the biggest)\n"
+	        "  -t ms       time limit of each request (default: none)\n"
+	        "  -p          print the replies to one round of requests instead\n",
+	        PROGRAM_NAME, DEFAULT_THREADS, DEFAULT_BATCH, DEFAULT_SECONDS);
+}
+
+int
+main(int argc, char **argv)
+{
+	static LoadSetup ls;
+	static LoadThread threads[MAX_THREADS];
+	pthread_t ids[MAX_THREADS];
+	char kinds[] = "classify,icon,version,metadata";
+	bool print = false, failed = false;
+	long jobs = DEFAULT_THREADS, seconds = DEFAULT_SECONDS;
+	double start;
+	int c, i;
+
+	ls.batch = DEFAULT_BATCH;
+	parse_kinds(&ls, kinds);
+	while ((c = getopt(argc, argv, "s:j:b:d:k:z:t:ph")) != -1) {
+		switch (c) {
+		case 's':
+			ls.socket_path = optarg;
+			break;
+		case 'j':
+			jobs = strtol(optarg, NULL, 10);
+			break;
+		case 'b':
+			ls.batch = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			seconds = strtol(optarg, NULL, 10);
+			break;
+		case 'k':
+			if (!parse_kinds(&ls, optarg)) {
+				fprintf(stderr, "%s: %s: unknown kind of request\n", PROGRAM_NAME, optarg);
+				return 1;
+			}
+			break;
+		case 'z':
+			ls.icon_size = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			ls.timeout_ms = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			print = true;
+			break;
+		case 'h':
+			usage(stdout);
+			return 0;
+		default:
+			usage(stderr);
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(stderr);
+		return 1;
+	}
+	if (jobs < 1)
+		jobs = 1;
+	if (jobs > MAX_THREADS)
+		jobs = MAX_THREADS;
+	if (ls.batch < 1)
+		ls.batch = 1;
+	if (ls.batch > WRESD_MAX_BATCH)
+		ls.batch = WRESD_MAX_BATCH;
+
+	/* wresd needs absolute paths */
+	ls.path_count = argc - optind;
+	ls.paths = xcalloc(ls.path_count, sizeof(char *));
+	for (i = 0; i < (int) ls.path_count; i++) {
+		ls.paths[i] = realpath(argv[optind + i], NULL);
+		if (ls.paths[i] == NULL) {
+			fprintf(stderr, "%s: %s: %s\n", PROGRAM_NAME, argv[optind + i], strerror(errno));
+			return 1;
+		}
+	}
+	if (print)
+		return probe(&ls);
+
+	start = now();
+	ls.end = start + seconds;
+	for (i = 0; i < jobs; i++) {
+		threads[i].setup = &ls;
+		threads[i].index = i;
+		pthread_create(&ids[i], NULL, run_thread, &threads[i]);
+	}
+	for (i = 0; i < jobs; i++) {
+		pthread_join(ids[i], NULL);
+		if (threads[i].error != WRES_ERROR_NONE) {
+			fprintf(stderr, "%s: thread %d: %s\n", PROGRAM_NAME, i, wres_strerr(threads[i].error));
+			failed = true;
+		}
+	}
+	print_summary(threads, (int) jobs, now() - start);
+	return failed ? 2 : 0;
+}